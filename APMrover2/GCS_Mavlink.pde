@@ -686,9 +686,17 @@ bool GCS_MAVLINK::try_send_message(enum ap_message id)
     case MSG_LIMITS_STATUS:
     case MSG_FENCE_STATUS:
     case MSG_WIND:
+    case MSG_SCHED_STATS:
         // unused
         break;
 
+    case MSG_DATAFLASH_STATS:
+#if HAL_OS_POSIX_IO
+        CHECK_PAYLOAD_SIZE(DEBUG_VECT);
+        gcs[chan-MAVLINK_COMM_0].send_dataflash_stats(DataFlash);
+#endif
+        break;
+
     case MSG_RETRY_DEFERRED:
         break; // just here to prevent a warning
 	}
@@ -971,6 +979,7 @@ GCS_MAVLINK::data_stream_send(void)
         send_message(MSG_HWSTATUS);
         send_message(MSG_RANGEFINDER);
         send_message(MSG_SYSTEM_TIME);
+        send_message(MSG_DATAFLASH_STATS);
     }
 }
 
@@ -179,6 +179,9 @@ struct PACKED log_Performance {
 // Write a performance monitoring packet. Total length : 19 bytes
 static void Log_Write_Performance()
 {
+    if (!DataFlash.ShouldLog(LOG_PERFORMANCE_MSG)) {
+        return;
+    }
     struct log_Performance pkt = {
         LOG_PACKET_HEADER_INIT(LOG_PERFORMANCE_MSG),
         time_ms         : millis(),
@@ -217,6 +220,9 @@ struct PACKED log_Camera {
 // Write a Camera packet. Total length : 26 bytes
 static void Log_Write_Camera()
 {
+    if (!DataFlash.ShouldLog(LOG_CAMERA_MSG)) {
+        return;
+    }
 #if CAMERA == ENABLED
     struct log_Camera pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CAMERA_MSG),
@@ -243,6 +249,9 @@ struct PACKED log_Steering {
 // Write a steering packet
 static void Log_Write_Steering()
 {
+    if (!DataFlash.ShouldLog(LOG_STEERING_MSG)) {
+        return;
+    }
     struct log_Steering pkt = {
         LOG_PACKET_HEADER_INIT(LOG_STEERING_MSG),
         time_ms        : hal.scheduler->millis(),
@@ -261,6 +270,9 @@ struct PACKED log_Startup {
 
 static void Log_Write_Startup(uint8_t type)
 {
+    if (!DataFlash.ShouldLog(LOG_STARTUP_MSG)) {
+        return;
+    }
     struct log_Startup pkt = {
         LOG_PACKET_HEADER_INIT(LOG_STARTUP_MSG),
         time_ms         : millis(),
@@ -291,6 +303,9 @@ struct PACKED log_Control_Tuning {
 // Write a control tuning packet. Total length : 22 bytes
 static void Log_Write_Control_Tuning()
 {
+    if (!DataFlash.ShouldLog(LOG_CTUN_MSG)) {
+        return;
+    }
     Vector3f accel = ins.get_accel();
     struct log_Control_Tuning pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CTUN_MSG),
@@ -317,6 +332,9 @@ struct PACKED log_Nav_Tuning {
 // Write a navigation tuning packet. Total length : 18 bytes
 static void Log_Write_Nav_Tuning()
 {
+    if (!DataFlash.ShouldLog(LOG_NTUN_MSG)) {
+        return;
+    }
     struct log_Nav_Tuning pkt = {
         LOG_PACKET_HEADER_INIT(LOG_NTUN_MSG),
         time_ms             : millis(),
@@ -341,14 +359,16 @@ struct PACKED log_Attitude {
 // Write an attitude packet
 static void Log_Write_Attitude()
 {
-    struct log_Attitude pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
-        time_ms : millis(),
-        roll    : (int16_t)ahrs.roll_sensor,
-        pitch   : (int16_t)ahrs.pitch_sensor,
-        yaw     : (uint16_t)ahrs.yaw_sensor
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_ATTITUDE_MSG)) {
+        struct log_Attitude pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
+            time_ms : millis(),
+            roll    : (int16_t)ahrs.roll_sensor,
+            pitch   : (int16_t)ahrs.pitch_sensor,
+            yaw     : (uint16_t)ahrs.yaw_sensor
+        };
+        DataFlash.WritePacket(&pkt, sizeof(pkt));
+    }
 #if AP_AHRS_NAVEKF_AVAILABLE
     DataFlash.Log_Write_EKF(ahrs);
     DataFlash.Log_Write_AHRS2(ahrs);
@@ -365,6 +385,9 @@ struct PACKED log_Mode {
 // Write a mode packet
 static void Log_Write_Mode()
 {
+    if (!DataFlash.ShouldLog(LOG_MODE_MSG)) {
+        return;
+    }
     struct log_Mode pkt = {
         LOG_PACKET_HEADER_INIT(LOG_MODE_MSG),
         time_ms         : millis(),
@@ -391,6 +414,9 @@ struct PACKED log_Sonar {
 // Write a sonar packet
 static void Log_Write_Sonar()
 {
+    if (!DataFlash.ShouldLog(LOG_SONAR_MSG)) {
+        return;
+    }
     uint16_t turn_time = 0;
     if (obstacle.turn_angle != 0) {
         turn_time = hal.scheduler->millis() - obstacle.detected_time_ms;
@@ -422,16 +448,18 @@ struct PACKED log_Current {
 
 static void Log_Write_Current()
 {
-    struct log_Current pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_CURRENT_MSG),
-        time_ms                 : millis(),
-        throttle_in             : channel_throttle->control_in,
-        battery_voltage         : (int16_t)(battery.voltage() * 100.0),
-        current_amps            : (int16_t)(battery.current_amps() * 100.0),
-        board_voltage           : (uint16_t)(hal.analogin->board_voltage()*1000),
-        current_total           : battery.current_total_mah()
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_CURRENT_MSG)) {
+        struct log_Current pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_CURRENT_MSG),
+            time_ms                 : millis(),
+            throttle_in             : channel_throttle->control_in,
+            battery_voltage         : (int16_t)(battery.voltage() * 100.0),
+            current_amps            : (int16_t)(battery.current_amps() * 100.0),
+            board_voltage           : (uint16_t)(hal.analogin->board_voltage()*1000),
+            current_total           : battery.current_total_mah()
+        };
+        DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    }
 
     // also write power status
     DataFlash.Log_Write_Power();
@@ -454,25 +482,27 @@ struct PACKED log_Compass {
 // Write a Compass packet. Total length : 15 bytes
 static void Log_Write_Compass()
 {
-    const Vector3f &mag_offsets = compass.get_offsets();
-    const Vector3f &mag_motor_offsets = compass.get_motor_offsets();
-    const Vector3f &mag = compass.get_field();
-    struct log_Compass pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_COMPASS_MSG),
-        time_ms         : millis(),
-        mag_x           : (int16_t)mag.x,
-        mag_y           : (int16_t)mag.y,
-        mag_z           : (int16_t)mag.z,
-        offset_x        : (int16_t)mag_offsets.x,
-        offset_y        : (int16_t)mag_offsets.y,
-        offset_z        : (int16_t)mag_offsets.z,
-        motor_offset_x  : (int16_t)mag_motor_offsets.x,
-        motor_offset_y  : (int16_t)mag_motor_offsets.y,
-        motor_offset_z  : (int16_t)mag_motor_offsets.z
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_COMPASS_MSG)) {
+        const Vector3f &mag_offsets = compass.get_offsets();
+        const Vector3f &mag_motor_offsets = compass.get_motor_offsets();
+        const Vector3f &mag = compass.get_field();
+        struct log_Compass pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_COMPASS_MSG),
+            time_ms         : millis(),
+            mag_x           : (int16_t)mag.x,
+            mag_y           : (int16_t)mag.y,
+            mag_z           : (int16_t)mag.z,
+            offset_x        : (int16_t)mag_offsets.x,
+            offset_y        : (int16_t)mag_offsets.y,
+            offset_z        : (int16_t)mag_offsets.z,
+            motor_offset_x  : (int16_t)mag_motor_offsets.x,
+            motor_offset_y  : (int16_t)mag_motor_offsets.y,
+            motor_offset_z  : (int16_t)mag_motor_offsets.z
+        };
+        DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    }
 #if COMPASS_MAX_INSTANCES > 1
-    if (compass.get_count() > 1) {
+    if (compass.get_count() > 1 && DataFlash.ShouldLog(LOG_COMPASS2_MSG)) {
         const Vector3f &mag2_offsets = compass.get_offsets(1);
         const Vector3f &mag2_motor_offsets = compass.get_motor_offsets(1);
         const Vector3f &mag2 = compass.get_field(1);
@@ -552,6 +582,11 @@ static void Log_Read(uint16_t log_num, uint16_t start_page, uint16_t end_page)
 // start a new log
 static void start_logging() 
 {
+    DataFlash.ClearCompact();
+    if (g.log_compact) {
+        DataFlash.SetCompact(LOG_ATTITUDE_MSG);
+        DataFlash.SetCompactCommon();
+    }
     in_mavlink_delay = true;
     DataFlash.StartNewLog();
     in_mavlink_delay = false;
@@ -51,6 +51,8 @@ public:
         // misc2
         k_param_log_bitmask = 40,
         k_param_gps,
+        k_param_log_compact,
+        k_param_DataFlash,
 
 
         // 110: Telemetry control
@@ -190,6 +192,7 @@ public:
     // Misc
     //
     AP_Int32    log_bitmask;
+    AP_Int8     log_compact;
     AP_Int16    num_resets;
     AP_Int8	    reset_switch_chan;
     AP_Int8     initial_mode;
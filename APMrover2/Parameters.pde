@@ -20,6 +20,13 @@ const AP_Param::Info var_info[] PROGMEM = {
     // @Values: 0:Disabled,3950:Default,4078:Default+IMU
     // @User: Advanced
 	GSCALAR(log_bitmask,            "LOG_BITMASK",      DEFAULT_LOG_BITMASK),
+
+    // @Param: LOG_COMPACT
+    // @DisplayName: Compact logging
+    // @Description: When enabled the high rate log messages are written as deltas against the previous message of the same type, which makes logs smaller. Compact logs need a log reader that understands the FMTC message
+    // @Values: 0:Disabled,1:Enabled
+    // @User: Advanced
+	GSCALAR(log_compact,            "LOG_COMPACT",      0),
 	GSCALAR(num_resets,             "SYS_NUM_RESETS",   0),
 
     // @Param: RST_SWITCH_CH
@@ -524,6 +531,12 @@ const AP_Param::Info var_info[] PROGMEM = {
     // @Path: ../libraries/AP_BoardConfig/AP_BoardConfig.cpp
     GOBJECT(BoardConfig,            "BRD_",       AP_BoardConfig),
 
+#if DATAFLASH_RATE_LIMIT
+    // @Group: LOG_
+    // @Path: ../libraries/DataFlash/LogFile.cpp
+    GOBJECT(DataFlash,              "LOG_",       DataFlash_Class),
+#endif
+
     // GPS driver
     // @Group: GPS_
     // @Path: ../libraries/AP_GPS/AP_GPS.cpp
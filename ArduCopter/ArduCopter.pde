@@ -754,7 +754,12 @@ AP_Param param_loader(var_info, MISSION_START_BYTE);
   scheduler table for fast CPUs - all regular tasks apart from the fast_loop()
   should be listed here, along with how often they should be called
   (in 2.5ms units) and the maximum time they are expected to take (in
-  microseconds)
+  microseconds). Tasks that share no state with the main thread may be
+  flagged with AP_SCHEDULER_FLAG_WORKER to run on a worker thread on
+  multi-core boards when SCHED_WORKERS is non-zero. update_notify only
+  reads the notify flags and drives the LEDs, so it qualifies. The
+  others share the GCS links, DataFlash or vehicle state with tasks run
+  on the main thread
   1    = 400hz
   2    = 200hz
   4    = 100hz
@@ -783,7 +788,7 @@ static const AP_Scheduler::Task scheduler_tasks[] PROGMEM = {
 #if FRAME_CONFIG == HELI_FRAME
     { check_dynamic_flight,  8,     10 },
 #endif
-    { update_notify,         8,     10 },
+    { update_notify,         8,     10, AP_SCHEDULER_FLAG_WORKER },
     { one_hz_loop,         400,     42 },
     { crash_check,          40,      2 },
     { gcs_check_input,	     8,    550 },
@@ -902,8 +907,17 @@ static void barometer_accumulate(void)
 
 static void perf_update(void)
 {
-    if (g.log_bitmask & MASK_LOG_PM)
+    if (g.log_bitmask & MASK_LOG_PM) {
         Log_Write_Performance();
+#if AP_SCHEDULER_TASK_STATS
+        DataFlash.Log_Write_Scheduler(scheduler);
+#endif
+#if HAL_OS_POSIX_IO
+        DataFlash.Log_Write_DataFlash_Stats();
+#endif
+        DataFlash.Log_Write_Rate_Stats();
+        DataFlash.Log_Write_Thread_Latency();
+    }
     if (scheduler.debug()) {
         cliSerial->printf_P(PSTR("PERF: %u/%u %lu\n"),
                             (unsigned)perf_info_get_num_long_running(),
@@ -911,6 +925,9 @@ static void perf_update(void)
                             (unsigned long)perf_info_get_max_time());
     }
     perf_info_reset();
+#if AP_SCHEDULER_TASK_STATS
+    scheduler.reset_task_stats();
+#endif
     pmTest1 = 0;
 }
 
@@ -980,6 +997,13 @@ static void fast_loop()
     }
 #endif  // OPTFLOW == ENABLED
 
+#if DATAFLASH_RATE_LIMIT && HIL_MODE == HIL_MODE_DISABLED
+    // IMU is offered at the main loop rate and decimated by the
+    // DataFlash rate limiter, so LOG_RATEn can set it up to 400Hz
+    if (g.log_bitmask & MASK_LOG_IMU) {
+        DataFlash.Log_Write_IMU(ins);
+    }
+#endif
 }
 
 // rc_loops - reads user input from transmitter/receiver
@@ -1088,10 +1112,12 @@ static void fifty_hz_logging_loop()
         Log_Write_Attitude();
     }
 
+#if !DATAFLASH_RATE_LIMIT
     if (g.log_bitmask & MASK_LOG_IMU) {
         DataFlash.Log_Write_IMU(ins);
     }
 #endif
+#endif
 }
 
 // three_hz_loop - 3.3hz loop
@@ -1122,6 +1148,9 @@ static void one_hz_loop()
         Log_Write_Data(DATA_AP_STATE, ap.value);
     }
 
+    // pick up changes to the LOG_RATEn parameters
+    DataFlash.UpdateRates();
+
     // log battery info to the dataflash
     if (g.log_bitmask & MASK_LOG_CURRENT) {
         Log_Write_Current();
@@ -1513,7 +1542,9 @@ static void tuning(){
         break;
 
 #if 0
-        // disabled for now - we need accessor functions
+        // disabled for now - we need accessor functions, which must
+        // pass the new values to the EKF thread when AHRS_EKF_THREAD
+        // is set rather than write to the filter directly
     case CH6_EKF_VERTICAL_POS:
         // EKF's baro vs accel (higher rely on accels more, baro impact is reduced)
         ahrs.get_NavEKF()._gpsVertPosNoise = tuning_value;
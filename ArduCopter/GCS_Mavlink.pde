@@ -745,6 +745,20 @@ bool GCS_MAVLINK::try_send_message(enum ap_message id)
         send_hwstatus(chan);
         break;
 
+    case MSG_SCHED_STATS:
+#if AP_SCHEDULER_TASK_STATS
+        CHECK_PAYLOAD_SIZE(DEBUG_VECT);
+        gcs[chan-MAVLINK_COMM_0].send_scheduler_stats(scheduler);
+#endif
+        break;
+
+    case MSG_DATAFLASH_STATS:
+#if HAL_OS_POSIX_IO
+        CHECK_PAYLOAD_SIZE(DEBUG_VECT);
+        gcs[chan-MAVLINK_COMM_0].send_dataflash_stats(DataFlash);
+#endif
+        break;
+
     case MSG_FENCE_STATUS:
     case MSG_WIND:
     case MSG_RANGEFINDER:
@@ -1022,6 +1036,8 @@ GCS_MAVLINK::data_stream_send(void)
         send_message(MSG_AHRS);
         send_message(MSG_HWSTATUS);
         send_message(MSG_SYSTEM_TIME);
+        send_message(MSG_SCHED_STATS);
+        send_message(MSG_DATAFLASH_STATS);
     }
 }
 
@@ -1521,7 +1537,10 @@ static void mavlink_delay_cb()
         gcs_check_input();
         gcs_data_stream_send();
         gcs_send_deferred();
-        notify.update();
+        if (!scheduler.using_workers()) {
+            // otherwise a worker thread is updating notify
+            notify.update();
+        }
     }
     if (tnow - last_5s > 5000) {
         last_5s = tnow;
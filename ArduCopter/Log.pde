@@ -172,6 +172,9 @@ struct PACKED log_AutoTune {
 // Write an Current data packet
 static void Log_Write_AutoTune(uint8_t axis, uint8_t tune_step, float rate_min, float rate_max, float new_gain_rp, float new_gain_rd, float new_gain_sp)
 {
+    if (!DataFlash.ShouldLog(LOG_AUTOTUNE_MSG)) {
+        return;
+    }
     struct log_AutoTune pkt = {
         LOG_PACKET_HEADER_INIT(LOG_AUTOTUNE_MSG),
         axis        : axis,
@@ -194,6 +197,9 @@ struct PACKED log_AutoTuneDetails {
 // Write an Current data packet
 static void Log_Write_AutoTuneDetails(int16_t angle_cd, float rate_cds)
 {
+    if (!DataFlash.ShouldLog(LOG_AUTOTUNEDETAILS_MSG)) {
+        return;
+    }
     struct log_AutoTuneDetails pkt = {
         LOG_PACKET_HEADER_INIT(LOG_AUTOTUNEDETAILS_MSG),
         angle_cd    : angle_cd,
@@ -217,17 +223,19 @@ struct PACKED log_Current {
 // Write an Current data packet
 static void Log_Write_Current()
 {
-    struct log_Current pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_CURRENT_MSG),
-        time_ms             : hal.scheduler->millis(),
-        throttle_out        : g.rc_3.servo_out,
-        throttle_integrator : throttle_integrator,
-        battery_voltage     : (int16_t) (battery.voltage() * 100.0f),
-        current_amps        : (int16_t) (battery.current_amps() * 100.0f),
-        board_voltage       : (uint16_t)(hal.analogin->board_voltage()*1000),
-        current_total       : battery.current_total_mah()
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_CURRENT_MSG)) {
+        struct log_Current pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_CURRENT_MSG),
+            time_ms             : hal.scheduler->millis(),
+            throttle_out        : g.rc_3.servo_out,
+            throttle_integrator : throttle_integrator,
+            battery_voltage     : (int16_t) (battery.voltage() * 100.0f),
+            current_amps        : (int16_t) (battery.current_amps() * 100.0f),
+            board_voltage       : (uint16_t)(hal.analogin->board_voltage()*1000),
+            current_total       : battery.current_total_mah()
+        };
+        DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    }
 
     // also write power status
     DataFlash.Log_Write_Power();
@@ -247,6 +255,9 @@ struct PACKED log_Optflow {
 // Write an optical flow packet
 static void Log_Write_Optflow()
 {
+    if (!DataFlash.ShouldLog(LOG_OPTFLOW_MSG)) {
+        return;
+    }
  #if OPTFLOW == ENABLED
     struct log_Optflow pkt = {
         LOG_PACKET_HEADER_INIT(LOG_OPTFLOW_MSG),
@@ -280,6 +291,9 @@ struct PACKED log_Nav_Tuning {
 // Write an Nav Tuning packet
 static void Log_Write_Nav_Tuning()
 {
+    if (!DataFlash.ShouldLog(LOG_NAV_TUNING_MSG)) {
+        return;
+    }
     const Vector3f &pos_target = pos_control.get_pos_target();
     const Vector3f &vel_target = pos_control.get_vel_target();
     const Vector3f &accel_target = pos_control.get_accel_target();
@@ -321,6 +335,9 @@ struct PACKED log_Control_Tuning {
 // Write a control tuning packet
 static void Log_Write_Control_Tuning()
 {
+    if (!DataFlash.ShouldLog(LOG_CONTROL_TUNING_MSG)) {
+        return;
+    }
     struct log_Control_Tuning pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CONTROL_TUNING_MSG),
         time_ms             : hal.scheduler->millis(),
@@ -355,25 +372,27 @@ struct PACKED log_Compass {
 // Write a Compass packet
 static void Log_Write_Compass()
 {
-    const Vector3f &mag_offsets = compass.get_offsets(0);
-    const Vector3f &mag_motor_offsets = compass.get_motor_offsets(0);
-    const Vector3f &mag = compass.get_field(0);
-    struct log_Compass pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_COMPASS_MSG),
-        time_ms         : hal.scheduler->millis(),
-        mag_x           : (int16_t)mag.x,
-        mag_y           : (int16_t)mag.y,
-        mag_z           : (int16_t)mag.z,
-        offset_x        : (int16_t)mag_offsets.x,
-        offset_y        : (int16_t)mag_offsets.y,
-        offset_z        : (int16_t)mag_offsets.z,
-        motor_offset_x  : (int16_t)mag_motor_offsets.x,
-        motor_offset_y  : (int16_t)mag_motor_offsets.y,
-        motor_offset_z  : (int16_t)mag_motor_offsets.z
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_COMPASS_MSG)) {
+        const Vector3f &mag_offsets = compass.get_offsets(0);
+        const Vector3f &mag_motor_offsets = compass.get_motor_offsets(0);
+        const Vector3f &mag = compass.get_field(0);
+        struct log_Compass pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_COMPASS_MSG),
+            time_ms         : hal.scheduler->millis(),
+            mag_x           : (int16_t)mag.x,
+            mag_y           : (int16_t)mag.y,
+            mag_z           : (int16_t)mag.z,
+            offset_x        : (int16_t)mag_offsets.x,
+            offset_y        : (int16_t)mag_offsets.y,
+            offset_z        : (int16_t)mag_offsets.z,
+            motor_offset_x  : (int16_t)mag_motor_offsets.x,
+            motor_offset_y  : (int16_t)mag_motor_offsets.y,
+            motor_offset_z  : (int16_t)mag_motor_offsets.z
+        };
+        DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    }
 #if COMPASS_MAX_INSTANCES > 1
-    if (compass.get_count() > 1) {
+    if (compass.get_count() > 1 && DataFlash.ShouldLog(LOG_COMPASS2_MSG)) {
         const Vector3f &mag2_offsets = compass.get_offsets(1);
         const Vector3f &mag2_motor_offsets = compass.get_motor_offsets(1);
         const Vector3f &mag2 = compass.get_field(1);
@@ -409,6 +428,9 @@ struct PACKED log_Performance {
 // Write a performance monitoring packet
 static void Log_Write_Performance()
 {
+    if (!DataFlash.ShouldLog(LOG_PERFORMANCE_MSG)) {
+        return;
+    }
     struct log_Performance pkt = {
         LOG_PACKET_HEADER_INIT(LOG_PERFORMANCE_MSG),
         num_long_running : perf_info_get_num_long_running(),
@@ -444,19 +466,21 @@ struct PACKED log_Attitude {
 // Write an attitude packet
 static void Log_Write_Attitude()
 {
-    Vector3f targets;
-    get_angle_targets_for_reporting(targets);
-    struct log_Attitude pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
-        time_ms         : hal.scheduler->millis(),
-        control_roll    : (int16_t)targets.x,
-        roll            : (int16_t)ahrs.roll_sensor,
-        control_pitch   : (int16_t)targets.y,
-        pitch           : (int16_t)ahrs.pitch_sensor,
-        control_yaw     : (uint16_t)targets.z,
-        yaw             : (uint16_t)ahrs.yaw_sensor
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_ATTITUDE_MSG)) {
+        Vector3f targets;
+        get_angle_targets_for_reporting(targets);
+        struct log_Attitude pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
+            time_ms         : hal.scheduler->millis(),
+            control_roll    : (int16_t)targets.x,
+            roll            : (int16_t)ahrs.roll_sensor,
+            control_pitch   : (int16_t)targets.y,
+            pitch           : (int16_t)ahrs.pitch_sensor,
+            control_yaw     : (uint16_t)targets.z,
+            yaw             : (uint16_t)ahrs.yaw_sensor
+        };
+        DataFlash.WritePacket(&pkt, sizeof(pkt));
+    }
 
 #if AP_AHRS_NAVEKF_AVAILABLE
     DataFlash.Log_Write_EKF(ahrs);
@@ -476,6 +500,9 @@ struct PACKED log_Mode {
 // Write a mode packet
 static void Log_Write_Mode(uint8_t mode)
 {
+    if (!DataFlash.ShouldLog(LOG_MODE_MSG)) {
+        return;
+    }
     struct log_Mode pkt = {
         LOG_PACKET_HEADER_INIT(LOG_MODE_MSG),
         mode            : mode,
@@ -491,6 +518,9 @@ struct PACKED log_Startup {
 // Write Startup packet
 static void Log_Write_Startup()
 {
+    if (!DataFlash.ShouldLog(LOG_STARTUP_MSG)) {
+        return;
+    }
     struct log_Startup pkt = {
         LOG_PACKET_HEADER_INIT(LOG_STARTUP_MSG)
     };
@@ -505,6 +535,9 @@ struct PACKED log_Event {
 // Wrote an event packet
 static void Log_Write_Event(uint8_t id)
 {
+    if (!DataFlash.ShouldLog(LOG_EVENT_MSG)) {
+        return;
+    }
     if (g.log_bitmask != 0) {
         struct log_Event pkt = {
             LOG_PACKET_HEADER_INIT(LOG_EVENT_MSG),
@@ -523,6 +556,9 @@ struct PACKED log_Data_Int16t {
 // Write an int16_t data packet
 static void Log_Write_Data(uint8_t id, int16_t value)
 {
+    if (!DataFlash.ShouldLog(LOG_DATA_INT16_MSG)) {
+        return;
+    }
     if (g.log_bitmask != 0) {
         struct log_Data_Int16t pkt = {
             LOG_PACKET_HEADER_INIT(LOG_DATA_INT16_MSG),
@@ -542,6 +578,9 @@ struct PACKED log_Data_UInt16t {
 // Write an uint16_t data packet
 static void Log_Write_Data(uint8_t id, uint16_t value)
 {
+    if (!DataFlash.ShouldLog(LOG_DATA_UINT16_MSG)) {
+        return;
+    }
     if (g.log_bitmask != 0) {
         struct log_Data_UInt16t pkt = {
             LOG_PACKET_HEADER_INIT(LOG_DATA_UINT16_MSG),
@@ -561,6 +600,9 @@ struct PACKED log_Data_Int32t {
 // Write an int32_t data packet
 static void Log_Write_Data(uint8_t id, int32_t value)
 {
+    if (!DataFlash.ShouldLog(LOG_DATA_INT32_MSG)) {
+        return;
+    }
     if (g.log_bitmask != 0) {
         struct log_Data_Int32t pkt = {
             LOG_PACKET_HEADER_INIT(LOG_DATA_INT32_MSG),
@@ -580,6 +622,9 @@ struct PACKED log_Data_UInt32t {
 // Write a uint32_t data packet
 static void Log_Write_Data(uint8_t id, uint32_t value)
 {
+    if (!DataFlash.ShouldLog(LOG_DATA_UINT32_MSG)) {
+        return;
+    }
     if (g.log_bitmask != 0) {
         struct log_Data_UInt32t pkt = {
             LOG_PACKET_HEADER_INIT(LOG_DATA_UINT32_MSG),
@@ -599,6 +644,9 @@ struct PACKED log_Data_Float {
 // Write a float data packet
 static void Log_Write_Data(uint8_t id, float value)
 {
+    if (!DataFlash.ShouldLog(LOG_DATA_FLOAT_MSG)) {
+        return;
+    }
     if (g.log_bitmask != 0) {
         struct log_Data_Float pkt = {
             LOG_PACKET_HEADER_INIT(LOG_DATA_FLOAT_MSG),
@@ -624,6 +672,9 @@ struct PACKED log_Camera {
 // Write a Camera packet
 static void Log_Write_Camera()
 {
+    if (!DataFlash.ShouldLog(LOG_CAMERA_MSG)) {
+        return;
+    }
 #if CAMERA == ENABLED
     struct log_Camera pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CAMERA_MSG),
@@ -649,6 +700,9 @@ struct PACKED log_Error {
 // Write an error packet
 static void Log_Write_Error(uint8_t sub_system, uint8_t error_code)
 {
+    if (!DataFlash.ShouldLog(LOG_ERROR_MSG)) {
+        return;
+    }
     struct log_Error pkt = {
         LOG_PACKET_HEADER_INIT(LOG_ERROR_MSG),
         sub_system    : sub_system,
@@ -732,6 +786,11 @@ static void start_logging()
     if (g.log_bitmask != 0) {
         if (!ap.logging_started) {
             ap.logging_started = true;
+            DataFlash.ClearCompact();
+            if (g.log_compact) {
+                DataFlash.SetCompact(LOG_ATTITUDE_MSG);
+                DataFlash.SetCompactCommon();
+            }
             in_mavlink_delay = true;
             DataFlash.StartNewLog();
             in_mavlink_delay = false;
@@ -78,6 +78,8 @@ public:
 
         // Parachute object
         k_param_parachute,	// 17
+        k_param_log_compact,
+        k_param_DataFlash,
 
         // Misc
         //
@@ -365,6 +367,7 @@ public:
     // Misc
     //
     AP_Int16        log_bitmask;
+    AP_Int8         log_compact;
     AP_Int8         esc_calibrate;
     AP_Int8         radio_tuning;
     AP_Int16        radio_tuning_high;
@@ -202,6 +202,9 @@ static void init_ardupilot()
 
 #if LOGGING_ENABLED == ENABLED
     DataFlash.Init(log_structure, sizeof(log_structure)/sizeof(log_structure[0]));
+    // IMU is written from the fast loop, keep it at 50Hz unless LOG_RATEn says otherwise
+    DataFlash.SetDefaultRate(LOG_IMU_MSG, 50);
+    DataFlash.SetDefaultRate(LOG_IMU2_MSG, 50);
     if (!DataFlash.CardInserted()) {
         gcs_send_text_P(SEVERITY_LOW, PSTR("No dataflash inserted"));
         g.log_bitmask.set(0);
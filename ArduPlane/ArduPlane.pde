@@ -939,6 +939,9 @@ static void one_second_loop()
     if (should_log(MASK_LOG_CURRENT))
         Log_Write_Current();
 
+    // pick up changes to the LOG_RATEn parameters
+    DataFlash.UpdateRates();
+
     // send a heartbeat
     gcs_send_message(MSG_HEARTBEAT);
 
@@ -963,8 +966,14 @@ static void log_perf_info()
     if (scheduler.debug() != 0) {
         hal.console->printf_P(PSTR("G_Dt_max=%lu\n"), (unsigned long)G_Dt_max);
     }
-    if (should_log(MASK_LOG_PM))
+    if (should_log(MASK_LOG_PM)) {
         Log_Write_Performance();
+#if HAL_OS_POSIX_IO
+        DataFlash.Log_Write_DataFlash_Stats();
+#endif
+        DataFlash.Log_Write_Rate_Stats();
+        DataFlash.Log_Write_Thread_Latency();
+    }
     G_Dt_max = 0;
     resetPerfData();
 }
@@ -177,16 +177,18 @@ struct PACKED log_Attitude {
 // Write an attitude packet
 static void Log_Write_Attitude(void)
 {
-    struct log_Attitude pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
-        time_ms : hal.scheduler->millis(),
-        roll  : (int16_t)ahrs.roll_sensor,
-        pitch : (int16_t)ahrs.pitch_sensor,
-        yaw   : (uint16_t)ahrs.yaw_sensor,
-        error_rp  : (uint16_t)(ahrs.get_error_rp() * 100),
-        error_yaw : (uint16_t)(ahrs.get_error_yaw() * 100)
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_ATTITUDE_MSG)) {
+        struct log_Attitude pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
+            time_ms : hal.scheduler->millis(),
+            roll  : (int16_t)ahrs.roll_sensor,
+            pitch : (int16_t)ahrs.pitch_sensor,
+            yaw   : (uint16_t)ahrs.yaw_sensor,
+            error_rp  : (uint16_t)(ahrs.get_error_rp() * 100),
+            error_yaw : (uint16_t)(ahrs.get_error_yaw() * 100)
+        };
+        DataFlash.WritePacket(&pkt, sizeof(pkt));
+    }
 
 #if AP_AHRS_NAVEKF_AVAILABLE
     DataFlash.Log_Write_EKF(ahrs);
@@ -213,6 +215,9 @@ struct PACKED log_Performance {
 // Write a performance monitoring packet. Total length : 19 bytes
 static void Log_Write_Performance()
 {
+    if (!DataFlash.ShouldLog(LOG_PERFORMANCE_MSG)) {
+        return;
+    }
     struct log_Performance pkt = {
         LOG_PACKET_HEADER_INIT(LOG_PERFORMANCE_MSG),
         loop_time       : millis() - perf_mon_timer,
@@ -250,6 +255,9 @@ struct PACKED log_Camera {
 // Write a Camera packet. Total length : 26 bytes
 static void Log_Write_Camera()
 {
+    if (!DataFlash.ShouldLog(LOG_CAMERA_MSG)) {
+        return;
+    }
 #if CAMERA == ENABLED
     struct log_Camera pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CAMERA_MSG),
@@ -274,6 +282,9 @@ struct PACKED log_Startup {
 
 static void Log_Write_Startup(uint8_t type)
 {
+    if (!DataFlash.ShouldLog(LOG_STARTUP_MSG)) {
+        return;
+    }
     struct log_Startup pkt = {
         LOG_PACKET_HEADER_INIT(LOG_STARTUP_MSG),
         startup_type    : type,
@@ -305,6 +316,9 @@ struct PACKED log_Control_Tuning {
 // Write a control tuning packet. Total length : 22 bytes
 static void Log_Write_Control_Tuning()
 {
+    if (!DataFlash.ShouldLog(LOG_CTUN_MSG)) {
+        return;
+    }
     Vector3f accel = ins.get_accel();
     struct log_Control_Tuning pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CTUN_MSG),
@@ -342,6 +356,9 @@ struct PACKED log_Nav_Tuning {
 // Write a navigation tuning packe
 static void Log_Write_Nav_Tuning()
 {
+    if (!DataFlash.ShouldLog(LOG_NTUN_MSG)) {
+        return;
+    }
     struct log_Nav_Tuning pkt = {
         LOG_PACKET_HEADER_INIT(LOG_NTUN_MSG),
         time_ms             : hal.scheduler->millis(),
@@ -367,6 +384,9 @@ struct PACKED log_Mode {
 // Write a mode packet. Total length : 5 bytes
 static void Log_Write_Mode(uint8_t mode)
 {
+    if (!DataFlash.ShouldLog(LOG_MODE_MSG)) {
+        return;
+    }
     struct log_Mode pkt = {
         LOG_PACKET_HEADER_INIT(LOG_MODE_MSG),
         time_ms  : hal.scheduler->millis(),
@@ -389,6 +409,9 @@ struct PACKED log_Sonar {
 // Write a sonar packet
 static void Log_Write_Sonar()
 {
+    if (!DataFlash.ShouldLog(LOG_SONAR_MSG)) {
+        return;
+    }
     struct log_Sonar pkt = {
         LOG_PACKET_HEADER_INIT(LOG_SONAR_MSG),
         timestamp   : hal.scheduler->millis(),
@@ -420,22 +443,27 @@ struct PACKED log_Arm_Disarm {
 
 static void Log_Write_Current()
 {
-    struct log_Current pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_CURRENT_MSG),
-        time_ms                 : hal.scheduler->millis(),
-        throttle_in             : channel_throttle->control_in,
-        battery_voltage         : (int16_t)(battery.voltage() * 100.0),
-        current_amps            : (int16_t)(battery.current_amps() * 100.0),
-        board_voltage           : (uint16_t)(hal.analogin->board_voltage()*1000),
-        current_total           : battery.current_total_mah()
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_CURRENT_MSG)) {
+        struct log_Current pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_CURRENT_MSG),
+            time_ms                 : hal.scheduler->millis(),
+            throttle_in             : channel_throttle->control_in,
+            battery_voltage         : (int16_t)(battery.voltage() * 100.0),
+            current_amps            : (int16_t)(battery.current_amps() * 100.0),
+            board_voltage           : (uint16_t)(hal.analogin->board_voltage()*1000),
+            current_total           : battery.current_total_mah()
+        };
+        DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    }
 
     // also write power status
     DataFlash.Log_Write_Power();
 }
 
 static void Log_Arm_Disarm() {
+    if (!DataFlash.ShouldLog(LOG_ARM_DISARM_MSG)) {
+        return;
+    }
     struct log_Arm_Disarm pkt = {
         LOG_PACKET_HEADER_INIT(LOG_ARM_DISARM_MSG),
         time_ms                 : hal.scheduler->millis(),
@@ -459,21 +487,23 @@ struct PACKED log_Compass {
 // Write a Compass packet. Total length : 15 bytes
 static void Log_Write_Compass()
 {
-    const Vector3f &mag_offsets = compass.get_offsets();
-    const Vector3f &mag = compass.get_field();
-    struct log_Compass pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_COMPASS_MSG),
-        time_ms         : hal.scheduler->millis(),
-        mag_x           : (int16_t)mag.x,
-        mag_y           : (int16_t)mag.y,
-        mag_z           : (int16_t)mag.z,
-        offset_x        : (int16_t)mag_offsets.x,
-        offset_y        : (int16_t)mag_offsets.y,
-        offset_z        : (int16_t)mag_offsets.z
-    };
-    DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    if (DataFlash.ShouldLog(LOG_COMPASS_MSG)) {
+        const Vector3f &mag_offsets = compass.get_offsets();
+        const Vector3f &mag = compass.get_field();
+        struct log_Compass pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_COMPASS_MSG),
+            time_ms         : hal.scheduler->millis(),
+            mag_x           : (int16_t)mag.x,
+            mag_y           : (int16_t)mag.y,
+            mag_z           : (int16_t)mag.z,
+            offset_x        : (int16_t)mag_offsets.x,
+            offset_y        : (int16_t)mag_offsets.y,
+            offset_z        : (int16_t)mag_offsets.z
+        };
+        DataFlash.WriteBlock(&pkt, sizeof(pkt));
+    }
 #if COMPASS_MAX_INSTANCES > 1
-    if (compass.get_count() > 1) {
+    if (compass.get_count() > 1 && DataFlash.ShouldLog(LOG_COMPASS2_MSG)) {
         const Vector3f &mag2_offsets = compass.get_offsets(1);
         const Vector3f &mag2 = compass.get_field(1);
         struct log_Compass pkt2 = {
@@ -523,6 +553,9 @@ struct PACKED log_AIRSPEED {
 // Write a AIRSPEED packet
 static void Log_Write_Airspeed(void)
 {
+    if (!DataFlash.ShouldLog(LOG_AIRSPEED_MSG)) {
+        return;
+    }
     float temperature;
     if (!airspeed.get_temperature(temperature)) {
         temperature = 0;
@@ -585,6 +618,11 @@ static void Log_Read(uint16_t log_num, int16_t start_page, int16_t end_page)
 // start a new log
 static void start_logging() 
 {
+    DataFlash.ClearCompact();
+    if (g.log_compact) {
+        DataFlash.SetCompact(LOG_ATTITUDE_MSG);
+        DataFlash.SetCompactCommon();
+    }
     DataFlash.StartNewLog();
     DataFlash.Log_Write_Message_P(PSTR(FIRMWARE_STRING));
 #if defined(PX4_GIT_VERSION) && defined(NUTTX_GIT_VERSION)
@@ -107,6 +107,8 @@ public:
         k_param_gps,
         k_param_autotune_level,
         k_param_rally,
+        k_param_log_compact,
+        k_param_DataFlash,
 
         // 100: Arming parameters
         k_param_arming = 100,
@@ -400,6 +402,7 @@ public:
     AP_Int8 reverse_ch2_elevon;
     AP_Int16 num_resets;
     AP_Int32 log_bitmask;
+    AP_Int8 log_compact;
     AP_Int8 reset_switch_chan;
     AP_Int8 reset_mission_chan;
     AP_Int32 airspeed_cruise_cm;
@@ -645,6 +645,13 @@ const AP_Param::Info var_info[] PROGMEM = {
     // @User: Advanced
     GSCALAR(log_bitmask,            "LOG_BITMASK",    DEFAULT_LOG_BITMASK),
 
+    // @Param: LOG_COMPACT
+    // @DisplayName: Compact logging
+    // @Description: When enabled the high rate log messages are written as deltas against the previous message of the same type, which makes logs smaller. Compact logs need a log reader that understands the FMTC message
+    // @Values: 0:Disabled,1:Enabled
+    // @User: Advanced
+    GSCALAR(log_compact,            "LOG_COMPACT",    0),
+
     // @Param: RST_SWITCH_CH
     // @DisplayName: Reset Switch Channel
     // @Description: RC channel to use to reset to last flight mode	after geofence takeover.
@@ -970,6 +977,12 @@ const AP_Param::Info var_info[] PROGMEM = {
     // @Path: ../libraries/AP_BoardConfig/AP_BoardConfig.cpp
     GOBJECT(BoardConfig,            "BRD_",       AP_BoardConfig),
 
+#if DATAFLASH_RATE_LIMIT
+    // @Group: LOG_
+    // @Path: ../libraries/DataFlash/LogFile.cpp
+    GOBJECT(DataFlash,              "LOG_",       DataFlash_Class),
+#endif
+
 #if CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
     // @Group: SIM_
     // @Path: ../libraries/SITL/SITL.cpp
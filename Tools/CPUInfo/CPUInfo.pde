@@ -27,6 +27,7 @@
 #include <AP_Math.h>
 #include <AP_AHRS.h>
 #include <AP_NavEKF.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_Mission.h>
@@ -25,6 +25,7 @@
 #include <DataFlash.h>
 #include <AP_GPS.h>
 #include <AP_AHRS.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_ADC_AnalogSource.h>
@@ -0,0 +1,571 @@
+/// -*- tab-width: 4; Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  export a DataFlash .BIN log as one binary column file per message
+  field, for bulk analysis.
+
+  The log is described by its own FMT messages, so any message type
+  is exported. For each message type NAME the output directory gets
+  NAME/_time.col with the timestamp of each row in milliseconds, and
+  NAME/FIELD.col for each field, holding the raw little endian values
+  back to back. schema.txt lists every column with its numpy style
+  type, the scale to apply to get engineering units, and its number
+  of rows.
+
+  The log is streamed through a fixed size buffer and columns are
+  written in blocks, so memory use does not depend on the log size.
+  Corrupt regions are skipped by searching for the next valid message
+  header. Compact messages (see log_Format_Compact) are decoded and
+  exported in full, as if they had been logged that way.
+
+  Build with "make linux". As the Linux HAL parses the command line
+  first, pass options after "--", for example
+      LogExport.elf -- -o out 00000001.BIN
+ */
+
+#include <AP_Common.h>
+#include <AP_Progmem.h>
+#include <AP_Param.h>
+#include <AP_Math.h>
+#include <AP_HAL.h>
+#include <AP_HAL_AVR.h>
+#include <AP_HAL_AVR_SITL.h>
+#include <AP_HAL_Linux.h>
+#include <AP_HAL_Empty.h>
+#include <AP_ADC.h>
+#include <AP_Declination.h>
+#include <AP_ADC_AnalogSource.h>
+#include <Filter.h>
+#include <AP_Buffer.h>
+#include <AP_Airspeed.h>
+#include <AP_Vehicle.h>
+#include <AP_Notify.h>
+#include <DataFlash.h>
+#include <GCS_MAVLink.h>
+#include <AP_GPS.h>
+#include <AP_AHRS.h>
+#include <SITL.h>
+#include <AP_Compass.h>
+#include <AP_Baro.h>
+#include <AP_InertialSensor.h>
+#include <AP_Mission.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+const AP_HAL::HAL& hal = AP_HAL_BOARD_DRIVER;
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+SITL sitl;
+#endif
+
+// size of the log read buffer, and of the block buffered for each column
+#define READ_BUFFER_SIZE  (1024*1024UL)
+#define COLUMN_BLOCK_SIZE (32*1024UL)
+
+// maximum fields in a message, from the length of log_Format.format
+#define MAX_FIELDS 16
+
+// a compact message is always shorter than the full message
+#define MAX_MESSAGE_LEN 256
+
+struct column {
+    char path[256];
+    uint8_t size;
+    uint8_t *buf;
+    uint32_t len;
+    bool created;
+};
+
+/*
+  everything we know about one message type
+ */
+struct msg_type {
+    bool have_format;
+    bool exporting;
+    struct log_Format fmt;
+    char name[5];
+    uint8_t num_fields;
+    char field_type[MAX_FIELDS];
+    char field_name[MAX_FIELDS][17];
+    uint8_t field_ofs[MAX_FIELDS];
+    // offset of the timestamp in the message, or zero for none
+    uint8_t time_ofs;
+    uint32_t rows;
+    struct column time_col;
+    struct column cols[MAX_FIELDS];
+    // the compact encoding, and the last message compact messages
+    // are decoded against
+    bool compact;
+    bool have_ref;
+    char encoding[16];
+    uint8_t ref[MAX_MESSAGE_LEN];
+};
+
+static struct msg_type types[256];
+static const char *out_dir = NULL;
+static uint32_t last_time_ms;
+
+// statistics
+static uint64_t bytes_read;
+static uint64_t bytes_skipped;
+static uint32_t corrupt_regions;
+static uint32_t messages;
+static uint32_t compact_messages;
+static uint32_t bad_formats;
+static bool in_corrupt;
+
+static void usage(void)
+{
+    ::printf("Usage: LogExport [options] LOGFILE\n");
+    ::printf("Options:\n");
+    ::printf(" -o DIR     output directory (default LOGFILE.cols)\n");
+}
+
+/*
+  size and numpy type of each format character, and the scale to
+  apply to get engineering units
+ */
+static uint8_t field_info(char c, const char *&dtype, const char *&scale)
+{
+    scale = "1";
+    switch (c) {
+    case 'b': dtype = "<i1"; return 1;
+    case 'B': dtype = "<u1"; return 1;
+    case 'M': dtype = "<u1"; return 1;
+    case 'h': dtype = "<i2"; return 2;
+    case 'H': dtype = "<u2"; return 2;
+    case 'c': dtype = "<i2"; scale = "0.01"; return 2;
+    case 'C': dtype = "<u2"; scale = "0.01"; return 2;
+    case 'i': dtype = "<i4"; return 4;
+    case 'I': dtype = "<u4"; return 4;
+    case 'e': dtype = "<i4"; scale = "0.01"; return 4;
+    case 'E': dtype = "<u4"; scale = "0.01"; return 4;
+    case 'L': dtype = "<i4"; scale = "1e-7"; return 4;
+    case 'f': dtype = "<f4"; return 4;
+    case 'n': dtype = "S4"; return 4;
+    case 'N': dtype = "S16"; return 16;
+    case 'Z': dtype = "S64"; return 64;
+    }
+    dtype = NULL;
+    return 0;
+}
+
+/*
+  append to a column, writing out a block when it fills. Files are
+  opened only while a block is written, so the number of columns is
+  not limited by the number of open files
+ */
+static void column_flush(struct column &c)
+{
+    if (c.len == 0 && c.created) {
+        return;
+    }
+    FILE *f = fopen(c.path, c.created ? "ab" : "wb");
+    if (f == NULL) {
+        perror(c.path);
+        exit(1);
+    }
+    if (c.len != 0 && fwrite(c.buf, c.len, 1, f) != 1) {
+        perror(c.path);
+        exit(1);
+    }
+    fclose(f);
+    c.created = true;
+    c.len = 0;
+}
+
+static void column_write(struct column &c, const uint8_t *data)
+{
+    if (c.len + c.size > COLUMN_BLOCK_SIZE) {
+        column_flush(c);
+    }
+    memcpy(&c.buf[c.len], data, c.size);
+    c.len += c.size;
+}
+
+static void column_init(struct column &c, const char *type_name, const char *field, uint8_t size)
+{
+    snprintf(c.path, sizeof(c.path), "%s/%s/%s.col", out_dir, type_name, field);
+    c.size = size;
+    c.len = 0;
+    c.created = false;
+    c.buf = (uint8_t *)malloc(COLUMN_BLOCK_SIZE);
+    if (c.buf == NULL) {
+        ::printf("Out of memory\n");
+        exit(1);
+    }
+}
+
+/*
+  parse a format message. Formats whose fields don't add up to the
+  message length can't be exported, but their messages are still
+  skipped over correctly
+ */
+static void add_format(const struct log_Format &f)
+{
+    struct msg_type &t = types[f.type];
+    if (t.have_format) {
+        // formats are repeated when a log is continued
+        if (memcmp(&t.fmt, &f, sizeof(f)) != 0) {
+            bad_formats++;
+        }
+        return;
+    }
+    memset(&t, 0, sizeof(t));
+    t.have_format = true;
+    t.fmt = f;
+    memcpy(t.name, f.name, sizeof(f.name));
+    t.name[4] = 0;
+
+    char labels[sizeof(f.labels)+1];
+    memcpy(labels, f.labels, sizeof(f.labels));
+    labels[sizeof(f.labels)] = 0;
+
+    uint8_t ofs = 3;
+    char *saveptr = NULL;
+    char *label = strtok_r(labels, ",", &saveptr);
+    uint8_t i;
+    for (i=0; i<sizeof(f.format) && f.format[i] != 0; i++) {
+        const char *dtype, *scale;
+        uint8_t size = field_info(f.format[i], dtype, scale);
+        if (size == 0 || label == NULL) {
+            break;
+        }
+        t.field_type[i] = f.format[i];
+        strncpy(t.field_name[i], label, sizeof(t.field_name[i])-1);
+        t.field_ofs[i] = ofs;
+        if (f.format[i] == 'I' && strcmp(label, "T") == 0) {
+            // GPS messages carry GPS time in TimeMS and system time in T
+            t.time_ofs = ofs;
+        } else if (f.format[i] == 'I' && strcmp(label, "TimeMS") == 0 && t.time_ofs == 0) {
+            t.time_ofs = ofs;
+        }
+        ofs += size;
+        label = strtok_r(NULL, ",", &saveptr);
+    }
+    t.num_fields = i;
+    if (ofs != f.length || (i < sizeof(f.format) && f.format[i] != 0)) {
+        bad_formats++;
+        t.num_fields = 0;
+    }
+}
+
+/*
+  start exporting a message type when we see its first message
+ */
+static void start_type(struct msg_type &t)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", out_dir, t.name);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        perror(path);
+        exit(1);
+    }
+    column_init(t.time_col, t.name, "_time", 4);
+    for (uint8_t i=0; i<t.num_fields; i++) {
+        const char *dtype, *scale;
+        column_init(t.cols[i], t.name, t.field_name[i], field_info(t.field_type[i], dtype, scale));
+    }
+    t.exporting = true;
+}
+
+static void export_message(struct msg_type &t, const uint8_t *msg)
+{
+    if (!t.exporting) {
+        start_type(t);
+    }
+    if (t.time_ofs != 0) {
+        memcpy(&last_time_ms, &msg[t.time_ofs], 4);
+    }
+    column_write(t.time_col, (const uint8_t *)&last_time_ms);
+    for (uint8_t i=0; i<t.num_fields; i++) {
+        column_write(t.cols[i], &msg[t.field_ofs[i]]);
+    }
+    t.rows++;
+}
+
+/*
+  decode the compact message at p into msg, returning its length in
+  the log, or zero if it can't be decoded
+ */
+static uint16_t decode_compact(const uint8_t *p, uint32_t avail, uint8_t *msg)
+{
+    if (avail < 4) {
+        return 0;
+    }
+    struct msg_type &t = types[p[3]];
+    if (!t.compact || !t.have_ref) {
+        return 0;
+    }
+    memcpy(msg, t.ref, t.fmt.length);
+    if (avail > MAX_MESSAGE_LEN) {
+        avail = MAX_MESSAGE_LEN;
+    }
+    int16_t n = DataFlash_Class::compact_decode(t.encoding, t.fmt.length, &p[4], avail - 4, msg);
+    if (n < 0) {
+        return 0;
+    }
+    return 4 + n;
+}
+
+/*
+  length of the message at p, or zero if it doesn't look like one
+ */
+static uint16_t message_length(const uint8_t *p, uint32_t avail)
+{
+    if (p[0] != HEAD_BYTE1 || p[1] != HEAD_BYTE2) {
+        return 0;
+    }
+    if (p[2] == LOG_FORMAT_MSG) {
+        return sizeof(struct log_Format);
+    }
+    if (p[2] == LOG_COMPACT_MSG) {
+        uint8_t msg[MAX_MESSAGE_LEN];
+        return decode_compact(p, avail, msg);
+    }
+    if (!types[p[2]].have_format || types[p[2]].fmt.length < 3) {
+        return 0;
+    }
+    return types[p[2]].fmt.length;
+}
+
+/*
+  process as much of the buffer as holds whole messages, returning
+  the number of bytes used
+ */
+static uint32_t process_buffer(const uint8_t *buf, uint32_t len, bool at_eof)
+{
+    uint32_t ofs = 0;
+    while (len - ofs >= 3) {
+        if (buf[ofs+2] == LOG_COMPACT_MSG && len - ofs < MAX_MESSAGE_LEN && !at_eof) {
+            // wait for the whole of a variable length message
+            break;
+        }
+        uint16_t mlen = message_length(&buf[ofs], len - ofs);
+        if (mlen != 0 && in_corrupt && len - ofs >= mlen + 3U &&
+            message_length(&buf[ofs+mlen], len - ofs - mlen) == 0) {
+            // when resynchronising, only trust a header that is
+            // followed by another one
+            mlen = 0;
+        }
+        if (mlen == 0) {
+            // resynchronise on the next header
+            if (!in_corrupt) {
+                corrupt_regions++;
+                in_corrupt = true;
+            }
+            // skip to the next possible header with memchr(), which
+            // is much faster than stepping a byte at a time through
+            // zeroed or garbage regions
+            const uint8_t *next = (const uint8_t *)memchr(&buf[ofs+1], HEAD_BYTE1, len - (ofs+1));
+            uint32_t next_ofs = next ? (uint32_t)(next - buf) : len;
+            bytes_skipped += next_ofs - ofs;
+            ofs = next_ofs;
+            continue;
+        }
+        if (len - ofs < mlen) {
+            if (at_eof) {
+                // truncated final message
+                bytes_skipped += len - ofs;
+                ofs = len;
+            }
+            break;
+        }
+        in_corrupt = false;
+        const uint8_t *msg = &buf[ofs];
+        uint8_t decoded[MAX_MESSAGE_LEN];
+        if (msg[2] == LOG_COMPACT_MSG) {
+            decode_compact(msg, len - ofs, decoded);
+            msg = decoded;
+            compact_messages++;
+        } else if (msg[2] == LOG_FORMAT_MSG) {
+            struct log_Format f;
+            memcpy(&f, msg, sizeof(f));
+            add_format(f);
+        } else if (msg[2] == LOG_FORMAT_COMPACT_MSG && mlen >= sizeof(struct log_Format_Compact)) {
+            struct log_Format_Compact fc;
+            memcpy(&fc, msg, sizeof(fc));
+            struct msg_type &ct = types[fc.type];
+            ct.compact = true;
+            ct.have_ref = false;
+            memcpy(ct.encoding, fc.encoding, sizeof(fc.encoding));
+        }
+        struct msg_type &t = types[msg[2]];
+        if (t.compact) {
+            // the next compact message is decoded against this one
+            memcpy(t.ref, msg, t.fmt.length);
+            t.have_ref = true;
+        }
+        if (t.num_fields != 0) {
+            export_message(t, msg);
+        }
+        messages++;
+        ofs += mlen;
+    }
+    if (at_eof && ofs < len) {
+        bytes_skipped += len - ofs;
+        ofs = len;
+    }
+    return ofs;
+}
+
+static void write_schema(void)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/schema.txt", out_dir);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "# column type scale rows\n");
+    for (uint16_t i=0; i<256; i++) {
+        struct msg_type &t = types[i];
+        if (!t.exporting) {
+            continue;
+        }
+        fprintf(f, "%s/_time <u4 1e-3 %u\n", t.name, (unsigned)t.rows);
+        for (uint8_t j=0; j<t.num_fields; j++) {
+            const char *dtype, *scale;
+            field_info(t.field_type[j], dtype, scale);
+            fprintf(f, "%s/%s %s %s %u\n", t.name, t.field_name[j], dtype, scale, (unsigned)t.rows);
+        }
+    }
+    fclose(f);
+}
+
+static void export_log(const char *filename)
+{
+    int fd = ::open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror(filename);
+        exit(1);
+    }
+    if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+        perror(out_dir);
+        exit(1);
+    }
+
+    struct timespec ts0, ts1;
+    clock_gettime(CLOCK_MONOTONIC, &ts0);
+
+    uint8_t *buf = (uint8_t *)malloc(READ_BUFFER_SIZE);
+    if (buf == NULL) {
+        ::printf("Out of memory\n");
+        exit(1);
+    }
+    uint32_t len = 0;
+    bool eof = false;
+    while (!eof || len != 0) {
+        if (!eof) {
+            ssize_t n = ::read(fd, &buf[len], READ_BUFFER_SIZE - len);
+            if (n < 0) {
+                perror(filename);
+                exit(1);
+            }
+            if (n == 0) {
+                eof = true;
+            }
+            len += n;
+            bytes_read += n;
+        }
+        uint32_t used = process_buffer(buf, len, eof);
+        // keep any partial message for the next read
+        memmove(buf, &buf[used], len - used);
+        len -= used;
+    }
+    ::close(fd);
+    free(buf);
+
+    for (uint16_t i=0; i<256; i++) {
+        struct msg_type &t = types[i];
+        if (!t.exporting) {
+            continue;
+        }
+        column_flush(t.time_col);
+        free(t.time_col.buf);
+        for (uint8_t j=0; j<t.num_fields; j++) {
+            column_flush(t.cols[j]);
+            free(t.cols[j].buf);
+        }
+    }
+    write_schema();
+
+    clock_gettime(CLOCK_MONOTONIC, &ts1);
+    float dt = (ts1.tv_sec - ts0.tv_sec) + (ts1.tv_nsec - ts0.tv_nsec)*1.0e-9f;
+    ::printf("Exported %u messages from %.1f MB in %.2f s (%.1f MB/s)\n",
+             (unsigned)messages, bytes_read*1.0e-6f, dt,
+             dt > 0 ? bytes_read*1.0e-6f/dt : 0.0f);
+    if (compact_messages != 0) {
+        ::printf("Decoded %u compact messages\n", (unsigned)compact_messages);
+    }
+    if (corrupt_regions != 0 || bad_formats != 0) {
+        ::printf("Skipped %u corrupt regions (%lu bytes), %u bad formats\n",
+                 (unsigned)corrupt_regions, (unsigned long)bytes_skipped, (unsigned)bad_formats);
+    }
+}
+
+void setup()
+{
+    uint8_t argc;
+    char * const *argv;
+    int opt;
+
+    hal.util->commandline_arguments(argc, argv);
+
+    while ((opt = getopt(argc, argv, "o:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_dir = optarg;
+            break;
+
+        case 'h':
+        default:
+            usage();
+            exit(0);
+        }
+    }
+
+    argv += optind;
+    argc -= optind;
+
+    if (argc < 1) {
+        usage();
+        exit(1);
+    }
+
+    static char default_dir[256];
+    if (out_dir == NULL) {
+        snprintf(default_dir, sizeof(default_dir), "%s.cols", argv[0]);
+        out_dir = default_dir;
+    }
+
+    export_log(argv[0]);
+    exit(0);
+}
+
+void loop()
+{
+}
+
+AP_HAL_MAIN();
@@ -15,12 +15,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 
 extern const AP_HAL::HAL& hal;
 
 LogReader::LogReader(AP_AHRS &_ahrs, AP_InertialSensor &_ins, AP_Baro_HIL &_baro, AP_Compass_HIL &_compass, AP_GPS &_gps, AP_Airspeed &_airspeed) :
     vehicle(VEHICLE_UNKNOWN),
-    fd(-1),
     ahrs(_ahrs),
     ins(_ins),
     baro(_baro),
@@ -28,18 +28,449 @@ LogReader::LogReader(AP_AHRS &_ahrs, AP_InertialSensor &_ins, AP_Baro_HIL &_baro
     gps(_gps),
     airspeed(_airspeed),
     accel_mask(3),
-    gyro_mask(3)
-{}
+    gyro_mask(3),
+    log_data(NULL),
+    log_size(0),
+    decoded(NULL),
+    decoded_size(0),
+    decoded_alloc(0),
+    msg_count(0),
+    msg_alloc(0),
+    msg_offset(NULL),
+    msg_time_ms(NULL),
+    num_corrupt(0),
+    num_skipped(0),
+    num_compact_dropped(0),
+    next_msg(0),
+    end_time_ms(0)
+{
+    memset(have_format, 0, sizeof(have_format));
+    memset(time_offset, 0, sizeof(time_offset));
+    memset(type_index, 0, sizeof(type_index));
+    memset(have_compact, 0, sizeof(have_compact));
+    memset(compact_ref, 0xFF, sizeof(compact_ref));
+}
 
+/*
+  map the log into memory and index it
+ */
 bool LogReader::open_log(const char *logfile)
 {
-    fd = ::open(logfile, O_RDONLY);
+    int fd = ::open(logfile, O_RDONLY);
     if (fd == -1) {
         return false;
     }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    log_size = st.st_size;
+    if (log_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *p = mmap(NULL, log_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    madvise(p, log_size, MADV_SEQUENTIAL);
+    log_data = (const uint8_t *)p;
+
+    uint32_t start_ms = hal.scheduler->millis();
+    if (!build_index()) {
+        ::printf("Out of memory indexing log\n");
+        return false;
+    }
+    ::printf("Indexed %u messages in %u ms\n",
+             (unsigned)msg_count,
+             (unsigned)(hal.scheduler->millis() - start_ms));
+    if (num_corrupt != 0) {
+        ::printf("Skipped %u bytes in %u damaged regions, dropped %u compact messages\n",
+                 (unsigned)num_skipped,
+                 (unsigned)num_corrupt,
+                 (unsigned)num_compact_dropped);
+    }
+    return true;
+}
+
+/*
+  return the size of a field from its format character
+ */
+static uint8_t field_size(char c)
+{
+    switch (c) {
+    case 'b':
+    case 'B':
+    case 'M':
+        return 1;
+    case 'h':
+    case 'H':
+    case 'c':
+    case 'C':
+        return 2;
+    case 'i':
+    case 'I':
+    case 'f':
+    case 'n':
+    case 'e':
+    case 'E':
+    case 'L':
+        return 4;
+    case 'N':
+        return 16;
+    case 'Z':
+        return 64;
+    }
+    return 0;
+}
+
+/*
+  record a format, and find the offset of its timestamp. GPS messages
+  carry the GPS time in TimeMS and the system time in T, so T is
+  preferred when present
+ */
+void LogReader::add_format(const struct log_Format &f)
+{
+    formats[f.type] = f;
+    have_format[f.type] = true;
+    time_offset[f.type] = 0;
+
+    char labels[sizeof(f.labels)+1];
+    memcpy(labels, f.labels, sizeof(f.labels));
+    labels[sizeof(f.labels)] = 0;
+
+    uint8_t ofs = 3;
+    char *saveptr = NULL;
+    char *label = strtok_r(labels, ",", &saveptr);
+    for (uint8_t i=0; i<sizeof(f.format) && f.format[i] && label != NULL; i++) {
+        if (f.format[i] == 'I' && ofs + 4 <= f.length) {
+            if (strcmp(label, "T") == 0) {
+                time_offset[f.type] = ofs;
+                break;
+            }
+            if (strcmp(label, "TimeMS") == 0 && time_offset[f.type] == 0) {
+                time_offset[f.type] = ofs;
+            }
+        }
+        uint8_t size = field_size(f.format[i]);
+        if (size == 0) {
+            break;
+        }
+        ofs += size;
+        label = strtok_r(NULL, ",", &saveptr);
+    }
+}
+
+/*
+  add a message to the index
+ */
+bool LogReader::add_message(uint32_t ofs, uint32_t time_ms)
+{
+    if (msg_count == msg_alloc) {
+        uint32_t n = msg_alloc ? msg_alloc*2 : 4096;
+        uint32_t *new_offset = (uint32_t *)realloc(msg_offset, n*sizeof(uint32_t));
+        if (new_offset == NULL) {
+            return false;
+        }
+        msg_offset = new_offset;
+        uint32_t *new_time = (uint32_t *)realloc(msg_time_ms, n*sizeof(uint32_t));
+        if (new_time == NULL) {
+            return false;
+        }
+        msg_time_ms = new_time;
+        msg_alloc = n;
+    }
+    uint8_t type = data_at(ofs)[2];
+    if (type_index[type].count == type_index[type].alloc) {
+        uint32_t n = type_index[type].alloc ? type_index[type].alloc*2 : 256;
+        uint32_t *new_msgs = (uint32_t *)realloc(type_index[type].msgs, n*sizeof(uint32_t));
+        if (new_msgs == NULL) {
+            return false;
+        }
+        type_index[type].msgs = new_msgs;
+        type_index[type].alloc = n;
+    }
+    type_index[type].msgs[type_index[type].count++] = msg_count;
+    msg_offset[msg_count] = ofs;
+    msg_time_ms[msg_count] = time_ms;
+    msg_count++;
+    return true;
+}
+
+/*
+  build the index in one pass over the log. Damaged regions, such as
+  the partial blocks left by a power loss while logging, are skipped
+  by searching for the next valid message
+ */
+bool LogReader::build_index(void)
+{
+    uint32_t ofs = 0;
+    uint32_t time_ms = 0;
+    // offset in the log of the last message indexed, if it can be
+    // taken back out of the index
+    uint32_t last_ofs = 0xFFFFFFFF;
+    while (ofs + 3 <= log_size) {
+        const uint8_t *hdr = &log_data[ofs];
+        uint16_t length;
+        uint32_t msg_ofs = ofs;
+        if (hdr[0] == HEAD_BYTE1 && hdr[1] == HEAD_BYTE2 && hdr[2] == LOG_COMPACT_MSG &&
+            decode_compact(ofs, length, msg_ofs)) {
+            // decoded against the last message of its type
+        } else {
+            length = message_length(ofs);
+            if (length == 0) {
+                if (last_ofs != 0xFFFFFFFF) {
+                    // the damage usually starts part way through the
+                    // last message, as when a block was only partly
+                    // written, so don't trust it and search from
+                    // just after its start
+                    msg_count--;
+                    type_index[data_at(msg_offset[msg_count])[2]].count--;
+                    ofs = last_ofs;
+                    last_ofs = 0xFFFFFFFF;
+                }
+                uint32_t next = resync(ofs+1);
+                num_corrupt++;
+                num_skipped += next - ofs;
+                // compact messages may have been lost with the damaged
+                // region, so the next ones of each type can't be
+                // decoded until a full message is seen
+                memset(compact_ref, 0xFF, sizeof(compact_ref));
+                ofs = next;
+                continue;
+            }
+            if (hdr[2] == LOG_COMPACT_MSG) {
+                num_compact_dropped++;
+                last_ofs = 0xFFFFFFFF;
+                ofs += length;
+                continue;
+            }
+            if (hdr[2] == LOG_FORMAT_MSG) {
+                struct log_Format f;
+                memcpy(&f, hdr, sizeof(f));
+                add_format(f);
+            } else {
+                compact_ref[hdr[2]] = ofs;
+                if (hdr[2] == LOG_FORMAT_COMPACT_MSG && length >= sizeof(struct log_Format_Compact)) {
+                    struct log_Format_Compact fc;
+                    memcpy(&fc, hdr, sizeof(fc));
+                    memcpy(compact_encoding[fc.type], fc.encoding, sizeof(fc.encoding));
+                    have_compact[fc.type] = true;
+                    compact_ref[fc.type] = 0xFFFFFFFF;
+                }
+            }
+        }
+        const uint8_t *msg = data_at(msg_ofs);
+        uint8_t tofs = time_offset[msg[2]];
+        if (tofs != 0) {
+            uint32_t t;
+            memcpy(&t, &msg[tofs], sizeof(t));
+            // keep times ordered so they can be searched
+            if (t > time_ms) {
+                time_ms = t;
+            }
+        }
+        if (!add_message(msg_ofs, time_ms)) {
+            return false;
+        }
+        // formats are kept, as they have already been applied
+        last_ofs = hdr[2] == LOG_FORMAT_MSG ? 0xFFFFFFFF : ofs;
+        ofs += length;
+    }
+    if (ofs < log_size) {
+        // a partial header at the end
+        num_corrupt++;
+        num_skipped += log_size - ofs;
+    }
+    return true;
+}
+
+/*
+  length of the message at ofs, or zero if it isn't a whole message
+  of a known type. Compact messages are decoded against zeros, as
+  the length doesn't depend on the message they are decoded against
+ */
+uint16_t LogReader::message_length(uint32_t ofs) const
+{
+    if (ofs + 3 > log_size) {
+        return 0;
+    }
+    const uint8_t *p = &log_data[ofs];
+    if (p[0] != HEAD_BYTE1 || p[1] != HEAD_BYTE2) {
+        return 0;
+    }
+    uint16_t length;
+    if (p[2] == LOG_FORMAT_MSG) {
+        length = sizeof(struct log_Format);
+        if (ofs + length <= log_size && ((const struct log_Format *)p)->length < 3) {
+            return 0;
+        }
+    } else if (p[2] == LOG_COMPACT_MSG) {
+        if (ofs + 4 > log_size) {
+            return 0;
+        }
+        uint8_t type = p[3];
+        if (!have_compact[type] || !have_format[type]) {
+            return 0;
+        }
+        uint8_t msg[256];
+        memset(msg, 0, formats[type].length);
+        uint32_t in_len = log_size - (ofs + 4);
+        if (in_len > 0xFFFF) {
+            in_len = 0xFFFF;
+        }
+        int16_t n = DataFlash_Class::compact_decode(compact_encoding[type], formats[type].length,
+                                                    &p[4], in_len, msg);
+        if (n < 0) {
+            return 0;
+        }
+        length = 4 + n;
+    } else if (have_format[p[2]] && formats[p[2]].length >= 3) {
+        length = formats[p[2]].length;
+    } else {
+        return 0;
+    }
+    if (ofs + length > log_size) {
+        return 0;
+    }
+    return length;
+}
+
+/*
+  find the first message at or after ofs, returning log_size if there
+  is none. Damaged regions easily contain the header bytes, so a
+  message is only trusted if it is followed by another one or by the
+  end of the log. The header is searched for with memchr(), which is
+  much faster than stepping through the region a byte at a time
+ */
+uint32_t LogReader::resync(uint32_t ofs) const
+{
+    while (ofs + 3 <= log_size) {
+        const uint8_t *p = (const uint8_t *)memchr(&log_data[ofs], HEAD_BYTE1, log_size - ofs);
+        if (p == NULL) {
+            break;
+        }
+        ofs = p - log_data;
+        uint16_t length = message_length(ofs);
+        if (length != 0 &&
+            (ofs + length + 3 > log_size || message_length(ofs + length) != 0)) {
+            return ofs;
+        }
+        ofs++;
+    }
+    return log_size;
+}
+
+/*
+  decode the compact message at ofs against the last message of its
+  type, giving its length in the log and the offset of the decoded
+  message. Returns false if it can't be decoded
+ */
+bool LogReader::decode_compact(uint32_t ofs, uint16_t &length, uint32_t &msg_ofs)
+{
+    if (ofs + 4 > log_size) {
+        return false;
+    }
+    uint8_t type = log_data[ofs+3];
+    if (!have_compact[type] || !have_format[type] || compact_ref[type] == 0xFFFFFFFF) {
+        return false;
+    }
+    uint8_t msg_len = formats[type].length;
+    if (decoded_size + msg_len > decoded_alloc) {
+        uint32_t n = decoded_alloc ? decoded_alloc*2 : 65536;
+        uint8_t *new_decoded = (uint8_t *)realloc(decoded, n);
+        if (new_decoded == NULL) {
+            return false;
+        }
+        decoded = new_decoded;
+        decoded_alloc = n;
+    }
+    uint8_t *msg = &decoded[decoded_size];
+    memcpy(msg, data_at(compact_ref[type]), msg_len);
+    uint32_t in_len = log_size - (ofs + 4);
+    if (in_len > 0xFFFF) {
+        in_len = 0xFFFF;
+    }
+    int16_t n = DataFlash_Class::compact_decode(compact_encoding[type], msg_len,
+                                                &log_data[ofs+4], in_len, msg);
+    if (n < 0) {
+        return false;
+    }
+    length = 4 + n;
+    msg_ofs = log_size + decoded_size;
+    decoded_size += msg_len;
+    compact_ref[type] = msg_ofs;
     return true;
 }
 
+const struct log_Format *LogReader::get_format(uint8_t type) const
+{
+    if (!have_format[type]) {
+        return NULL;
+    }
+    return &formats[type];
+}
+
+/*
+  binary search for the first message at or after time_ms
+ */
+uint32_t LogReader::find_time(uint32_t time_ms) const
+{
+    uint32_t lo = 0, hi = msg_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (msg_time_ms[mid] < time_ms) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+  binary search for the first message of type at or after idx
+ */
+uint32_t LogReader::find_type(uint8_t type, uint32_t idx) const
+{
+    const uint32_t *msgs = type_index[type].msgs;
+    uint32_t lo = 0, hi = type_index[type].count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (msgs[mid] < idx) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void LogReader::seek_time(uint32_t time_ms)
+{
+    uint32_t idx = find_time(time_ms);
+
+    // apply the parameters and vehicle detection we are skipping
+    // over, without parsing the rest of the log
+    const uint8_t types[2] = { LOG_PARAMETER_MSG, LOG_MESSAGE_MSG };
+    for (uint8_t t=0; t<2; t++) {
+        uint8_t type = types[t];
+        if (!have_format[type]) {
+            continue;
+        }
+        for (uint32_t n=0; n<type_index[type].count; n++) {
+            uint32_t i = type_index[type].msgs[n];
+            if (i >= idx) {
+                break;
+            }
+            process_message(formats[type], message_data(i));
+        }
+    }
+    next_msg = idx;
+}
+
 
 struct PACKED log_Plane_Compass {
     LOG_PACKET_HEADER;
@@ -132,7 +563,7 @@ struct PACKED log_Rover_Compass {
     int16_t motor_offset_z;
 };
 
-void LogReader::process_plane(uint8_t type, uint8_t *data, uint16_t length)
+void LogReader::process_plane(uint8_t type, const uint8_t *data, uint16_t length)
 {
     switch (type) {
     case LOG_PLANE_COMPASS_MSG: {
@@ -174,7 +605,7 @@ void LogReader::process_plane(uint8_t type, uint8_t *data, uint16_t length)
     }
 }
 
-void LogReader::process_rover(uint8_t type, uint8_t *data, uint16_t length)
+void LogReader::process_rover(uint8_t type, const uint8_t *data, uint16_t length)
 {
     switch (type) {
     case LOG_ROVER_COMPASS_MSG: {
@@ -204,7 +635,7 @@ void LogReader::process_rover(uint8_t type, uint8_t *data, uint16_t length)
     }
 }
 
-void LogReader::process_copter(uint8_t type, uint8_t *data, uint16_t length)
+void LogReader::process_copter(uint8_t type, const uint8_t *data, uint16_t length)
 {
     switch (type) {
     case LOG_COPTER_COMPASS_MSG: {
@@ -276,43 +707,29 @@ bool LogReader::set_parameter(const char *name, float value)
 
 bool LogReader::update(uint8_t &type)
 {
-    uint8_t hdr[3];
-    if (::read(fd, hdr, 3) != 3) {
+    if (next_msg >= msg_count) {
         return false;
     }
-    if (hdr[0] != HEAD_BYTE1 || hdr[1] != HEAD_BYTE2) {
-        printf("bad log header\n");
+    if (end_time_ms != 0 && msg_time_ms[next_msg] > end_time_ms) {
         return false;
     }
+    const uint8_t *data = message_data(next_msg++);
 
-    if (hdr[2] == LOG_FORMAT_MSG) {
-        struct log_Format &f = formats[num_formats];
-        memcpy(&f, hdr, 3);
-        if (::read(fd, &f.type, sizeof(f)-3) != sizeof(f)-3) {
-            return false;
-        }
-        if (num_formats < LOGREADER_MAX_FORMATS-1) {
-            num_formats++;
-        }
-        type = f.type;
+    if (data[2] == LOG_FORMAT_MSG) {
+        // formats were all read when the log was indexed
+        type = ((const struct log_Format *)data)->type;
         return true;
     }
 
-    uint8_t i;
-    for (i=0; i<num_formats; i++) {
-        if (formats[i].type == hdr[2]) break;
-    }
-    if (i == num_formats) {
-        return false;
-    }
-    const struct log_Format &f = formats[i];
-    
-    uint8_t data[f.length];
-    memcpy(data, hdr, 3);
-    if (::read(fd, &data[3], f.length-3) != f.length-3) {
-        return false;
-    }
+    const struct log_Format &f = formats[data[2]];
+    process_message(f, data);
+    type = f.type;
+
+    return true;
+}
 
+void LogReader::process_message(const struct log_Format &f, const uint8_t *data)
+{
     switch (f.type) {
     case LOG_MESSAGE_MSG: {
         struct log_Message msg;
@@ -478,10 +895,6 @@ bool LogReader::update(uint8_t &type)
         }
         break;
     }
-
-    type = f.type;
-
-    return true;
 }
 
 void LogReader::wait_timestamp(uint32_t timestamp)
@@ -24,6 +24,46 @@ public:
     bool update(uint8_t &type);
     bool wait_type(uint8_t type);
 
+    /*
+      the log is memory mapped and indexed when opened. Messages are
+      numbered from zero in log order, and each has a time in
+      milliseconds, taken from its own timestamp or else the last
+      timestamp before it
+     */
+    uint32_t num_messages(void) const { return msg_count; }
+    uint32_t message_time(uint32_t idx) const { return msg_time_ms[idx]; }
+    const uint8_t *message_data(uint32_t idx) const { return data_at(msg_offset[idx]); }
+    uint8_t message_type(uint32_t idx) const { return data_at(msg_offset[idx])[2]; }
+    const struct log_Format *get_format(uint8_t type) const;
+
+    // first message at or after time_ms
+    uint32_t find_time(uint32_t time_ms) const;
+
+    // number of messages of one type, and the n'th of them
+    uint32_t num_messages_of_type(uint8_t type) const { return type_index[type].count; }
+    uint32_t message_of_type(uint8_t type, uint32_t n) const { return type_index[type].msgs[n]; }
+
+    // first message of type at or after message idx, as n for message_of_type()
+    uint32_t find_type(uint8_t type, uint32_t idx) const;
+
+    /*
+      replay from time_ms, and stop before any message after
+      end_ms if it is non-zero. Parameters and vehicle messages
+      before time_ms are still applied
+     */
+    void seek_time(uint32_t time_ms);
+    void set_end_time(uint32_t end_ms) { end_time_ms = end_ms; }
+
+    /*
+      damaged regions of the log are skipped when it is indexed. These
+      give the number of regions and bytes skipped, and the number of
+      compact messages that were dropped because the messages they
+      depend on were lost
+     */
+    uint32_t corrupt_regions(void) const { return num_corrupt; }
+    uint32_t bytes_skipped(void) const { return num_skipped; }
+    uint32_t compact_dropped(void) const { return num_compact_dropped; }
+
     const Vector3f &get_attitude(void) const { return attitude; }
     const Vector3f &get_inavpos(void) const { return inavpos; }
     const Vector3f &get_sim_attitude(void) const { return sim_attitude; }
@@ -39,7 +79,6 @@ public:
     void set_gyro_mask(uint8_t mask) { gyro_mask = mask; }
 
 private:
-    int fd;
     AP_AHRS &ahrs;
     AP_InertialSensor &ins;
     AP_Baro_HIL &baro;
@@ -52,9 +91,54 @@ private:
 
     uint32_t ground_alt_cm;
 
-#define LOGREADER_MAX_FORMATS 100
-    uint8_t num_formats;
-    struct log_Format formats[LOGREADER_MAX_FORMATS];
+    // the mapped log file
+    const uint8_t *log_data;
+    uint32_t log_size;
+
+    // formats by message type, and the offset of the timestamp in
+    // each type, or zero if it has none
+    bool have_format[256];
+    struct log_Format formats[256];
+    uint8_t time_offset[256];
+
+    /*
+      compact messages are decoded into full messages when the log
+      is indexed. Offsets from log_size up are in the decoded
+      messages. compact_ref is the offset of the last message of each
+      type, which the next compact message is decoded against
+     */
+    bool have_compact[256];
+    char compact_encoding[256][16];
+    uint32_t compact_ref[256];
+    uint8_t *decoded;
+    uint32_t decoded_size;
+    uint32_t decoded_alloc;
+
+    const uint8_t *data_at(uint32_t ofs) const {
+        return ofs < log_size ? &log_data[ofs] : &decoded[ofs - log_size];
+    }
+
+    // offset and time of each message
+    uint32_t msg_count;
+    uint32_t msg_alloc;
+    uint32_t *msg_offset;
+    uint32_t *msg_time_ms;
+
+    // messages of each type
+    struct {
+        uint32_t count;
+        uint32_t alloc;
+        uint32_t *msgs;
+    } type_index[256];
+
+    // damaged regions skipped while indexing
+    uint32_t num_corrupt;
+    uint32_t num_skipped;
+    uint32_t num_compact_dropped;
+
+    // next message for update(), and where to stop
+    uint32_t next_msg;
+    uint32_t end_time_ms;
 
     Vector3f attitude;
     Vector3f sim_attitude;
@@ -63,7 +147,15 @@ private:
 
     void wait_timestamp(uint32_t timestamp);
 
-    void process_plane(uint8_t type, uint8_t *data, uint16_t length);
-    void process_copter(uint8_t type, uint8_t *data, uint16_t length);
-    void process_rover(uint8_t type, uint8_t *data, uint16_t length);
+    void add_format(const struct log_Format &f);
+    bool add_message(uint32_t ofs, uint32_t time_ms);
+    bool decode_compact(uint32_t ofs, uint16_t &length, uint32_t &msg_ofs);
+    uint16_t message_length(uint32_t ofs) const;
+    uint32_t resync(uint32_t ofs) const;
+    bool build_index(void);
+
+    void process_message(const struct log_Format &f, const uint8_t *data);
+    void process_plane(uint8_t type, const uint8_t *data, uint16_t length);
+    void process_copter(uint8_t type, const uint8_t *data, uint16_t length);
+    void process_rover(uint8_t type, const uint8_t *data, uint16_t length);
 };
@@ -48,6 +48,7 @@
 #include <getopt.h>
 #include <errno.h>
 #include <fenv.h>
+#include <time.h>
 
 #include "LogReader.h"
 
@@ -87,6 +88,22 @@ static bool done_baro_init;
 static bool done_home_init;
 static uint16_t update_rate = 50;
 static uint32_t arm_time_ms;
+static uint32_t start_time_ms;
+static uint32_t end_time_ms;
+static bool write_plots = true;
+
+// wall clock time the replay started
+static struct timespec wall_start;
+
+// log time the replayed range starts, after any -s skip
+static uint32_t replay_start_ms;
+
+// EKF innovation statistics for the run summary
+static struct {
+    uint32_t count;
+    double vel_sq, pos_sq, hgt_sq, mag_sq, tas_sq;
+    float vel_max, pos_max, hgt_max, mag_max, tas_max;
+} innov;
 
 static uint8_t num_user_parameters;
 static struct {
@@ -103,6 +120,9 @@ static void usage(void)
     ::printf(" -aMASK     set accel mask (1=accel1 only, 2=accel2 only, 3=both)\n");
     ::printf(" -gMASK     set gyro mask (1=gyro1 only, 2=gyro2 only, 3=both)\n");
     ::printf(" -A time    arm at time milliseconds)\n");
+    ::printf(" -s time    start replay at time milliseconds\n");
+    ::printf(" -e time    end replay at time milliseconds\n");
+    ::printf(" -n         don't write plot files, just print a summary\n");
 }
 
 void setup()
@@ -116,7 +136,7 @@ void setup()
 
     hal.util->commandline_arguments(argc, argv);
 
-	while ((opt = getopt(argc, argv, "r:p:ha:g:A:")) != -1) {
+	while ((opt = getopt(argc, argv, "r:p:ha:g:A:s:e:n")) != -1) {
 		switch (opt) {
         case 'h':
             usage();
@@ -138,6 +158,18 @@ void setup()
             arm_time_ms = strtoul(optarg, NULL, 0);
             break;
 
+        case 's':
+            start_time_ms = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'e':
+            end_time_ms = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'n':
+            write_plots = false;
+            break;
+
         case 'p':
             char *eq = strchr(optarg, '=');
             if (eq == NULL) {
@@ -170,15 +202,23 @@ void setup()
 
     load_parameters();
 
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
     if (!LogReader.open_log(filename)) {
         perror(filename);
         exit(1);
     }
 
+    if (start_time_ms != 0) {
+        LogReader.seek_time(start_time_ms);
+    }
+    LogReader.set_end_time(end_time_ms);
+
     LogReader.wait_type(LOG_GPS_MSG);
     LogReader.wait_type(LOG_IMU_MSG);
     LogReader.wait_type(LOG_GPS_MSG);
     LogReader.wait_type(LOG_IMU_MSG);
+    replay_start_ms = hal.scheduler->millis();
 
     feenableexcept(FE_INVALID | FE_OVERFLOW);
 
@@ -212,19 +252,21 @@ void setup()
         break;
     }
 
-    plotf = fopen("plot.dat", "w");
-    plotf2 = fopen("plot2.dat", "w");
-    ekf1f = fopen("EKF1.dat", "w");
-    ekf2f = fopen("EKF2.dat", "w");
-    ekf3f = fopen("EKF3.dat", "w");
-    ekf4f = fopen("EKF4.dat", "w");
-
-    fprintf(plotf, "time SIM.Roll SIM.Pitch SIM.Yaw BAR.Alt FLIGHT.Roll FLIGHT.Pitch FLIGHT.Yaw FLIGHT.dN FLIGHT.dE FLIGHT.Alt DCM.Roll DCM.Pitch DCM.Yaw EKF.Roll EKF.Pitch EKF.Yaw INAV.dN INAV.dE INAV.Alt EKF.dN EKF.dE EKF.Alt\n");
-    fprintf(plotf2, "time E1 E2 E3 VN VE VD PN PE PD GX GY GZ WN WE MN ME MD MX MY MZ E1ref E2ref E3ref\n");
-    fprintf(ekf1f, "timestamp TimeMS Roll Pitch Yaw VN VE VD PN PE PD GX GY GZ\n");
-    fprintf(ekf2f, "timestamp TimeMS AX AY AZ VWN VWE MN ME MD MX MY MZ\n");
-    fprintf(ekf3f, "timestamp TimeMS IVN IVE IVD IPN IPE IPD IMX IMY IMZ IVT\n");
-    fprintf(ekf4f, "timestamp TimeMS SV SP SH SMX SMY SMZ SVT OFN EFE\n");
+    if (write_plots) {
+        plotf = fopen("plot.dat", "w");
+        plotf2 = fopen("plot2.dat", "w");
+        ekf1f = fopen("EKF1.dat", "w");
+        ekf2f = fopen("EKF2.dat", "w");
+        ekf3f = fopen("EKF3.dat", "w");
+        ekf4f = fopen("EKF4.dat", "w");
+
+        fprintf(plotf, "time SIM.Roll SIM.Pitch SIM.Yaw BAR.Alt FLIGHT.Roll FLIGHT.Pitch FLIGHT.Yaw FLIGHT.dN FLIGHT.dE FLIGHT.Alt DCM.Roll DCM.Pitch DCM.Yaw EKF.Roll EKF.Pitch EKF.Yaw INAV.dN INAV.dE INAV.Alt EKF.dN EKF.dE EKF.Alt\n");
+        fprintf(plotf2, "time E1 E2 E3 VN VE VD PN PE PD GX GY GZ WN WE MN ME MD MX MY MZ E1ref E2ref E3ref\n");
+        fprintf(ekf1f, "timestamp TimeMS Roll Pitch Yaw VN VE VD PN PE PD GX GY GZ\n");
+        fprintf(ekf2f, "timestamp TimeMS AX AY AZ VWN VWE MN ME MD MX MY MZ\n");
+        fprintf(ekf3f, "timestamp TimeMS IVN IVE IVD IPN IPE IPD IMX IMY IMZ IVT\n");
+        fprintf(ekf4f, "timestamp TimeMS SV SP SH SMX SMY SMZ SVT OFN EFE\n");
+    }
 
     ahrs.set_ekf_use(true);
 
@@ -271,6 +313,55 @@ static void set_user_parameters(void)
     }
 }
 
+/*
+  accumulate EKF innovation statistics
+ */
+static void update_innov_stats(const Vector3f &velInnov, const Vector3f &posInnov,
+                               const Vector3f &magInnov, float tasInnov)
+{
+    float vel = velInnov.length();
+    float pos = pythagorous2(posInnov.x, posInnov.y);
+    float hgt = fabsf(posInnov.z);
+    float mag = magInnov.length();
+    float tas = fabsf(tasInnov);
+
+    innov.count++;
+    innov.vel_sq += vel*vel;
+    innov.pos_sq += pos*pos;
+    innov.hgt_sq += hgt*hgt;
+    innov.mag_sq += mag*mag;
+    innov.tas_sq += tas*tas;
+    innov.vel_max = max(innov.vel_max, vel);
+    innov.pos_max = max(innov.pos_max, pos);
+    innov.hgt_max = max(innov.hgt_max, hgt);
+    innov.mag_max = max(innov.mag_max, mag);
+    innov.tas_max = max(innov.tas_max, tas);
+}
+
+/*
+  print a one line summary of the run, for batch replay
+ */
+static void print_summary(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    float wall = (now.tv_sec - wall_start.tv_sec) + (now.tv_nsec - wall_start.tv_nsec)*1.0e-9f;
+    float log_time = (hal.scheduler->millis() - replay_start_ms)*0.001f;
+    uint32_t n = innov.count ? innov.count : 1;
+
+    ::printf("SUMMARY time=%.1f wall=%.2f speedup=%.1f samples=%u "
+             "vel_rms=%.3f vel_max=%.3f pos_rms=%.3f pos_max=%.3f "
+             "hgt_rms=%.3f hgt_max=%.3f mag_rms=%.1f mag_max=%.1f "
+             "tas_rms=%.3f tas_max=%.3f\n",
+             log_time, wall, wall > 0 ? log_time / wall : 0.0f,
+             (unsigned)innov.count,
+             sqrt(innov.vel_sq/n), innov.vel_max,
+             sqrt(innov.pos_sq/n), innov.pos_max,
+             sqrt(innov.hgt_sq/n), innov.hgt_max,
+             sqrt(innov.mag_sq/n), innov.mag_max,
+             sqrt(innov.tas_sq/n), innov.tas_max);
+}
+
 static void read_sensors(uint8_t type)
 {
     if (!done_parameters && type != LOG_FORMAT_MSG && type != LOG_PARAMETER_MSG) {
@@ -324,7 +415,10 @@ void loop()
 
         if (!LogReader.update(type)) {
             ::printf("End of log at %.1f seconds\n", hal.scheduler->millis()*0.001f);
-            fclose(plotf);
+            print_summary();
+            if (plotf != NULL) {
+                fclose(plotf);
+            }
             exit(0);
         }
         read_sensors(type);
@@ -367,6 +461,12 @@ void loop()
             NavEKF.getInnovations(velInnov, posInnov, magInnov, tasInnov);
             NavEKF.getVariances(velVar, posVar, hgtVar, magVar, tasVar, offset);
             NavEKF.getPosNED(ekf_relpos);
+
+            update_innov_stats(velInnov, posInnov, magInnov, tasInnov);
+            if (!write_plots) {
+                continue;
+            }
+
             Vector3f inav_pos = inertial_nav.get_position() * 0.01f;
             float temp = degrees(ekf_euler.z);
 
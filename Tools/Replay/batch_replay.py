@@ -0,0 +1,124 @@
+#!/usr/bin/env python
+'''
+replay a set of logs against a set of EKF parameter variants, running
+one Replay instance per log and variant across all CPUs, and print a
+summary of the EKF innovations and runtime of each run
+
+Each --variant is a parameter file in the same NAME VALUE format as
+the autotest .parm files. With no variants each log is replayed with
+the parameters it was flown with.
+
+Build Replay first with "make linux" in Tools/Replay
+'''
+
+import optparse, os, sys, subprocess, tempfile, shutil, multiprocessing, time
+
+parser = optparse.OptionParser("batch_replay.py [options] LOG...")
+parser.add_option("--replay", default="/tmp/Replay.build/Replay.elf", help="Replay executable")
+parser.add_option("--jobs", "-j", type='int', default=multiprocessing.cpu_count(), help="number of parallel replays")
+parser.add_option("--variant", action='append', default=[], help="parameter file for one variant (may be repeated)")
+parser.add_option("--param", "-p", action='append', default=[], help="NAME=VALUE to set in all variants (may be repeated)")
+parser.add_option("--rate", default=None, help="IMU rate in Hz to pass to Replay")
+parser.add_option("--csv", default=None, help="also write the summary to a CSV file")
+
+opts, args = parser.parse_args()
+
+if len(args) == 0:
+    parser.print_help()
+    sys.exit(1)
+
+# summary fields printed by Replay, in table order
+fields = ['time', 'wall', 'speedup', 'vel_rms', 'vel_max', 'pos_rms', 'pos_max',
+          'hgt_rms', 'hgt_max', 'mag_rms', 'mag_max', 'tas_rms', 'tas_max']
+
+def load_variant(filename):
+    '''load a parameter file as a list of NAME=VALUE strings'''
+    params = []
+    for line in open(filename):
+        line = line.split('#')[0].strip()
+        if not line:
+            continue
+        a = line.replace(',', ' ').split()
+        if len(a) != 2:
+            print("%s: bad line '%s'" % (filename, line))
+            sys.exit(1)
+        params.append("%s=%s" % (a[0], a[1]))
+    return params
+
+def run_replay(job):
+    '''run one replay in its own directory so the output files of
+    parallel runs don't collide'''
+    (logfile, variant, params) = job
+    cmd = [os.path.abspath(opts.replay), '--', '-n']
+    if opts.rate is not None:
+        cmd.extend(['-r', opts.rate])
+    for p in params:
+        cmd.extend(['-p', p])
+    cmd.append(os.path.abspath(logfile))
+    tmpdir = tempfile.mkdtemp(prefix='replay')
+    start = time.time()
+    try:
+        p = subprocess.Popen(cmd, cwd=tmpdir, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        output = p.communicate()[0].decode('utf-8', 'replace')
+    finally:
+        shutil.rmtree(tmpdir, ignore_errors=True)
+    result = { 'log' : logfile, 'variant' : variant, 'status' : 'FAILED' }
+    for line in output.split('\n'):
+        if line.startswith('SUMMARY '):
+            for kv in line.split()[1:]:
+                (k, v) = kv.split('=')
+                result[k] = float(v)
+            result['status'] = 'OK'
+    if result['status'] != 'OK':
+        # keep the tail of the output to show why
+        result['output'] = '\n'.join(output.split('\n')[-5:])
+        result['wall'] = time.time() - start
+    return result
+
+variants = [('log', [])]
+if opts.variant:
+    variants = [(os.path.basename(v), load_variant(v)) for v in opts.variant]
+
+jobs = []
+for logfile in args:
+    for (name, params) in variants:
+        jobs.append((logfile, name, params + opts.param))
+
+print("Replaying %u logs with %u variants on %u CPUs" % (len(args), len(variants), opts.jobs))
+start = time.time()
+pool = multiprocessing.Pool(opts.jobs)
+results = []
+for r in pool.imap_unordered(run_replay, jobs):
+    results.append(r)
+    sys.stdout.write("\r%u/%u" % (len(results), len(jobs)))
+    sys.stdout.flush()
+pool.close()
+pool.join()
+elapsed = time.time() - start
+print("")
+
+results.sort(key=lambda r: (r['log'], r['variant']))
+
+logw = max([len(os.path.basename(r['log'])) for r in results] + [3])
+varw = max([len(r['variant']) for r in results] + [7])
+print("%-*s %-*s %s" % (logw, 'Log', varw, 'Variant', ' '.join(["%8s" % f for f in fields])))
+for r in results:
+    line = "%-*s %-*s " % (logw, os.path.basename(r['log']), varw, r['variant'])
+    if r['status'] != 'OK':
+        print(line + r['status'])
+        print(r['output'])
+        continue
+    print(line + ' '.join(["%8.3f" % r[f] for f in fields]))
+
+total = sum([r['time'] for r in results if r['status'] == 'OK'])
+failed = len([r for r in results if r['status'] != 'OK'])
+print("%u runs, %u failed, %.0f seconds of log replayed in %.1f seconds (%.0fx realtime)" % (
+    len(results), failed, total, elapsed, total / max(elapsed, 0.001)))
+
+if opts.csv is not None:
+    csv = open(opts.csv, 'w')
+    csv.write("log,variant,status,%s\n" % ','.join(fields))
+    for r in results:
+        csv.write("%s,%s,%s,%s\n" % (r['log'], r['variant'], r['status'],
+                                      ','.join([str(r.get(f, '')) for f in fields])))
+    csv.close()
@@ -62,6 +62,11 @@ make clean
 make linux -j4
 popd
 
+pushd Tools/LogExport
+make clean
+make linux -j4
+popd
+
 test -n "$PX4_ROOT" && test -d "$PX4_ROOT" && {
     ./Tools/scripts/build_all_px4.sh
 }
@@ -318,7 +318,7 @@ void AP_AutoTune::write_log_headers(void)
 
 void AP_AutoTune::write_log(float servo, float demanded, float achieved)
 {
-    if (!dataflash.logging_started()) {
+    if (!dataflash.logging_started() || !dataflash.ShouldLog(LOG_MSG_ATRP)) {
         return;
     }
 
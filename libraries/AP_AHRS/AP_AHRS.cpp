@@ -120,6 +120,15 @@ const AP_Param::GroupInfo AP_AHRS::var_info[] PROGMEM = {
     AP_GROUPINFO("EKF_USE",  13, AP_AHRS, _ekf_use, 0),
 #endif
 
+#if AP_AHRS_NAVEKF_THREAD
+    // @Param: EKF_THREAD
+    // @DisplayName: Run NavEKF on its own thread
+    // @Description: On multi-core boards this runs the NavEKF Kalman filter on its own thread, so the main loop does not wait for it. The DCM solution is used when the EKF results are late. Changes take effect after a reboot
+    // @Values: 0:Disabled,1:Enabled
+    // @User: Advanced
+    AP_GROUPINFO("EKF_THREAD",  14, AP_AHRS, _ekf_thread, 0),
+#endif
+
     AP_GROUPEND
 };
 
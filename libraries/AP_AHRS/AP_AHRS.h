@@ -335,6 +335,7 @@ protected:
     AP_Int8 _gps_minsats;
     AP_Int8 _gps_delay;
     AP_Int8 _ekf_use;
+    AP_Int8 _ekf_thread;
 
     // flags structure
     struct ahrs_flags {
@@ -23,6 +23,14 @@
 
 #if AP_AHRS_NAVEKF_AVAILABLE
 
+#if AP_AHRS_NAVEKF_THREAD
+#include <sched.h>
+#include <unistd.h>
+
+// the EKF thread runs above the main thread so it keeps up with the IMU
+#define AP_AHRS_NAVEKF_THREAD_PRIORITY 12
+#endif
+
 extern const AP_HAL::HAL& hal;
 
 // return the smoothed gyro vector corrected for drift
@@ -59,19 +67,30 @@ void AP_AHRS_NavEKF::update(void)
             }
             if (hal.scheduler->millis() - start_time_ms > startup_delay_ms) {
                 ekf_started = true;
-                EKF.InitialiseFilterDynamic();
+#if AP_AHRS_NAVEKF_THREAD
+                if (_ekf_thread) {
+                    _ekf_thread_started = start_ekf_thread();
+                }
+#endif
+                run_ekf(EKF_INIT_DYNAMIC);
             }
         }
     }
     if (ekf_started) {
-        EKF.UpdateFilter();
-        EKF.getRotationBodyToNED(_dcm_matrix);
+        run_ekf(EKF_UPDATE);
+#if AP_AHRS_NAVEKF_THREAD
+        if (_ekf_thread_started) {
+            // take the latest results the EKF thread has published. If
+            // it is part way through publishing we keep the previous
+            // results rather than wait for it
+            _ekf_published.read(_ekf_out);
+        }
+#endif
+        _dcm_matrix = _ekf_out.dcm_matrix;
         if (using_EKF()) {
-            Vector3f eulers;
-            EKF.getEulerAngles(eulers);
-            roll  = eulers.x;
-            pitch = eulers.y;
-            yaw   = eulers.z;
+            roll  = _ekf_out.eulers.x;
+            pitch = _ekf_out.eulers.y;
+            yaw   = _ekf_out.eulers.z;
             roll_sensor  = degrees(roll) * 100;
             pitch_sensor = degrees(pitch) * 100;
             yaw_sensor   = degrees(yaw) * 100;
@@ -86,7 +105,7 @@ void AP_AHRS_NavEKF::reset(bool recover_eulers)
 {
     AP_AHRS_DCM::reset(recover_eulers);
     if (ekf_started) {
-        EKF.InitialiseFilterBootstrap();        
+        run_ekf(EKF_INIT_BOOTSTRAP);
     }
 }
 
@@ -95,14 +114,183 @@ void AP_AHRS_NavEKF::reset_attitude(const float &_roll, const float &_pitch, con
 {
     AP_AHRS_DCM::reset_attitude(_roll, _pitch, _yaw);
     if (ekf_started) {
-        EKF.InitialiseFilterBootstrap();        
+        run_ekf(EKF_INIT_BOOTSTRAP);
+    }
+}
+
+/*
+  run an EKF command with the current sensor data. With the EKF
+  thread running the sensor data is queued for the thread and the
+  results are picked up by a later update()
+ */
+void AP_AHRS_NavEKF::run_ekf(enum ekf_command command)
+{
+#if AP_AHRS_NAVEKF_THREAD
+    if (_ekf_thread_started) {
+        if (command == EKF_UPDATE) {
+            // a reset that didn't fit in the queue replaces the update
+            command = _ekf_pending_command;
+        }
+        struct ekf_sample sample;
+        sample.command = command;
+        EKF.CaptureInputs(sample.inputs);
+        if (!_ekf_queue.push(sample)) {
+            // the EKF thread has fallen behind. Drop this sample, the
+            // EKF will integrate over the gap on the next one. A reset
+            // is kept and sent with the next sample instead
+            _ekf_queue_drops++;
+            _ekf_pending_command = command;
+            return;
+        }
+        _ekf_pending_command = EKF_UPDATE;
+        sem_post(&_ekf_sem);
+        return;
+    }
+#endif
+
+    switch (command) {
+    case EKF_INIT_DYNAMIC:
+        EKF.InitialiseFilterDynamic();
+        break;
+    case EKF_INIT_BOOTSTRAP:
+        EKF.InitialiseFilterBootstrap();
+        break;
+    case EKF_UPDATE:
+        EKF.UpdateFilter();
+        break;
     }
+    get_ekf_outputs(_ekf_out, hal.scheduler->millis());
 }
 
+void AP_AHRS_NavEKF::get_ekf_outputs(struct ekf_outputs &out, uint32_t time_ms) const
+{
+    out.time_ms = time_ms;
+    out.healthy = EKF.healthy();
+    EKF.getRotationBodyToNED(out.dcm_matrix);
+    EKF.getEulerAngles(out.eulers);
+    EKF.getVelNED(out.velNED);
+    out.have_posNED = EKF.getPosNED(out.posNED);
+    EKF.getWind(out.wind);
+    out.have_location = EKF.getLLH(out.location);
+}
+
+void AP_AHRS_NavEKF::read_ekf_log_data(struct ekf_log_data &data) const
+{
+    EKF.getEulerAngles(data.euler);
+    EKF.getVelNED(data.velNED);
+    EKF.getPosNED(data.posNED);
+    EKF.getGyroBias(data.gyroBias);
+    EKF.getAccelBias(data.accelBias);
+    EKF.getWind(data.wind);
+    EKF.getMagNED(data.magNED);
+    EKF.getMagXYZ(data.magXYZ);
+    EKF.getInnovations(data.velInnov, data.posInnov, data.magInnov, data.tasInnov);
+    EKF.getVariances(data.velVar, data.posVar, data.hgtVar, data.magVar, data.tasVar, data.offset);
+}
+
+void AP_AHRS_NavEKF::get_ekf_log_data(struct ekf_log_data &data)
+{
+#if AP_AHRS_NAVEKF_THREAD
+    if (_ekf_thread_started) {
+        // keep the previous state if the EKF thread is part way
+        // through publishing
+        _ekf_log_published.read(_ekf_log);
+        data = _ekf_log;
+        return;
+    }
+#endif
+    read_ekf_log_data(data);
+}
+
+#if AP_AHRS_NAVEKF_THREAD
+/*
+  start the EKF thread. It runs above the main thread priority so
+  that it keeps up with the IMU, pinned to the last CPU away from the
+  main loop on CPU 0
+ */
+bool AP_AHRS_NavEKF::start_ekf_thread(void)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus <= 1) {
+        return false;
+    }
+    if (!_ekf_queue.set_size(AP_AHRS_NAVEKF_QUEUE_LEN)) {
+        return false;
+    }
+    if (sem_init(&_ekf_sem, 0, 0) != 0) {
+        return false;
+    }
+
+    pthread_attr_t thread_attr;
+    struct sched_param param;
+    cpu_set_t cpus;
+
+    pthread_attr_init(&thread_attr);
+    param.sched_priority = AP_AHRS_NAVEKF_THREAD_PRIORITY;
+    (void)pthread_attr_setschedparam(&thread_attr, &param);
+    pthread_attr_setschedpolicy(&thread_attr, SCHED_FIFO);
+    // use the priority above rather than inheriting the main thread's
+    pthread_attr_setinheritsched(&thread_attr, PTHREAD_EXPLICIT_SCHED);
+    CPU_ZERO(&cpus);
+    CPU_SET(ncpus-1, &cpus);
+    (void)pthread_attr_setaffinity_np(&thread_attr, sizeof(cpus), &cpus);
+
+    bool ret = (pthread_create(&_ekf_thread_ctx, &thread_attr, &AP_AHRS_NavEKF::ekf_thread, this) == 0);
+    pthread_attr_destroy(&thread_attr);
+    if (!ret) {
+        sem_destroy(&_ekf_sem);
+        return false;
+    }
+    hal.console->printf_P(PSTR("AHRS: EKF thread on CPU %ld\n"), ncpus-1);
+    return true;
+}
+
+void *AP_AHRS_NavEKF::ekf_thread(void *arg)
+{
+    ((AP_AHRS_NavEKF *)arg)->ekf_thread_loop();
+    return NULL;
+}
+
+/*
+  run the queued EKF commands, publishing the results and the state
+  for logging after each one
+ */
+void AP_AHRS_NavEKF::ekf_thread_loop(void)
+{
+    struct ekf_sample sample;
+    struct ekf_outputs out;
+    struct ekf_log_data log_data;
+    while (true) {
+        if (sem_wait(&_ekf_sem) != 0) {
+            // interrupted by a signal
+            continue;
+        }
+        while (_ekf_queue.pop(sample)) {
+            switch (sample.command) {
+            case EKF_INIT_DYNAMIC:
+                EKF.InitialiseFilterDynamic(sample.inputs);
+                break;
+            case EKF_INIT_BOOTSTRAP:
+                EKF.InitialiseFilterBootstrap(sample.inputs);
+                break;
+            case EKF_UPDATE:
+                EKF.UpdateFilter(sample.inputs);
+                break;
+            }
+            get_ekf_outputs(out, sample.inputs.imuTime_ms);
+            _ekf_published.write(out);
+            read_ekf_log_data(log_data);
+            _ekf_log_published.write(log_data);
+        }
+    }
+}
+#endif // AP_AHRS_NAVEKF_THREAD
+
 // dead-reckoning support
 bool AP_AHRS_NavEKF::get_position(struct Location &loc)
 {
-    if (using_EKF() && EKF.getLLH(loc)) {
+    if (using_EKF() && _ekf_out.have_location) {
+        loc = _ekf_out.location;
         return true;
     }
     return AP_AHRS_DCM::get_position(loc);
@@ -127,9 +315,7 @@ Vector3f AP_AHRS_NavEKF::wind_estimate(void)
         // sensor active
         return AP_AHRS_DCM::wind_estimate();
     }
-    Vector3f wind;
-    EKF.getWind(wind);
-    return wind;
+    return _ekf_out.wind;
 }
 
 // return an airspeed estimate if available. return true
@@ -156,7 +342,7 @@ bool AP_AHRS_NavEKF::get_secondary_attitude(Vector3f &eulers)
     }
     if (ekf_started) {
         // EKF is secondary
-        EKF.getEulerAngles(eulers);
+        eulers = _ekf_out.eulers;
         return true;
     }
     // no secondary available
@@ -173,7 +359,7 @@ bool AP_AHRS_NavEKF::get_secondary_position(struct Location &loc)
     }    
     if (ekf_started) {
         // EKF is secondary
-        EKF.getLLH(loc);
+        loc = _ekf_out.location;
         return true;
     }
     // no secondary available
@@ -186,9 +372,7 @@ Vector2f AP_AHRS_NavEKF::groundspeed_vector(void)
     if (!using_EKF()) {
         return AP_AHRS_DCM::groundspeed_vector();
     }
-    Vector3f vec;
-    EKF.getVelNED(vec);
-    return Vector2f(vec.x, vec.y);
+    return Vector2f(_ekf_out.velNED.x, _ekf_out.velNED.y);
 }
 
 void AP_AHRS_NavEKF::set_home(const Location &loc)
@@ -207,7 +391,7 @@ bool AP_AHRS_NavEKF::have_inertial_nav(void) const
 bool AP_AHRS_NavEKF::get_velocity_NED(Vector3f &vec) const
 {
     if (using_EKF()) {
-        EKF.getVelNED(vec);
+        vec = _ekf_out.velNED;
         return true;
     }
     return false;
@@ -218,14 +402,25 @@ bool AP_AHRS_NavEKF::get_velocity_NED(Vector3f &vec) const
 bool AP_AHRS_NavEKF::get_relative_position_NED(Vector3f &vec) const
 {
     if (using_EKF()) {
-        return EKF.getPosNED(vec);
+        vec = _ekf_out.posNED;
+        return _ekf_out.have_posNED;
     }
     return false;
 }
 
 bool AP_AHRS_NavEKF::using_EKF(void) const
 {
-    return ekf_started && _ekf_use && EKF.healthy();
+    if (!ekf_started || !_ekf_use || !_ekf_out.healthy) {
+        return false;
+    }
+#if AP_AHRS_NAVEKF_THREAD
+    // fall back to DCM if the EKF thread is not keeping up
+    if (_ekf_thread_started &&
+        hal.scheduler->millis() - _ekf_out.time_ms > AP_AHRS_NAVEKF_MAX_LAG_MS) {
+        return false;
+    }
+#endif
+    return true;
 }
 
 #endif // AP_AHRS_NAVEKF_AVAILABLE
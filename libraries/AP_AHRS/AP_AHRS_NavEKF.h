@@ -29,6 +29,23 @@
 
 #define AP_AHRS_NAVEKF_AVAILABLE 1
 
+// on Linux boards the EKF can run on its own thread, see AHRS_EKF_THREAD
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+#define AP_AHRS_NAVEKF_THREAD 1
+#include <pthread.h>
+#include <semaphore.h>
+#include <utility/RingBuffer.h>
+#include <utility/Seqlock.h>
+#else
+#define AP_AHRS_NAVEKF_THREAD 0
+#endif
+
+// number of IMU samples that can be queued for the EKF thread
+#define AP_AHRS_NAVEKF_QUEUE_LEN 32
+
+// EKF results older than this are not used, and DCM is used instead
+#define AP_AHRS_NAVEKF_MAX_LAG_MS 100
+
 class AP_AHRS_NavEKF : public AP_AHRS_DCM
 {
 public:
@@ -38,7 +55,16 @@ public:
         EKF(this, baro),
         ekf_started(false),
         startup_delay_ms(10000)
+#if AP_AHRS_NAVEKF_THREAD
+        ,_ekf_thread_started(false),
+        _ekf_queue_drops(0),
+        _ekf_pending_command(EKF_UPDATE)
+#endif
         {
+            _ekf_out = ekf_outputs();
+#if AP_AHRS_NAVEKF_THREAD
+            _ekf_log = ekf_log_data();
+#endif
         }
 
     // return the smoothed gyro vector corrected for drift
@@ -92,15 +118,108 @@ public:
 
     void set_ekf_use(bool setting) { _ekf_use.set(setting); }
 
+#if AP_AHRS_NAVEKF_THREAD
+    // number of IMU samples dropped because the EKF thread fell behind
+    uint32_t get_ekf_queue_drops(void) const { return _ekf_queue_drops; }
+#endif
+
+    // the EKF state recorded in the EKF log messages
+    struct ekf_log_data {
+        Vector3f euler;
+        Vector3f velNED;
+        Vector3f posNED;
+        Vector3f gyroBias;
+        Vector3f accelBias;
+        Vector3f wind;
+        Vector3f magNED;
+        Vector3f magXYZ;
+        Vector3f velInnov;
+        Vector3f posInnov;
+        Vector3f magInnov;
+        float tasInnov;
+        float velVar;
+        float posVar;
+        float hgtVar;
+        Vector3f magVar;
+        float tasVar;
+        Vector2f offset;
+    };
+
+    // get the EKF state for logging. With the EKF thread running this
+    // is the state it last published, as the filter itself may be
+    // part way through an update
+    void get_ekf_log_data(struct ekf_log_data &data);
+
 private:
     bool using_EKF(void) const;
 
+    enum ekf_command {
+        EKF_UPDATE             = 0,
+        EKF_INIT_DYNAMIC       = 1,
+        EKF_INIT_BOOTSTRAP     = 2
+    };
+
+    // the EKF results used by the AHRS, taken after each filter update
+    struct ekf_outputs {
+        uint32_t time_ms;           // time of the IMU data used by the update
+        bool healthy;
+        bool have_posNED;
+        bool have_location;
+        Matrix3f dcm_matrix;
+        Vector3f eulers;
+        Vector3f velNED;
+        Vector3f posNED;
+        Vector3f wind;
+        struct Location location;
+    };
+
+    // run an EKF command, on the EKF thread if it is running
+    void run_ekf(enum ekf_command command);
+
+    // get the EKF results used by the AHRS, after an update with IMU
+    // data from time_ms
+    void get_ekf_outputs(struct ekf_outputs &out, uint32_t time_ms) const;
+
+    // get the EKF state for logging from the filter
+    void read_ekf_log_data(struct ekf_log_data &data) const;
+
     NavEKF EKF;
     bool ekf_started;
     Matrix3f _dcm_matrix;
     Vector3f _dcm_attitude;
     const uint16_t startup_delay_ms;
     uint32_t start_time_ms;
+
+    // latest EKF results. When the EKF runs on its own thread this
+    // is a copy of the results it last published
+    struct ekf_outputs _ekf_out;
+
+#if AP_AHRS_NAVEKF_THREAD
+    // an IMU sample, or a reset request, for the EKF thread
+    struct ekf_sample {
+        uint8_t command;
+        NavEKF::sensor_inputs inputs;
+    };
+
+    bool start_ekf_thread(void);
+    static void *ekf_thread(void *arg);
+    void ekf_thread_loop(void);
+
+    bool _ekf_thread_started;
+    uint32_t _ekf_queue_drops;
+
+    // a reset request that didn't fit in the queue, sent in place of
+    // the next update
+    enum ekf_command _ekf_pending_command;
+    pthread_t _ekf_thread_ctx;
+    sem_t _ekf_sem;
+    RingBuffer<struct ekf_sample> _ekf_queue;
+    Seqlock<struct ekf_outputs> _ekf_published;
+    Seqlock<struct ekf_log_data> _ekf_log_published;
+
+    // latest EKF state for logging taken from _ekf_log_published
+    struct ekf_log_data _ekf_log;
+#endif
 };
 #endif
 
@@ -26,6 +26,7 @@
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_NavEKF.h>
+#include <AP_Buffer.h>
 #include <AP_Notify.h>
 #include <AP_Mission.h>
 
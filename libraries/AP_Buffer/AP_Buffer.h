@@ -27,12 +27,12 @@ public:
     void push_back( const T &item );
 
     /// pop_front - removes an element from the begin of the buffer (i.e. the oldest element)
-    /// and returns it.  If the buffer is empty, 0 is returned
+    /// and returns it.  If the buffer is empty, a value initialised T (0 for numbers) is returned
     /// @return
     T pop_front();
 
     /// peek - returns a reference to an element of the buffer
-    /// if position isn't valid (i.e. >= size()) 0 is returned
+    /// if position isn't valid (i.e. >= size()) a value initialised T is returned
     /// @param position : index of the element
     /// "0" is the oldest, size()-1 is the newest
     /// @return
@@ -109,7 +109,7 @@ T AP_Buffer<T,SIZE>::pop_front()
 
 	// return zero if buffer is empty
 	if( _num_items == 0 ) {
-		return 0;
+		return T();
 	}
 
 	// get next value in buffer
@@ -134,7 +134,7 @@ const T& AP_Buffer<T,SIZE>::peek(uint8_t position) const
 
     // return zero if position is out of range
     if( position >= _num_items ) {
-    	const static T r = 0;
+    	const static T r = T();
         return r;
     }
 
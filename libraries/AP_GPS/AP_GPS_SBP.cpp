@@ -436,7 +436,8 @@ void AP_GPS_SBP::logging_write_headers(void)
 void AP_GPS_SBP::logging_log_health(float pos_msg_hz, float vel_msg_hz, float dops_msg_hz, float baseline_msg_hz, float crc_error_hz)
 {
 
-    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started()) {
+    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started() ||
+        !gps._DataFlash->ShouldLog(LOG_MSG_SBPHEALTH)) {
       return;
     }
 
@@ -458,7 +459,8 @@ void AP_GPS_SBP::logging_log_health(float pos_msg_hz, float vel_msg_hz, float do
 void AP_GPS_SBP::logging_log_baseline(struct sbp_baseline_ecef_t* b)
 {
 
-    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started()) {
+    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started() ||
+        !gps._DataFlash->ShouldLog(LOG_MSG_SBPBASELINE)) {
       return;
     }
 
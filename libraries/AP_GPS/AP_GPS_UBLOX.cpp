@@ -287,7 +287,8 @@ void AP_GPS_UBLOX::write_logging_headers(void)
 
 void AP_GPS_UBLOX::log_mon_hw(void)
 {
-    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started()) {
+    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started() ||
+        !gps._DataFlash->ShouldLog(LOG_MSG_UBX1)) {
         return;
     }
     // log mon_hw message
@@ -311,7 +312,8 @@ void AP_GPS_UBLOX::log_mon_hw(void)
 
 void AP_GPS_UBLOX::log_mon_hw2(void)
 {
-    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started()) {
+    if (gps._DataFlash == NULL || !gps._DataFlash->logging_started() ||
+        !gps._DataFlash->ShouldLog(LOG_MSG_UBX2)) {
         return;
     }
     // log mon_hw message
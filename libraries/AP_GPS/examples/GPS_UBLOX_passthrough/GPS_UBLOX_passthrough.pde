@@ -22,6 +22,7 @@
 #include <AP_Baro.h>
 #include <Filter.h>
 #include <AP_AHRS.h>
+#include <AP_Buffer.h>
 #include <AP_Compass.h>
 #include <AP_Declination.h>
 #include <AP_Airspeed.h>
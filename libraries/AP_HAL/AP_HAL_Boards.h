@@ -69,7 +69,10 @@
 #define HAL_BOARD_NAME "SITL"
 #define HAL_CPU_CLASS HAL_CPU_CLASS_1000
 #define HAL_OS_POSIX_IO 1
+// storage is a file, so the size can be raised at build time
+#ifndef HAL_STORAGE_SIZE
 #define HAL_STORAGE_SIZE            4096
+#endif
 #define HAL_STORAGE_SIZE_AVAILABLE  HAL_STORAGE_SIZE
 
 #elif CONFIG_HAL_BOARD == HAL_BOARD_FLYMAPLE
@@ -92,7 +95,10 @@
 #define HAL_BOARD_NAME "Linux"
 #define HAL_CPU_CLASS HAL_CPU_CLASS_1000
 #define HAL_OS_POSIX_IO 1
+// storage is a file, so the size can be raised at build time
+#ifndef HAL_STORAGE_SIZE
 #define HAL_STORAGE_SIZE            4096
+#endif
 #define HAL_STORAGE_SIZE_AVAILABLE  HAL_STORAGE_SIZE
 
 #elif CONFIG_HAL_BOARD == HAL_BOARD_EMPTY
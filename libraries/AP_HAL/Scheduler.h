@@ -9,11 +9,26 @@
 
 class AP_HAL::Scheduler {
 public:
-    Scheduler() {}
+    Scheduler() : _micros64_last(0), _micros64_high(0) {}
     virtual void     init(void* implspecific) = 0;
     virtual void     delay(uint16_t ms) = 0;
     virtual uint32_t millis() = 0;
     virtual uint32_t micros() = 0;
+
+    /**
+       microseconds since boot as a 64 bit value, which does not wrap
+       after 71 minutes like micros(). Boards with a 64 bit clock
+       should override this. The default extends micros(), so needs
+       to be called at least once per wrap and only from one thread
+     */
+    virtual uint64_t micros64() {
+        uint32_t now = micros();
+        if (now < _micros64_last) {
+            _micros64_high++;
+        }
+        _micros64_last = now;
+        return ((uint64_t)_micros64_high << 32) | now;
+    }
     virtual void     delay_microseconds(uint16_t us) = 0;
     virtual void     register_delay_callback(AP_HAL::Proc,
                                              uint16_t min_time_ms) = 0;
@@ -48,6 +63,29 @@ public:
        optional function to stop clock at a given time, used by log replay
      */
     virtual void     stop_clock(uint64_t time_usec) {}
+
+    /**
+       wakeup latency statistics for a periodic HAL thread, on boards
+       that measure them
+     */
+    struct thread_latency {
+        uint32_t count;
+        uint32_t min_usec;
+        uint32_t avg_usec;
+        uint32_t max_usec;
+        uint32_t p99_usec;
+        uint32_t overruns;
+    };
+
+    /**
+       optional function to get the latency statistics of HAL thread
+       number thread. Returns false if there is no such thread
+     */
+    virtual bool     get_thread_latency(uint8_t, struct thread_latency &) { return false; }
+
+private:
+    uint32_t _micros64_last;
+    uint32_t _micros64_high;
 };
 
 #endif // __AP_HAL_SCHEDULER_H__
@@ -0,0 +1,112 @@
+/// -*- tab-width: 4; Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+//
+// Benchmark of the cost of the HAL clock functions
+//
+// On Linux and SITL this also times the floating point timespec
+// conversion that micros() used before micros64() was added, for
+// comparison
+//
+
+#include <AP_HAL.h>
+#include <AP_HAL_AVR.h>
+#include <AP_HAL_AVR_SITL.h>
+#include <AP_HAL_PX4.h>
+#include <AP_HAL_Empty.h>
+#include <AP_Common.h>
+#include <AP_Baro.h>
+#include <AP_ADC.h>
+#include <AP_GPS.h>
+#include <AP_InertialSensor.h>
+#include <AP_Notify.h>
+#include <DataFlash.h>
+#include <GCS_MAVLink.h>
+#include <AP_Mission.h>
+#include <AP_Compass.h>
+#include <AP_Declination.h>
+#include <SITL.h>
+#include <Filter.h>
+#include <AP_Param.h>
+#include <AP_Progmem.h>
+#include <AP_Math.h>
+#include <AP_AHRS.h>
+#include <AP_Buffer.h>
+#include <AP_Airspeed.h>
+#include <AP_Vehicle.h>
+#include <AP_ADC_AnalogSource.h>
+
+const AP_HAL::HAL& hal = AP_HAL_BOARD_DRIVER;
+
+#if HAL_CPU_CLASS >= HAL_CPU_CLASS_75
+#define NUM_CALLS 1000000UL
+#else
+#define NUM_CALLS 10000UL
+#endif
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+#include <time.h>
+
+static struct timespec start_time;
+
+// the old floating point micros() implementation
+static uint32_t micros_double(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1.0e6*((ts.tv_sec + (ts.tv_nsec*1.0e-9)) - 
+                  (start_time.tv_sec +
+                   (start_time.tv_nsec*1.0e-9)));
+}
+#endif
+
+static volatile uint64_t sink;
+
+static void report(const char *name, uint64_t start_us)
+{
+    uint64_t elapsed = hal.scheduler->micros64() - start_us;
+    hal.console->printf("%-14s %8.1f ns/call\n", name,
+                        (elapsed * 1000.0f) / NUM_CALLS);
+}
+
+void setup(void)
+{
+    hal.console->println_P(PSTR("Clock benchmark"));
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+#endif
+}
+
+void loop(void)
+{
+    uint64_t start;
+
+    start = hal.scheduler->micros64();
+    for (uint32_t i=0; i<NUM_CALLS; i++) {
+        sink = hal.scheduler->micros();
+    }
+    report("micros()", start);
+
+    start = hal.scheduler->micros64();
+    for (uint32_t i=0; i<NUM_CALLS; i++) {
+        sink = hal.scheduler->millis();
+    }
+    report("millis()", start);
+
+    start = hal.scheduler->micros64();
+    for (uint32_t i=0; i<NUM_CALLS; i++) {
+        sink = hal.scheduler->micros64();
+    }
+    report("micros64()", start);
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+    start = hal.scheduler->micros64();
+    for (uint32_t i=0; i<NUM_CALLS; i++) {
+        sink = micros_double();
+    }
+    report("old micros()", start);
+#endif
+
+    hal.console->printf("uptime %lu ms\n\n", (unsigned long)(hal.scheduler->micros64() / 1000));
+    hal.scheduler->delay(1000);
+}
+
+AP_HAL_MAIN();
@@ -20,6 +20,7 @@
 #include <AP_Progmem.h>
 #include <AP_Math.h>
 #include <AP_AHRS.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_ADC_AnalogSource.h>
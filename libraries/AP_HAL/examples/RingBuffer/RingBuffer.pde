@@ -0,0 +1,167 @@
+/// -*- tab-width: 4; Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+//
+// Throughput and latency benchmark for the AP_HAL RingBuffer
+//
+// A producer thread writes fixed size timestamped records into a
+// ByteBuffer while the main thread consumes them, checking the
+// sequence numbers. Reports bytes/sec and the distribution of the
+// time between a record being committed and it being read.
+//
+
+#include <AP_HAL.h>
+#include <AP_HAL_AVR.h>
+#include <AP_HAL_AVR_SITL.h>
+#include <AP_HAL_PX4.h>
+#include <AP_HAL_Empty.h>
+#include <AP_Common.h>
+#include <AP_Baro.h>
+#include <AP_ADC.h>
+#include <AP_GPS.h>
+#include <AP_InertialSensor.h>
+#include <AP_Notify.h>
+#include <DataFlash.h>
+#include <GCS_MAVLink.h>
+#include <AP_Mission.h>
+#include <AP_Compass.h>
+#include <AP_Declination.h>
+#include <SITL.h>
+#include <Filter.h>
+#include <AP_Param.h>
+#include <AP_Progmem.h>
+#include <AP_Math.h>
+#include <AP_AHRS.h>
+#include <AP_Buffer.h>
+#include <AP_Airspeed.h>
+#include <AP_Vehicle.h>
+#include <AP_ADC_AnalogSource.h>
+
+const AP_HAL::HAL& hal = AP_HAL_BOARD_DRIVER;
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+#include <utility/RingBuffer.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+// bytes per record, and number of records per run
+#define RECORD_SIZE     64
+#define NUM_RECORDS     2000000UL
+#define BUFFER_SIZE     16384
+
+// latency histogram in 1us buckets, plus an overflow bucket
+#define LATENCY_BUCKETS 1000
+
+struct record {
+    uint32_t seq;
+    uint64_t time_ns;
+    uint8_t payload[RECORD_SIZE - 12];
+} __attribute__((packed));
+
+static ByteBuffer ring;
+static uint32_t latency_hist[LATENCY_BUCKETS+1];
+
+static uint64_t time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+static void *producer(void *arg)
+{
+    struct record r;
+    memset(&r, 0, sizeof(r));
+    for (uint32_t i=0; i<NUM_RECORDS; i++) {
+        r.seq = i;
+        while (ring.space() < sizeof(r)) {
+            // let the consumer run if we share a CPU
+            sched_yield();
+        }
+        r.time_ns = time_ns();
+        ring.write((const uint8_t *)&r, sizeof(r));
+    }
+    return NULL;
+}
+
+static uint32_t percentile(uint32_t count, float pct)
+{
+    uint32_t target = count * pct;
+    uint32_t sum = 0;
+    for (uint16_t i=0; i<=LATENCY_BUCKETS; i++) {
+        sum += latency_hist[i];
+        if (sum > target) {
+            return i;
+        }
+    }
+    return LATENCY_BUCKETS;
+}
+
+static void run_benchmark(void)
+{
+    pthread_t ctx;
+
+    ring.set_size(BUFFER_SIZE);
+    memset(latency_hist, 0, sizeof(latency_hist));
+
+    uint64_t start_ns = time_ns();
+    pthread_create(&ctx, NULL, producer, NULL);
+
+    uint32_t expected = 0;
+    uint32_t errors = 0;
+    uint64_t max_latency = 0;
+    struct record r;
+    while (expected < NUM_RECORDS) {
+        if (ring.available() < sizeof(r)) {
+            sched_yield();
+            continue;
+        }
+        ring.read((uint8_t *)&r, sizeof(r));
+        uint64_t latency = time_ns() - r.time_ns;
+        if (r.seq != expected) {
+            errors++;
+        }
+        expected = r.seq + 1;
+        if (latency > max_latency) {
+            max_latency = latency;
+        }
+        uint32_t bucket = latency / 1000;
+        if (bucket > LATENCY_BUCKETS) {
+            bucket = LATENCY_BUCKETS;
+        }
+        latency_hist[bucket]++;
+    }
+    uint64_t elapsed_ns = time_ns() - start_ns;
+    pthread_join(ctx, NULL);
+
+    float mbytes_per_sec = (NUM_RECORDS * (float)RECORD_SIZE) / (elapsed_ns * 1.0e-9f) / 1.0e6f;
+    hal.console->printf("%lu records of %u bytes in %.3f s: %.1f MB/s, %u sequence errors\n",
+                        (unsigned long)NUM_RECORDS,
+                        (unsigned)RECORD_SIZE,
+                        elapsed_ns * 1.0e-9f,
+                        mbytes_per_sec,
+                        (unsigned)errors);
+    hal.console->printf("latency p50 %uus p99 %uus p99.9 %uus max %uus\n",
+                        (unsigned)percentile(NUM_RECORDS, 0.5f),
+                        (unsigned)percentile(NUM_RECORDS, 0.99f),
+                        (unsigned)percentile(NUM_RECORDS, 0.999f),
+                        (unsigned)(max_latency / 1000));
+}
+#else
+static void run_benchmark(void)
+{
+    hal.console->println_P(PSTR("RingBuffer benchmark needs threads"));
+}
+#endif
+
+void setup(void)
+{
+    hal.console->println_P(PSTR("RingBuffer benchmark"));
+}
+
+void loop(void)
+{
+    run_benchmark();
+    hal.scheduler->delay(1000);
+}
+
+AP_HAL_MAIN();
@@ -0,0 +1,476 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AP_HAL.h>
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+
+#include "MMapStorage.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern const AP_HAL::HAL& hal;
+
+#define MMAP_STORAGE_MAGIC 0x41505354 // 'APST'
+
+/*
+  standard CRC32, table driven as we checksum a whole slot on each
+  commit
+ */
+static uint32_t crc32_table[256];
+
+static uint32_t crc32(const uint8_t *buf, uint32_t len)
+{
+    if (crc32_table[1] == 0) {
+        for (uint32_t i=0; i<256; i++) {
+            uint32_t c = i;
+            for (uint8_t k=0; k<8; k++) {
+                c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+            }
+            crc32_table[i] = c;
+        }
+    }
+    uint32_t crc = 0xFFFFFFFFUL;
+    while (len--) {
+        crc = crc32_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+MMapStorage::MMapStorage(const char *path) :
+    _path(path),
+    _initialised(false),
+    _map(NULL),
+    _slot_size(0),
+    _active_slot(0),
+    _seq(0),
+    _first_write_ms(0),
+    _last_write_ms(0)
+{
+    pthread_mutex_init(&_lock, NULL);
+    memset(_buffer, 0, sizeof(_buffer));
+    memset(_dirty, 0, sizeof(_dirty));
+}
+
+struct MMapStorage::slot_header *MMapStorage::_header(uint8_t slot) const
+{
+    return (struct slot_header *)&_map[slot * _slot_size];
+}
+
+/*
+  slot data starts on the page after the header, so a header update
+  never shares a page with the data it describes
+ */
+uint8_t *MMapStorage::_data(uint8_t slot) const
+{
+    return &_map[slot * _slot_size + sysconf(_SC_PAGESIZE)];
+}
+
+bool MMapStorage::_slot_valid(uint8_t slot, uint32_t &seq) const
+{
+    const struct slot_header *h = _header(slot);
+    if (h->magic != MMAP_STORAGE_MAGIC || h->size != HAL_STORAGE_SIZE) {
+        return false;
+    }
+    if (crc32(_data(slot), HAL_STORAGE_SIZE) != h->crc) {
+        return false;
+    }
+    seq = h->seq;
+    return true;
+}
+
+/*
+  import storage from a file that isn't in our current layout. This
+  is either a plain image as written by older firmware, or a slot
+  file written with a different HAL_STORAGE_SIZE. Anything that
+  doesn't fit is dropped
+ */
+bool MMapStorage::_import_legacy(int fd, off_t size)
+{
+    struct slot_header h;
+    if (pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+        h.magic == MMAP_STORAGE_MAGIC) {
+        long pagesize = sysconf(_SC_PAGESIZE);
+        off_t old_slot_size = pagesize + ((h.size + pagesize - 1) / pagesize) * pagesize;
+        uint8_t *data = (uint8_t *)malloc(h.size);
+        if (data == NULL) {
+            return false;
+        }
+        uint32_t best_seq = 0;
+        bool found = false;
+        for (uint8_t slot=0; slot<2; slot++) {
+            struct slot_header sh;
+            off_t ofs = slot * old_slot_size;
+            if (pread(fd, &sh, sizeof(sh), ofs) != (ssize_t)sizeof(sh) ||
+                sh.magic != MMAP_STORAGE_MAGIC || sh.size != h.size ||
+                pread(fd, data, sh.size, ofs + pagesize) != (ssize_t)sh.size ||
+                crc32(data, sh.size) != sh.crc) {
+                continue;
+            }
+            if (!found || (int32_t)(sh.seq - best_seq) > 0) {
+                memcpy(_buffer, data, sh.size < HAL_STORAGE_SIZE ? sh.size : HAL_STORAGE_SIZE);
+                best_seq = sh.seq;
+                found = true;
+            }
+        }
+        free(data);
+        return found;
+    }
+
+    if (size > HAL_STORAGE_SIZE) {
+        size = HAL_STORAGE_SIZE;
+    }
+    return pread(fd, _buffer, size, 0) == size;
+}
+
+/*
+  open and map the storage file, creating or converting it if needed
+ */
+bool MMapStorage::_map_file(void)
+{
+    // create the directory if need be
+    char *dir = strdup(_path);
+    char *slash = dir ? strrchr(dir, '/') : NULL;
+    if (slash != NULL && slash != dir) {
+        *slash = 0;
+        mkdir(dir, 0777);
+    }
+    free(dir);
+
+    int fd = open(_path, O_RDWR|O_CREAT, 0666);
+    if (fd == -1) {
+        return false;
+    }
+
+    long pagesize = sysconf(_SC_PAGESIZE);
+    _slot_size = pagesize + ((HAL_STORAGE_SIZE + pagesize - 1) / pagesize) * pagesize;
+    off_t file_size = 2 * _slot_size;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size != 0 && st.st_size != file_size) {
+        // the old file is left untouched until the converted one is
+        // safely on disk
+        _import_legacy(fd, st.st_size);
+        close(fd);
+        return _replace_file(file_size);
+    }
+
+    // a new, empty file has nothing to lose by being extended in place
+    if (st.st_size == 0 && ftruncate(fd, file_size) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void *p = mmap(NULL, file_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    _map = (uint8_t *)p;
+
+    uint32_t seq0, seq1;
+    bool valid0 = _slot_valid(0, seq0);
+    bool valid1 = _slot_valid(1, seq1);
+    if (valid0 && (!valid1 || (int32_t)(seq0 - seq1) > 0)) {
+        _active_slot = 0;
+        _seq = seq0;
+    } else if (valid1) {
+        _active_slot = 1;
+        _seq = seq1;
+    } else {
+        // a new file. Both slots get written on the first commits
+        for (uint8_t i=0; i<MMAP_STORAGE_MASK_WORDS; i++) {
+            _dirty[0][i] = _dirty[1][i] = 0xFFFFFFFF;
+        }
+        _active_slot = 1;
+        return true;
+    }
+    memcpy(_buffer, _data(_active_slot), HAL_STORAGE_SIZE);
+
+    // the other slot is out of date wherever it differs
+    uint8_t other = 1 - _active_slot;
+    for (uint16_t line=0; line<MMAP_STORAGE_NUM_LINES; line++) {
+        uint32_t ofs = line << MMAP_STORAGE_LINE_SHIFT;
+        if (memcmp(_data(other) + ofs, _buffer + ofs, MMAP_STORAGE_LINE_SIZE) != 0) {
+            _dirty[other][line/32] |= 1U << (line%32);
+        }
+    }
+    return true;
+}
+
+/*
+  write the working buffer to both slots of a new file in our layout,
+  then rename it over the storage file. A power loss at any point
+  leaves either the old file or the complete new one
+ */
+bool MMapStorage::_replace_file(off_t file_size)
+{
+    char tmp_path[strlen(_path)+5];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+
+    int fd = open(tmp_path, O_RDWR|O_CREAT|O_TRUNC, 0666);
+    if (fd == -1) {
+        return false;
+    }
+    if (ftruncate(fd, file_size) != 0) {
+        close(fd);
+        unlink(tmp_path);
+        return false;
+    }
+    void *p = mmap(NULL, file_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        unlink(tmp_path);
+        return false;
+    }
+    _map = (uint8_t *)p;
+
+    for (uint8_t i=0; i<MMAP_STORAGE_MASK_WORDS; i++) {
+        _dirty[0][i] = _dirty[1][i] = 0xFFFFFFFF;
+    }
+    _active_slot = 1;
+    pthread_mutex_lock(&_lock);
+    _commit();
+    pthread_mutex_lock(&_lock);
+    _commit();
+
+    if (fsync(fd) != 0 || rename(tmp_path, _path) != 0) {
+        munmap(_map, file_size);
+        _map = NULL;
+        close(fd);
+        unlink(tmp_path);
+        return false;
+    }
+    close(fd);
+
+    // make the rename itself durable
+    char *dir = strdup(_path);
+    char *slash = dir ? strrchr(dir, '/') : NULL;
+    if (slash != NULL) {
+        if (slash == dir) {
+            slash++;
+        }
+        *slash = 0;
+    }
+    int dir_fd = open(slash != NULL ? dir : ".", O_RDONLY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    free(dir);
+    return true;
+}
+
+void MMapStorage::_storage_open(void)
+{
+    if (_initialised) {
+        return;
+    }
+    if (!_map_file()) {
+        hal.scheduler->panic("Failed to open storage file");
+    }
+    _initialised = true;
+}
+
+/*
+  mark some lines as needing to be written to both slots. Called with
+  _lock held
+ */
+void MMapStorage::_mark_dirty(uint16_t loc, uint16_t length)
+{
+    uint16_t first = loc >> MMAP_STORAGE_LINE_SHIFT;
+    uint16_t last = (loc + length - 1) >> MMAP_STORAGE_LINE_SHIFT;
+    for (uint16_t line=first; line<=last; line++) {
+        _dirty[0][line/32] |= 1U << (line%32);
+        _dirty[1][line/32] |= 1U << (line%32);
+    }
+    uint32_t now = hal.scheduler->millis();
+    if (_first_write_ms == 0) {
+        _first_write_ms = now ? now : 1;
+    }
+    _last_write_ms = now;
+}
+
+bool MMapStorage::_check_range(uint16_t loc, size_t n) const
+{
+    return n != 0 && loc + n <= HAL_STORAGE_SIZE;
+}
+
+uint8_t MMapStorage::read_byte(uint16_t loc)
+{
+    uint8_t value = 0;
+    read_block(&value, loc, sizeof(value));
+    return value;
+}
+
+uint16_t MMapStorage::read_word(uint16_t loc)
+{
+    uint16_t value = 0;
+    read_block(&value, loc, sizeof(value));
+    return value;
+}
+
+uint32_t MMapStorage::read_dword(uint16_t loc)
+{
+    uint32_t value = 0;
+    read_block(&value, loc, sizeof(value));
+    return value;
+}
+
+void MMapStorage::read_block(void *dst, uint16_t loc, size_t n)
+{
+    if (!_check_range(loc, n)) {
+        return;
+    }
+    _storage_open();
+    memcpy(dst, &_buffer[loc], n);
+}
+
+void MMapStorage::_write(uint16_t loc, const void *src, size_t n)
+{
+    if (!_check_range(loc, n)) {
+        return;
+    }
+    _storage_open();
+    if (memcmp(src, &_buffer[loc], n) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&_lock);
+    memcpy(&_buffer[loc], src, n);
+    _mark_dirty(loc, n);
+    pthread_mutex_unlock(&_lock);
+}
+
+void MMapStorage::write_byte(uint16_t loc, uint8_t value)
+{
+    _write(loc, &value, sizeof(value));
+}
+
+void MMapStorage::write_word(uint16_t loc, uint16_t value)
+{
+    _write(loc, &value, sizeof(value));
+}
+
+void MMapStorage::write_dword(uint16_t loc, uint32_t value)
+{
+    _write(loc, &value, sizeof(value));
+}
+
+void MMapStorage::write_block(uint16_t loc, const void *src, size_t n)
+{
+    _write(loc, src, n);
+}
+
+/*
+  commit the working buffer to the older slot. Only the lines that
+  have changed since that slot was last written are copied and
+  synced. The header is written last, so the slot only becomes valid
+  once its data is on disk.
+
+  Must be called with _lock held. The lock is released once the
+  changes have been copied, so writers are not held up by msync()
+ */
+void MMapStorage::_commit(void)
+{
+    uint8_t slot = 1 - _active_slot;
+    uint32_t mask[MMAP_STORAGE_MASK_WORDS];
+
+    memcpy(mask, _dirty[slot], sizeof(mask));
+    memset(_dirty[slot], 0, sizeof(_dirty[slot]));
+    for (uint16_t line=0; line<MMAP_STORAGE_NUM_LINES; line++) {
+        if (mask[line/32] & (1U << (line%32))) {
+            uint32_t ofs = line << MMAP_STORAGE_LINE_SHIFT;
+            memcpy(_data(slot) + ofs, _buffer + ofs, MMAP_STORAGE_LINE_SIZE);
+        }
+    }
+    _first_write_ms = 0;
+    pthread_mutex_unlock(&_lock);
+
+    // the slot is no longer valid until the new header is written
+    struct slot_header *h = _header(slot);
+    h->magic = 0;
+
+    // sync each run of dirty lines, rounded out to whole pages
+    long pagesize = sysconf(_SC_PAGESIZE);
+    uint16_t line = 0;
+    while (line < MMAP_STORAGE_NUM_LINES) {
+        if (!(mask[line/32] & (1U << (line%32)))) {
+            line++;
+            continue;
+        }
+        uint16_t end = line;
+        while (end < MMAP_STORAGE_NUM_LINES && (mask[end/32] & (1U << (end%32)))) {
+            end++;
+        }
+        uintptr_t start = (uintptr_t)(_data(slot) + (line << MMAP_STORAGE_LINE_SHIFT));
+        uintptr_t stop = (uintptr_t)(_data(slot) + (end << MMAP_STORAGE_LINE_SHIFT));
+        start &= ~(uintptr_t)(pagesize-1);
+        msync((void *)start, stop - start, MS_SYNC);
+        line = end;
+    }
+
+    h->size = HAL_STORAGE_SIZE;
+    h->seq = _seq + 1;
+    h->crc = crc32(_data(slot), HAL_STORAGE_SIZE);
+    h->magic = MMAP_STORAGE_MAGIC;
+    msync(h, pagesize, MS_SYNC);
+
+    _seq++;
+    _active_slot = slot;
+}
+
+/*
+  commit any changes once writes have stopped for a while. A burst of
+  writes, such as a parameter save, becomes a single commit. We never
+  wait on the lock, as on SITL this is called from a signal handler
+  that may have interrupted a writer
+ */
+void MMapStorage::_timer_tick(void)
+{
+    if (!_initialised || _map == NULL) {
+        return;
+    }
+    if (pthread_mutex_trylock(&_lock) != 0) {
+        return;
+    }
+    bool pending = false;
+    for (uint8_t i=0; i<MMAP_STORAGE_MASK_WORDS; i++) {
+        if (_dirty[_active_slot][i] != 0) {
+            pending = true;
+            break;
+        }
+    }
+    uint32_t now = hal.scheduler->millis();
+    if (pending &&
+        (now - _last_write_ms >= MMAP_STORAGE_COMMIT_DELAY_MS ||
+         now - _first_write_ms >= MMAP_STORAGE_COMMIT_MAX_MS)) {
+        _commit();
+    } else {
+        pthread_mutex_unlock(&_lock);
+    }
+}
+
+#endif // CONFIG_HAL_BOARD
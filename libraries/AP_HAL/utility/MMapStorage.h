@@ -0,0 +1,119 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __AP_HAL_UTILITY_MMAPSTORAGE_H__
+#define __AP_HAL_UTILITY_MMAPSTORAGE_H__
+
+#include <AP_HAL.h>
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+#include <pthread.h>
+#include <sys/types.h>
+
+#if HAL_STORAGE_SIZE > 65536 || (HAL_STORAGE_SIZE % 512) != 0
+#error "HAL_STORAGE_SIZE must be a multiple of 512 and at most 65536"
+#endif
+
+// storage is tracked for changes in lines of this size
+#define MMAP_STORAGE_LINE_SHIFT 9
+#define MMAP_STORAGE_LINE_SIZE (1<<MMAP_STORAGE_LINE_SHIFT)
+#define MMAP_STORAGE_NUM_LINES (HAL_STORAGE_SIZE/MMAP_STORAGE_LINE_SIZE)
+#define MMAP_STORAGE_MASK_WORDS ((MMAP_STORAGE_NUM_LINES+31)/32)
+
+// changes are batched until writes stop for this long, but are
+// committed at least this often while writes continue
+#define MMAP_STORAGE_COMMIT_DELAY_MS 100
+#define MMAP_STORAGE_COMMIT_MAX_MS   1000
+
+/*
+  crash consistent 'eeprom' storage in a memory mapped file, for
+  boards with a POSIX filesystem
+
+  The file holds two copies (slots) of the storage, each with a header
+  containing a sequence number and CRC. Reads and writes go to an
+  in-memory buffer. Changes are committed in batches from the IO
+  thread by copying the dirty lines into the older slot, msync()ing
+  them, then writing and msync()ing that slot's header. A power loss
+  at any point leaves at least one slot with a valid CRC, and the
+  newest valid slot is loaded on startup.
+
+  A plain image of HAL_STORAGE_SIZE bytes or less, as written by
+  older firmware, is imported on first use. The converted file is
+  built alongside the old one and renamed over it.
+ */
+class MMapStorage : public AP_HAL::Storage {
+public:
+    MMapStorage(const char *path);
+
+    void init(void *) {}
+    uint8_t  read_byte(uint16_t loc);
+    uint16_t read_word(uint16_t loc);
+    uint32_t read_dword(uint16_t loc);
+    void     read_block(void *dst, uint16_t src, size_t n);
+
+    void write_byte(uint16_t loc, uint8_t value);
+    void write_word(uint16_t loc, uint16_t value);
+    void write_dword(uint16_t loc, uint32_t value);
+    void write_block(uint16_t dst, const void* src, size_t n);
+
+    // commit pending changes. Called regularly from the IO thread,
+    // and never blocks on the main thread
+    void _timer_tick(void);
+
+private:
+    struct slot_header {
+        uint32_t magic;
+        uint32_t size;
+        uint32_t seq;
+        uint32_t crc;
+    };
+
+    const char *_path;
+    volatile bool _initialised;
+    pthread_mutex_t _lock;
+
+    // the working copy that reads and writes go to
+    uint8_t _buffer[HAL_STORAGE_SIZE];
+
+    // the mapped file, and the size of each slot in it
+    uint8_t *_map;
+    uint32_t _slot_size;
+
+    // slot holding the last commit, and its sequence number
+    uint8_t _active_slot;
+    uint32_t _seq;
+
+    // lines that differ between _buffer and each slot
+    uint32_t _dirty[2][MMAP_STORAGE_MASK_WORDS];
+
+    // when the first uncommitted and latest writes happened
+    uint32_t _first_write_ms;
+    uint32_t _last_write_ms;
+
+    void _storage_open(void);
+    bool _map_file(void);
+    bool _import_legacy(int fd, off_t size);
+    bool _replace_file(off_t file_size);
+    void _commit(void);
+    bool _slot_valid(uint8_t slot, uint32_t &seq) const;
+    struct slot_header *_header(uint8_t slot) const;
+    uint8_t *_data(uint8_t slot) const;
+    void _mark_dirty(uint16_t loc, uint16_t length);
+    bool _check_range(uint16_t loc, size_t n) const;
+    void _write(uint16_t loc, const void *src, size_t n);
+};
+
+#endif // CONFIG_HAL_BOARD
+#endif // __AP_HAL_UTILITY_MMAPSTORAGE_H__
@@ -0,0 +1,291 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __AP_HAL_UTILITY_RINGBUFFER_H__
+#define __AP_HAL_UTILITY_RINGBUFFER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// size of a cache line. The producer and consumer indexes are kept on
+// separate lines so the two threads don't fight over ownership
+#define RINGBUFFER_CACHE_LINE 64
+
+/*
+  a lock-free single producer, single consumer ring buffer
+
+  One thread (the producer) may call space(), write(), push(),
+  reserve() and commit(). One other thread (the consumer) may call
+  available(), read(), pop(), peek() and advance(). The producer
+  publishes data with a release store of the tail index and the
+  consumer frees space with a release store of the head index, so
+  data written before commit() is visible to the consumer once
+  available() reports it.
+
+  The indexes run freely and are masked on access, so the size is
+  rounded up to a power of two and the whole buffer can be used.
+
+  set_size() and clear() are not thread safe, and must only be called
+  when neither side is accessing the buffer.
+ */
+template <typename T>
+class RingBuffer {
+public:
+    RingBuffer() :
+        _buf(NULL),
+        _size(0),
+        _mask(0),
+        _head(0),
+        _cached_tail(0),
+        _tail(0),
+        _cached_head(0)
+    {}
+
+    ~RingBuffer() {
+        free(_buf);
+    }
+
+    /*
+      allocate the buffer with room for at least size elements. If
+      the rounded size is unchanged the contents are kept, otherwise
+      they are discarded. Returns false if allocation fails, leaving
+      the buffer empty with zero size
+     */
+    bool set_size(uint32_t size) {
+        uint32_t sz = 0;
+        if (size != 0) {
+            sz = 1;
+            while (sz < size) {
+                sz <<= 1;
+            }
+        }
+        if (sz == _size && (_buf != NULL || sz == 0)) {
+            return true;
+        }
+        free(_buf);
+        _buf = NULL;
+        _size = _mask = 0;
+        clear();
+        if (sz == 0) {
+            return true;
+        }
+        _buf = (T *)malloc(sz * sizeof(T));
+        if (_buf == NULL) {
+            return false;
+        }
+        _size = sz;
+        _mask = sz - 1;
+        return true;
+    }
+
+    // number of elements the buffer can hold
+    uint32_t get_size(void) const { return _size; }
+
+    // discard all contents
+    void clear(void) {
+        _head = _tail = 0;
+        _cached_head = _cached_tail = 0;
+    }
+
+    /*
+      consumer side
+     */
+
+    // number of elements available to read
+    uint32_t available(void) const {
+        return load_acquire(&_tail) - _head;
+    }
+
+    bool empty(void) const {
+        return available() == 0;
+    }
+
+    /*
+      get a pointer to the contiguous run of readable elements
+      starting at the head. n is set to the length of the run, which
+      may be less than available() if the data wraps
+     */
+    const T *peek(uint32_t &n) {
+        _cached_tail = load_acquire(&_tail);
+        n = _cached_tail - _head;
+        if (n == 0) {
+            return NULL;
+        }
+        uint32_t ofs = _head & _mask;
+        if (n > _size - ofs) {
+            n = _size - ofs;
+        }
+        return &_buf[ofs];
+    }
+
+    /*
+      get all readable elements as up to two contiguous runs, for
+      scatter/gather IO. The second run is only non-empty if the data
+      wraps. Returns the total number of elements
+     */
+    uint32_t peek(const T *&p1, uint32_t &n1, const T *&p2, uint32_t &n2) {
+        p1 = peek(n1);
+        n2 = (_cached_tail - _head) - n1;
+        p2 = n2 ? &_buf[0] : NULL;
+        return n1 + n2;
+    }
+
+    // release n elements that have been consumed
+    void advance(uint32_t n) {
+        store_release(&_head, _head + n);
+    }
+
+    // read up to n elements, returning the number read
+    uint32_t read(T *data, uint32_t n) {
+        uint32_t ret = 0;
+        while (ret < n) {
+            uint32_t len;
+            const T *p = peek(len);
+            if (p == NULL) {
+                break;
+            }
+            if (len > n - ret) {
+                len = n - ret;
+            }
+            memcpy(&data[ret], p, len * sizeof(T));
+            advance(len);
+            ret += len;
+        }
+        return ret;
+    }
+
+    // read one element. Returns false if empty
+    bool pop(T &v) {
+        if (_cached_tail == _head) {
+            _cached_tail = load_acquire(&_tail);
+            if (_cached_tail == _head) {
+                return false;
+            }
+        }
+        v = _buf[_head & _mask];
+        store_release(&_head, _head + 1);
+        return true;
+    }
+
+    /*
+      producer side
+     */
+
+    // number of elements that can be written
+    uint32_t space(void) const {
+        return _size - (_tail - load_acquire(&_head));
+    }
+
+    /*
+      get a pointer to the contiguous free space starting at the
+      tail. n is set to the length of the span, which may be less than
+      space() if the free space wraps. Nothing is visible to the
+      consumer until commit() is called
+     */
+    T *reserve(uint32_t &n) {
+        _cached_head = load_acquire(&_head);
+        n = _size - (_tail - _cached_head);
+        if (n == 0) {
+            return NULL;
+        }
+        uint32_t ofs = _tail & _mask;
+        if (n > _size - ofs) {
+            n = _size - ofs;
+        }
+        return &_buf[ofs];
+    }
+
+    // publish n elements written into a reserve()d span
+    void commit(uint32_t n) {
+        store_release(&_tail, _tail + n);
+    }
+
+    // write up to n elements, returning the number written
+    uint32_t write(const T *data, uint32_t n) {
+        uint32_t ret = 0;
+        while (ret < n) {
+            uint32_t len;
+            T *p = reserve(len);
+            if (p == NULL) {
+                break;
+            }
+            if (len > n - ret) {
+                len = n - ret;
+            }
+            memcpy(p, &data[ret], len * sizeof(T));
+            ret += len;
+            // publish each piece so the consumer sees a consistent
+            // tail even if we wrap
+            commit(len);
+        }
+        return ret;
+    }
+
+    // write one element. Returns false if full
+    bool push(const T &v) {
+        if (_tail - _cached_head == _size) {
+            _cached_head = load_acquire(&_head);
+            if (_tail - _cached_head == _size) {
+                return false;
+            }
+        }
+        _buf[_tail & _mask] = v;
+        store_release(&_tail, _tail + 1);
+        return true;
+    }
+
+private:
+#ifdef __ATOMIC_ACQUIRE
+    static uint32_t load_acquire(const volatile uint32_t *p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+    static void store_release(volatile uint32_t *p, uint32_t v) {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+#else
+    // older compilers without the __atomic builtins get full barriers
+    static uint32_t load_acquire(const volatile uint32_t *p) {
+        uint32_t v = *p;
+        __sync_synchronize();
+        return v;
+    }
+    static void store_release(volatile uint32_t *p, uint32_t v) {
+        __sync_synchronize();
+        *p = v;
+    }
+#endif
+
+    // shared, read-only after set_size()
+    T *_buf;
+    uint32_t _size;
+    uint32_t _mask;
+    uint8_t _pad0[RINGBUFFER_CACHE_LINE - sizeof(T *) - 2*sizeof(uint32_t)];
+
+    // written by the consumer
+    volatile uint32_t _head;
+    uint32_t _cached_tail;
+    uint8_t _pad1[RINGBUFFER_CACHE_LINE - 2*sizeof(uint32_t)];
+
+    // written by the producer
+    volatile uint32_t _tail;
+    uint32_t _cached_head;
+    uint8_t _pad2[RINGBUFFER_CACHE_LINE - 2*sizeof(uint32_t)];
+};
+
+// the common case of a byte stream
+typedef RingBuffer<uint8_t> ByteBuffer;
+
+#endif // __AP_HAL_UTILITY_RINGBUFFER_H__
@@ -0,0 +1,110 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __AP_HAL_UTILITY_SEQLOCK_H__
+#define __AP_HAL_UTILITY_SEQLOCK_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+  a sequence lock protecting a value with one writer thread and any
+  number of reader threads. Neither side ever blocks.
+
+  The writer makes the sequence number odd while it copies in a new
+  value and even again when it is done. A reader copies the value
+  out and checks that the sequence number was even and unchanged
+  across the copy. If the writer got in the way the reader retries,
+  and after a few failed attempts gives up, so a reader can't be held
+  up by a writer that was preempted part way through a write.
+
+  T must be safe to copy with memcpy()
+ */
+template <typename T>
+class Seqlock {
+public:
+    Seqlock() :
+        _seq(0)
+    {
+        memset((void *)&_value, 0, sizeof(_value));
+    }
+
+    // publish a new value. Must only be called from one thread
+    void write(const T &v) {
+        uint32_t seq = _seq;
+        store_release(&_seq, seq + 1);
+        // keep the value stores after the odd sequence number
+        __sync_synchronize();
+        memcpy((void *)&_value, &v, sizeof(T));
+        store_release(&_seq, seq + 2);
+    }
+
+    /*
+      get a consistent copy of the latest value. Returns false,
+      leaving v unchanged, if no consistent copy was obtained within
+      max_tries attempts or nothing has been written yet
+     */
+    bool read(T &v, uint8_t max_tries = 4) const {
+        T tmp;
+        for (uint8_t i=0; i<max_tries; i++) {
+            uint32_t seq1 = load_acquire(&_seq);
+            if (seq1 == 0) {
+                return false;
+            }
+            if (seq1 & 1) {
+                continue;
+            }
+            memcpy(&tmp, (const void *)&_value, sizeof(T));
+            // keep the value loads before the second sequence number load
+            __sync_synchronize();
+            if (load_acquire(&_seq) == seq1) {
+                v = tmp;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // number of values written so far
+    uint32_t count(void) const {
+        return load_acquire(&_seq) / 2;
+    }
+
+private:
+#ifdef __ATOMIC_ACQUIRE
+    static uint32_t load_acquire(const volatile uint32_t *p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+    static void store_release(volatile uint32_t *p, uint32_t v) {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+#else
+    // older compilers without the __atomic builtins get full barriers
+    static uint32_t load_acquire(const volatile uint32_t *p) {
+        uint32_t v = *p;
+        __sync_synchronize();
+        return v;
+    }
+    static void store_release(volatile uint32_t *p, uint32_t v) {
+        __sync_synchronize();
+        *p = v;
+    }
+#endif
+
+    volatile uint32_t _seq;
+    volatile T _value;
+};
+
+#endif // __AP_HAL_UTILITY_SEQLOCK_H__
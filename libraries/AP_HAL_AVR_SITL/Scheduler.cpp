@@ -5,6 +5,7 @@
 
 #include "AP_HAL_AVR_SITL.h"
 #include "Scheduler.h"
+#include "Storage.h"
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -70,36 +71,36 @@ double SITLScheduler::_cyg_sec()
 }
 #endif
 
-uint32_t SITLScheduler::_micros() 
+uint64_t SITLScheduler::_micros64() 
 {
 #ifdef __CYGWIN__
-	return (uint32_t)(_cyg_sec() * 1.0e6);
+	return (uint64_t)(_cyg_sec() * 1.0e6);
 #else   
 	struct timeval tp;
 	gettimeofday(&tp,NULL);
-	return 1.0e6*((tp.tv_sec + (tp.tv_usec*1.0e-6)) - 
-		      (_sketch_start_time.tv_sec +
-		       (_sketch_start_time.tv_usec*1.0e-6)));
+	return (tp.tv_sec - _sketch_start_time.tv_sec)*1000000LL +
+		(tp.tv_usec - _sketch_start_time.tv_usec);
 #endif
 }
 
+uint32_t SITLScheduler::_micros() 
+{
+    return _micros64();
+}
+
+uint64_t SITLScheduler::micros64() 
+{
+    return _micros64();
+}
+
 uint32_t SITLScheduler::micros() 
 {
-    return _micros();
+    return _micros64();
 }
 
 uint32_t SITLScheduler::millis() 
 {
-#ifdef __CYGWIN__
-	// 1000 ms in a second
-	return (uint32_t)(_cyg_sec() * 1000);
-#else
-	struct timeval tp;
-	gettimeofday(&tp,NULL);
-	return 1.0e3*((tp.tv_sec + (tp.tv_usec*1.0e-6)) - 
-		      (_sketch_start_time.tv_sec +
-		       (_sketch_start_time.tv_usec*1.0e-6)));
-#endif
+    return _micros64() / 1000;
 }
 
 void SITLScheduler::delay_microseconds(uint16_t usec) 
@@ -263,6 +264,8 @@ void SITLScheduler::_run_io_procs(bool called_from_isr)
                 _io_proc[i]();
             }
         }
+        // commit any pending storage changes
+        ((SITLEEPROMStorage *)hal.storage)->_timer_tick();
     } else if (called_from_isr) {
         _timer_event_missed = true;
     }
@@ -19,6 +19,7 @@ public:
     void     delay(uint16_t ms);
     uint32_t millis();
     uint32_t micros();
+    uint64_t micros64();
     void     delay_microseconds(uint16_t us);
     void     register_delay_callback(AP_HAL::Proc, uint16_t min_time_ms);
 
@@ -44,6 +45,7 @@ public:
 
     // callable from interrupt handler
     static uint32_t _micros();
+    static uint64_t _micros64();
     static void timer_event() { _run_timer_procs(true); _run_io_procs(true); }
 
 private:
@@ -21,6 +21,7 @@ namespace Linux {
     class LinuxRCOutput;
     class LinuxSemaphore;
     class LinuxScheduler;
+    class LinuxLatencyStats;
     class LinuxUtil;
 }
 
@@ -65,6 +65,7 @@ void HAL_Linux::init(int argc,char* const argv[]) const
             break;
         case 'h':
             printf("Usage: -A uartAPath -B uartBPath -C uartCPath\n");
+            printf("  a path may be a tty device, udp:HOST:PORT, tcp:PORT or tcp:HOST:PORT\n");
             exit(0);
         default:
             printf("Unknown option '%c'\n", (char)opt);
@@ -7,12 +7,14 @@
 #include "UARTDriver.h"
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <poll.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
 
 using namespace Linux;
 
@@ -23,7 +25,13 @@ extern const AP_HAL::HAL& hal;
 #define APM_LINUX_MAIN_PRIORITY     11
 #define APM_LINUX_IO_PRIORITY       10
 
-LinuxScheduler::LinuxScheduler()
+// the UART thread is woken by data arriving or the port becoming
+// writable, but also polls at this interval as a fallback
+#define APM_LINUX_UART_POLL_MS      10
+
+LinuxScheduler::LinuxScheduler() :
+    _timer_period_usec(1000000UL / LINUX_SCHEDULER_TIMER_HZ_DEFAULT),
+    _uart_wakeup_fd(-1)
 {}
 
 typedef void *(*pthread_startroutine_t)(void *);
@@ -41,7 +49,9 @@ void LinuxScheduler::_setup_realtime(uint32_t size)
 
 void LinuxScheduler::init(void* machtnichts)
 {
-    clock_gettime(CLOCK_MONOTONIC, &_sketch_start_time);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    _sketch_start_usec = ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
 
     _setup_realtime(32768);
 
@@ -60,6 +70,8 @@ void LinuxScheduler::init(void* machtnichts)
 
     pthread_create(&_timer_thread_ctx, &thread_attr, (pthread_startroutine_t)&Linux::LinuxScheduler::_timer_thread, this);
 
+    _uart_wakeup_fd = eventfd(0, EFD_NONBLOCK);
+
     // the UART thread runs at a medium priority
     pthread_attr_init(&thread_attr);
     param.sched_priority = APM_LINUX_UART_PRIORITY;
@@ -85,6 +97,42 @@ void LinuxScheduler::_microsleep(uint32_t usec)
     while (nanosleep(&ts, &ts) == -1 && errno == EINTR) ;
 }
 
+/*
+  sleep until an absolute deadline on the monotonic clock, then
+  record how late we woke up. Using an absolute deadline means the
+  time taken by the thread body does not add to the period, so the
+  thread runs at its nominal rate rather than drifting slower
+ */
+void LinuxScheduler::_wait_deadline(struct timespec &deadline, uint32_t period_usec,
+                                    LinuxLatencyStats &stats)
+{
+    deadline.tv_nsec += period_usec*1000UL;
+    while (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_nsec -= 1000000000L;
+        deadline.tv_sec++;
+    }
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) ;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t late_nsec = (int64_t)(now.tv_sec - deadline.tv_sec)*1000000000LL +
+        (now.tv_nsec - deadline.tv_nsec);
+    if (late_nsec < 0) {
+        late_nsec = 0;
+    }
+    uint32_t late_usec = late_nsec / 1000;
+
+    // if we have fallen more than a whole period behind then
+    // resynchronise to the current time rather than running a burst
+    // of back to back iterations to catch up
+    bool overrun = (late_usec >= period_usec);
+    if (overrun) {
+        deadline = now;
+    }
+    stats.update(late_usec, overrun);
+}
+
 void LinuxScheduler::delay(uint16_t ms)
 {
     if (stopped_clock_usec) {
@@ -104,32 +152,36 @@ void LinuxScheduler::delay(uint16_t ms)
     }
 }
 
-uint32_t LinuxScheduler::millis() 
+/*
+  the 32 bit clocks are derived from the 64 bit one, using integer
+  arithmetic only
+ */
+uint64_t LinuxScheduler::micros64() 
 {
     if (stopped_clock_usec) {
-        return stopped_clock_usec/1000;
+        return stopped_clock_usec;
     }
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return 1.0e3*((ts.tv_sec + (ts.tv_nsec*1.0e-9)) - 
-                  (_sketch_start_time.tv_sec +
-                   (_sketch_start_time.tv_nsec*1.0e-9)));
+    return (ts.tv_sec*1000000ULL + ts.tv_nsec/1000) - _sketch_start_usec;
+}
+
+uint32_t LinuxScheduler::millis() 
+{
+    return micros64() / 1000;
 }
 
 uint32_t LinuxScheduler::micros() 
 {
-    if (stopped_clock_usec) {
-        return stopped_clock_usec;
-    }
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return 1.0e6*((ts.tv_sec + (ts.tv_nsec*1.0e-9)) - 
-                  (_sketch_start_time.tv_sec +
-                   (_sketch_start_time.tv_nsec*1.0e-9)));
+    return micros64();
 }
 
 void LinuxScheduler::delay_microseconds(uint16_t us)
 {
+    if (stopped_clock_usec) {
+        stopped_clock_usec += us;
+        return;
+    }
     _microsleep(us);
 }
 
@@ -226,8 +278,10 @@ void *LinuxScheduler::_timer_thread(void)
     while (system_initializing()) {
         poll(NULL, 0, 1);        
     }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
     while (true) {
-        _microsleep(5000);
+        _wait_deadline(deadline, _timer_period_usec, _latency[LINUX_THREAD_TIMER]);
 
         // run registered timers
         _run_timers(true);
@@ -255,19 +309,113 @@ void LinuxScheduler::_run_io(void)
     _in_io_proc = false;
 }
 
+void LinuxScheduler::wakeup_uart_thread(void)
+{
+    if (_uart_wakeup_fd != -1) {
+        uint64_t v = 1;
+        write(_uart_wakeup_fd, &v, sizeof(v));
+    }
+}
+
+/*
+  the UART thread sleeps in poll() on all of the UART file
+  descriptors at once, so received bytes are drained as soon as they
+  arrive and pending bytes are flushed as soon as the port can take
+  them
+ */
 void *LinuxScheduler::_uart_thread(void)
 {
     _setup_realtime(32768);
     while (system_initializing()) {
         poll(NULL, 0, 1);        
     }
+
+    LinuxUARTDriver *uarts[] = {
+        (LinuxUARTDriver *)hal.uartA,
+        (LinuxUARTDriver *)hal.uartB,
+        (LinuxUARTDriver *)hal.uartC
+    };
+    const uint8_t num_uarts = sizeof(uarts)/sizeof(uarts[0]);
+
+    // each port can have separate read and write descriptors, plus
+    // one for the wakeup eventfd
+    struct pollfd fds[2*num_uarts+1];
+    uint8_t fd_port[2*num_uarts+1];
+
+    // time each port was last serviced
+    uint32_t last_tick_us[num_uarts];
+    memset(last_tick_us, 0, sizeof(last_tick_us));
+
     while (true) {
-        _microsleep(10000);
+        uint8_t nfds = 0;
+        for (uint8_t i=0; i<num_uarts; i++) {
+            int rd_fd = uarts[i]->_poll_read_fd();
+            int wr_fd = uarts[i]->_poll_write_fd();
+            if (rd_fd != -1) {
+                fds[nfds].fd = rd_fd;
+                fds[nfds].events = POLLIN;
+                if (wr_fd == rd_fd) {
+                    fds[nfds].events |= POLLOUT;
+                    wr_fd = -1;
+                }
+                fd_port[nfds++] = i;
+            }
+            if (wr_fd != -1) {
+                fds[nfds].fd = wr_fd;
+                fds[nfds].events = POLLOUT;
+                fd_port[nfds++] = i;
+            }
+        }
+        if (_uart_wakeup_fd != -1) {
+            fds[nfds].fd = _uart_wakeup_fd;
+            fds[nfds].events = POLLIN;
+            fd_port[nfds++] = num_uarts;
+        }
+        for (uint8_t i=0; i<nfds; i++) {
+            fds[i].revents = 0;
+        }
+
+        int ret = poll(fds, nfds, APM_LINUX_UART_POLL_MS);
+        if (ret == -1 && errno != EINTR) {
+            // should not happen, but avoid spinning if it does
+            _microsleep(APM_LINUX_UART_POLL_MS*1000UL);
+        }
 
-        // process any pending serial bytes
-        ((LinuxUARTDriver *)hal.uartA)->_timer_tick();
-        ((LinuxUARTDriver *)hal.uartB)->_timer_tick();
-        ((LinuxUARTDriver *)hal.uartC)->_timer_tick();
+        // service any port that has gone a full poll period without
+        // being serviced, whatever poll() returned, so that nothing is
+        // left behind by a port we are not able to poll on
+        uint32_t now = micros();
+        bool service[num_uarts];
+        for (uint8_t i=0; i<num_uarts; i++) {
+            service[i] = (now - last_tick_us[i]) >= APM_LINUX_UART_POLL_MS*1000UL;
+        }
+        for (uint8_t i=0; ret > 0 && i<nfds; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if (fd_port[i] == num_uarts) {
+                uint64_t v;
+                read(_uart_wakeup_fd, &v, sizeof(v));
+                // a transmit buffer has become non-empty
+                for (uint8_t j=0; j<num_uarts; j++) {
+                    if (uarts[j]->tx_pending()) {
+                        service[j] = true;
+                    }
+                }
+                continue;
+            }
+            if (fds[i].revents & (POLLERR|POLLHUP|POLLNVAL)) {
+                uarts[fd_port[i]]->_poll_error();
+            }
+            service[fd_port[i]] = true;
+        }
+
+        for (uint8_t i=0; i<num_uarts; i++) {
+            if (service[i]) {
+                uarts[i]->_timer_tick();
+                last_tick_us[i] = now;
+            }
+        }
     }
     return NULL;
 }
@@ -278,8 +426,10 @@ void *LinuxScheduler::_io_thread(void)
     while (system_initializing()) {
         poll(NULL, 0, 1);        
     }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
     while (true) {
-        _microsleep(20000);
+        _wait_deadline(deadline, 20000, _latency[LINUX_THREAD_IO]);
 
         // process any pending storage writes
         ((LinuxStorage *)hal.storage)->_timer_tick();
@@ -331,4 +481,114 @@ void LinuxScheduler::stop_clock(uint64_t time_usec)
     stopped_clock_usec = time_usec;
 }
 
+/*
+  set the rate of the timer thread in Hz. The new rate takes effect
+  on the next timer tick
+ */
+void LinuxScheduler::set_timer_speed(uint16_t speed_hz)
+{
+    if (speed_hz > LINUX_SCHEDULER_TIMER_HZ_MAX) {
+        speed_hz = LINUX_SCHEDULER_TIMER_HZ_MAX;
+    }
+    if (speed_hz < LINUX_SCHEDULER_TIMER_HZ_MIN) {
+        speed_hz = LINUX_SCHEDULER_TIMER_HZ_MIN;
+    }
+    _timer_period_usec = 1000000UL / speed_hz;
+}
+
+bool LinuxScheduler::get_thread_latency(uint8_t thread, struct thread_latency &lat)
+{
+    if (thread >= LINUX_THREAD_COUNT) {
+        return false;
+    }
+    _latency[thread].get_report(lat);
+    return true;
+}
+
+void LinuxScheduler::reset_latency_stats(void)
+{
+    for (uint8_t i=0; i<LINUX_THREAD_COUNT; i++) {
+        _latency[i].request_reset();
+    }
+}
+
+void LinuxLatencyStats::reset(void)
+{
+    _count = 0;
+    _min_usec = 0;
+    _max_usec = 0;
+    _sum_usec = 0;
+    _overruns = 0;
+    memset(_histogram, 0, sizeof(_histogram));
+    _reset_requested = false;
+}
+
+void LinuxLatencyStats::update(uint32_t latency_usec, bool overrun)
+{
+    if (_reset_requested) {
+        reset();
+    }
+    if (_count == 0 || latency_usec < _min_usec) {
+        _min_usec = latency_usec;
+    }
+    if (latency_usec > _max_usec) {
+        _max_usec = latency_usec;
+    }
+    _count++;
+    _sum_usec += latency_usec;
+    if (overrun) {
+        _overruns++;
+    }
+    uint32_t bucket = latency_usec / LINUX_LATENCY_BUCKET_USEC;
+    if (bucket > LINUX_LATENCY_NUM_BUCKETS) {
+        bucket = LINUX_LATENCY_NUM_BUCKETS;
+    }
+    _histogram[bucket]++;
+
+    if (_count % LINUX_LATENCY_PUBLISH_COUNT == 0) {
+        report r;
+        _make_report(r);
+        _published.write(r);
+    }
+}
+
+/*
+  get the last published report. Until the first report is published,
+  or if the owning thread keeps getting in the way, this gives zeros
+ */
+void LinuxLatencyStats::get_report(report &r) const
+{
+    if (!_published.read(r)) {
+        memset(&r, 0, sizeof(r));
+    }
+}
+
+/*
+  produce a summary of the statistics. The 99th percentile is given as
+  the upper edge of the histogram bucket it falls in, or the maximum
+  if it is beyond the range of the histogram
+ */
+void LinuxLatencyStats::_make_report(report &r) const
+{
+    r.count = _count;
+    r.min_usec = _min_usec;
+    r.max_usec = _max_usec;
+    r.avg_usec = _count ? (uint32_t)(_sum_usec / _count) : 0;
+    r.overruns = _overruns;
+    r.p99_usec = _max_usec;
+
+    uint32_t threshold = _count - _count/100;
+    uint32_t total = 0;
+    for (uint16_t i=0; i<LINUX_LATENCY_NUM_BUCKETS; i++) {
+        total += _histogram[i];
+        if (total >= threshold && total != 0) {
+            r.p99_usec = (i+1) * LINUX_LATENCY_BUCKET_USEC;
+            if (r.p99_usec > _max_usec) {
+                r.p99_usec = _max_usec;
+            }
+            break;
+        }
+    }
+}
+
 #endif // CONFIG_HAL_BOARD
@@ -7,9 +7,60 @@
 #if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
 #include <sys/time.h>
 #include <pthread.h>
+#include <utility/Seqlock.h>
 
 #define LINUX_SCHEDULER_MAX_TIMER_PROCS 10
 
+// default, minimum and maximum rate of the timer thread, in Hz. The
+// rate is set with set_timer_speed(), from the SCHED_TIMER_HZ parameter
+#define LINUX_SCHEDULER_TIMER_HZ_DEFAULT 200
+#define LINUX_SCHEDULER_TIMER_HZ_MIN     50
+#define LINUX_SCHEDULER_TIMER_HZ_MAX     4000
+
+// wakeup latency histogram, in buckets of this many microseconds
+#define LINUX_LATENCY_BUCKET_USEC 10
+#define LINUX_LATENCY_NUM_BUCKETS 100
+
+// number of wakeups between publishing the latency report
+#define LINUX_LATENCY_PUBLISH_COUNT 50
+
+/*
+  wakeup latency statistics for one scheduler thread. The latency is
+  the time between the absolute deadline a thread asked to be woken
+  at and the time it actually started running. The statistics are
+  only updated by the thread they belong to, which every
+  LINUX_LATENCY_PUBLISH_COUNT wakeups publishes a report through a
+  seqlock for other threads to read
+ */
+class Linux::LinuxLatencyStats {
+public:
+    LinuxLatencyStats() { reset(); }
+
+    typedef AP_HAL::Scheduler::thread_latency report;
+
+    void reset(void);
+    void update(uint32_t latency_usec, bool overrun);
+
+    // get the last published report, safe to call from any thread
+    void get_report(report &r) const;
+
+    // ask the owning thread to clear the statistics on its next wakeup
+    void request_reset(void) { _reset_requested = true; }
+
+private:
+    void _make_report(report &r) const;
+
+    Seqlock<report> _published;
+    volatile bool _reset_requested;
+    uint32_t _count;
+    uint32_t _min_usec;
+    uint32_t _max_usec;
+    uint64_t _sum_usec;
+    uint32_t _overruns;
+    // the last bucket holds all samples beyond the histogram range
+    uint32_t _histogram[LINUX_LATENCY_NUM_BUCKETS+1];
+};
+
 class Linux::LinuxScheduler : public AP_HAL::Scheduler {
 public:
     LinuxScheduler();
@@ -17,6 +68,7 @@ public:
     void     delay(uint16_t ms);
     uint32_t millis();
     uint32_t micros();
+    uint64_t micros64();
     void     delay_microseconds(uint16_t us);
     void     register_delay_callback(AP_HAL::Proc,
                 uint16_t min_time_ms);
@@ -41,10 +93,36 @@ public:
 
     void     stop_clock(uint64_t time_usec);
 
+    void     set_timer_speed(uint16_t speed_hz);
+
+    enum linux_thread {
+        LINUX_THREAD_TIMER = 0,
+        LINUX_THREAD_IO    = 1,
+        LINUX_THREAD_COUNT = 2
+    };
+
+    /*
+      get wakeup latency statistics for one of the deadline driven
+      scheduler threads, numbered as in enum linux_thread. The UART
+      thread is event driven so has no deadline to measure against
+     */
+    bool     get_thread_latency(uint8_t thread, struct thread_latency &lat);
+    void     reset_latency_stats(void);
+
+    /*
+      wake the UART thread so it re-evaluates which ports have data
+      to send. Called by the UART drivers when their transmit buffer
+      goes from empty to non-empty
+     */
+    void     wakeup_uart_thread(void);
+
 private:
-    struct timespec _sketch_start_time;    
+    // CLOCK_MONOTONIC time at startup, in microseconds
+    uint64_t _sketch_start_usec;
     void _timer_handler(int signum);
     void _microsleep(uint32_t usec);
+    void _wait_deadline(struct timespec &deadline, uint32_t period_usec,
+                        LinuxLatencyStats &stats);
 
     AP_HAL::Proc _delay_cb;
     uint16_t _min_delay_cb_ms;
@@ -66,6 +144,12 @@ private:
 
     volatile bool _timer_event_missed;
 
+    volatile uint32_t _timer_period_usec;
+    LinuxLatencyStats _latency[LINUX_THREAD_COUNT];
+
+    // eventfd used to wake the UART thread from poll()
+    int _uart_wakeup_fd;
+
     pthread_t _timer_thread_ctx;
     pthread_t _io_thread_ctx;
     pthread_t _uart_thread_ctx;
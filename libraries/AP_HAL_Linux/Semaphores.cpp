@@ -3,37 +3,138 @@
 #if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
 
 #include "Semaphores.h"
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+// glibc 2.30 added pthread_mutex_clocklock(), which takes its
+// deadline on a clock of our choosing
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+#define LINUX_HAVE_MUTEX_CLOCKLOCK 1
+#else
+#define LINUX_HAVE_MUTEX_CLOCKLOCK 0
+#endif
+
+// polling interval when waiting for the lock without clocklock
+#define LINUX_SEMAPHORE_POLL_USEC 100
 
 extern const AP_HAL::HAL& hal;
 
 using namespace Linux;
 
+/*
+  the bus semaphores are shared between SCHED_FIFO threads of
+  different priorities, so use priority inheritance to stop a low
+  priority holder being starved while a high priority thread waits
+ */
+LinuxSemaphore::LinuxSemaphore()
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    memset(&_stats, 0, sizeof(_stats));
+}
+
 bool LinuxSemaphore::give() 
 {
     return pthread_mutex_unlock(&_lock) == 0;
 }
 
-bool LinuxSemaphore::take(uint32_t timeout_ms) 
+/*
+  record a contended take. Called with the lock held
+ */
+void LinuxSemaphore::_record_wait(uint32_t wait_us)
 {
-    if (timeout_ms == 0) {
-        return pthread_mutex_lock(&_lock) == 0;
+    _stats.takes++;
+    _stats.contended++;
+    _stats.total_wait_us += wait_us;
+    if (wait_us > _stats.max_wait_us) {
+        _stats.max_wait_us = wait_us;
     }
+}
+
+/*
+  take the semaphore, sleeping until it is free or the timeout
+  expires. A timeout of 0 or HAL_SEMAPHORE_BLOCK_FOREVER waits forever
+ */
+bool LinuxSemaphore::take(uint32_t timeout_ms) 
+{
     if (take_nonblocking()) {
         return true;
     }
+
     uint32_t start = hal.scheduler->micros();
+    int ret;
+    if (timeout_ms == 0 || timeout_ms == HAL_SEMAPHORE_BLOCK_FOREVER) {
+        ret = pthread_mutex_lock(&_lock);
+    } else {
+        ret = _timed_lock(timeout_ms);
+    }
+
+    if (ret != 0) {
+        __sync_fetch_and_add(&_stats.timeouts, 1);
+        return false;
+    }
+    _record_wait(hal.scheduler->micros() - start);
+    return true;
+}
+
+/*
+  lock with a timeout measured on CLOCK_MONOTONIC, so a step in the
+  system time from NTP or the GPS can't cut the wait short or stretch
+  it out
+ */
+int LinuxSemaphore::_timed_lock(uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000UL;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    int ret;
+#if LINUX_HAVE_MUTEX_CLOCKLOCK
     do {
-        hal.scheduler->delay_microseconds(200);
-        if (take_nonblocking()) {
-            return true;
+        ret = pthread_mutex_clocklock(&_lock, CLOCK_MONOTONIC, &deadline);
+    } while (ret == EINTR);
+#else
+    // without clocklock poll the lock, as pthread_mutex_timedlock()
+    // only takes a CLOCK_REALTIME deadline
+    while ((ret = pthread_mutex_trylock(&_lock)) == EBUSY) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec ||
+            (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+            return ETIMEDOUT;
         }
-    } while ((hal.scheduler->micros() - start) < timeout_ms*1000);
-    return false;
+        usleep(LINUX_SEMAPHORE_POLL_USEC);
+    }
+#endif
+    return ret;
 }
 
 bool LinuxSemaphore::take_nonblocking() 
 {
-    return pthread_mutex_trylock(&_lock) == 0;
+    if (pthread_mutex_trylock(&_lock) != 0) {
+        return false;
+    }
+    _stats.takes++;
+    return true;
+}
+
+void LinuxSemaphore::reset_stats(void)
+{
+    if (!take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    give();
 }
 
 #endif // CONFIG_HAL_BOARD
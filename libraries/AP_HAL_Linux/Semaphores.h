@@ -10,14 +10,31 @@
 
 class Linux::LinuxSemaphore : public AP_HAL::Semaphore {
 public:
-    LinuxSemaphore() {
-        pthread_mutex_init(&_lock, NULL);
-    }
+    LinuxSemaphore();
     bool give();
     bool take(uint32_t timeout_ms);
     bool take_nonblocking();
+
+    /*
+      contention statistics, for finding which bus semaphores threads
+      are fighting over
+     */
+    struct sem_stats {
+        uint32_t takes;         // successful takes
+        uint32_t contended;     // takes that had to wait
+        uint32_t timeouts;      // takes that gave up
+        uint32_t total_wait_us; // time spent waiting in contended takes
+        uint32_t max_wait_us;
+    };
+    void get_stats(struct sem_stats &stats) const { stats = _stats; }
+    void reset_stats(void);
+
 private:
     pthread_mutex_t _lock;
+    struct sem_stats _stats;
+
+    void _record_wait(uint32_t wait_us);
+    int _timed_lock(uint32_t timeout_ms);
 };
 #endif // CONFIG_HAL_BOARD
 
@@ -3,6 +3,7 @@
 #if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
 
 #include "UARTDriver.h"
+#include "Scheduler.h"
 
 #include <stdio.h>
 #include <errno.h>
@@ -15,6 +16,10 @@
 #include <poll.h>
 #include <assert.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
 
 extern const AP_HAL::HAL& hal;
 
@@ -23,12 +28,17 @@ using namespace Linux;
 LinuxUARTDriver::LinuxUARTDriver(bool default_console) :
     device_path(NULL),
     _rd_fd(-1),
-    _wr_fd(-1)
+    _wr_fd(-1),
+    _listen_fd(-1),
+    _device_type(DEVICE_TTY),
+    _poll_failed(false)
 {
+    memset(&_stats, 0, sizeof(_stats));
     if (default_console) {
         _rd_fd = 0;
         _wr_fd = 1;
         _console = true;
+        _connected = true;
     }
 }
 
@@ -43,6 +53,179 @@ void LinuxUARTDriver::set_device_path(const char *path)
 /*
   open the tty
  */
+bool LinuxUARTDriver::_tty_open(void)
+{
+    uint8_t retries = 0;
+    while (retries < 5) {
+        _rd_fd = open(device_path, O_RDWR);
+        if (_rd_fd != -1) {
+            break;
+        }
+        // sleep a bit and retry. There seems to be a NuttX bug
+        // that can cause ttyACM0 to not be available immediately,
+        // but a small delay can fix it
+        hal.scheduler->delay(100);
+        retries++;
+    }
+    _wr_fd = _rd_fd;
+    if (_rd_fd == -1) {
+        fprintf(stdout, "Failed to open UART device %s - %s\n",
+                device_path, strerror(errno));
+        return false;
+    }
+    if (retries != 0) {
+        fprintf(stdout, "WARNING: took %u retries to open UART %s\n", 
+                (unsigned)retries, device_path);
+        return false;
+    }
+
+    // always run the file descriptor non-blocking, and deal with
+    // blocking IO in the higher level calls
+    fcntl(_rd_fd, F_SETFL, fcntl(_rd_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    _device_type = DEVICE_TTY;
+    _connected = true;
+    return true;
+}
+
+/*
+  start a network connection. The device path is one of
+    udp:HOST:PORT  - send datagrams to HOST:PORT and accept replies
+    tcp:PORT       - listen for a single TCP client on PORT
+    tcp:HOST:PORT  - connect as a TCP client to HOST:PORT
+ */
+bool LinuxUARTDriver::_network_start(void)
+{
+    char *devstr = strdup(device_path);
+    char *saveptr = NULL;
+    char *protocol = strtok_r(devstr, ":", &saveptr);
+    char *host = strtok_r(NULL, ":", &saveptr);
+    char *port = strtok_r(NULL, ":", &saveptr);
+    bool ret = false;
+
+    if (strcmp(protocol, "udp") == 0 && host != NULL && port != NULL) {
+        ret = _ip_connect(host, port, SOCK_DGRAM);
+        _device_type = DEVICE_UDP;
+    } else if (strcmp(protocol, "tcp") == 0 && host != NULL && port != NULL) {
+        ret = _ip_connect(host, port, SOCK_STREAM);
+        _device_type = DEVICE_TCP_CLIENT;
+    } else if (strcmp(protocol, "tcp") == 0 && host != NULL) {
+        ret = _tcp_listen(host);
+        _device_type = DEVICE_TCP_SERVER;
+    } else {
+        fprintf(stdout, "Bad network device %s\n", device_path);
+    }
+
+    free(devstr);
+    return ret;
+}
+
+/*
+  create a UDP or TCP socket connected to the given host and port
+ */
+bool LinuxUARTDriver::_ip_connect(const char *host, const char *port, int type)
+{
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = type;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        fprintf(stdout, "Failed to resolve %s\n", device_path);
+        return false;
+    }
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd == -1) {
+        fprintf(stdout, "socket failed for %s - %s\n", device_path, strerror(errno));
+        freeaddrinfo(res);
+        return false;
+    }
+    if (connect(fd, res->ai_addr, res->ai_addrlen) == -1) {
+        fprintf(stdout, "Failed to connect %s - %s\n", device_path, strerror(errno));
+        close(fd);
+        freeaddrinfo(res);
+        return false;
+    }
+    freeaddrinfo(res);
+
+    if (type == SOCK_STREAM) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    _rd_fd = _wr_fd = fd;
+    _connected = true;
+    return true;
+}
+
+/*
+  start listening for a TCP client. The connection itself is accepted
+  by the UART thread, so we don't block waiting for a client
+ */
+bool LinuxUARTDriver::_tcp_listen(const char *port)
+{
+    struct sockaddr_in sockaddr;
+    int one = 1;
+
+    memset(&sockaddr, 0, sizeof(sockaddr));
+    sockaddr.sin_port = htons(atoi(port));
+    sockaddr.sin_family = AF_INET;
+    sockaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen_fd == -1) {
+        fprintf(stdout, "socket failed for %s - %s\n", device_path, strerror(errno));
+        return false;
+    }
+
+    // we want to be able to re-use ports quickly
+    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(_listen_fd, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) == -1 ||
+        listen(_listen_fd, 1) == -1) {
+        fprintf(stdout, "Failed to listen on %s - %s\n", device_path, strerror(errno));
+        close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+    fcntl(_listen_fd, F_SETFL, fcntl(_listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    fprintf(stdout, "Serial port %s waiting for TCP connection\n", device_path);
+    _rd_fd = _wr_fd = -1;
+    _connected = false;
+    return true;
+}
+
+/*
+  accept a pending TCP client, if there is one
+ */
+void LinuxUARTDriver::_tcp_accept(void)
+{
+    int fd = accept(_listen_fd, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    _rd_fd = _wr_fd = fd;
+    _connected = true;
+    fprintf(stdout, "New connection on serial port %s\n", device_path);
+}
+
+/*
+  the other end of a TCP connection has gone away. A server goes back
+  to listening for a new client, a client stays disconnected
+ */
+void LinuxUARTDriver::_tcp_disconnect(void)
+{
+    fprintf(stdout, "Closed connection on serial port %s\n", device_path);
+    _connected = false;
+    close(_rd_fd);
+    _rd_fd = _wr_fd = -1;
+}
+
 void LinuxUARTDriver::begin(uint32_t b) 
 {
     begin(b, 0, 0);
@@ -61,34 +244,15 @@ void LinuxUARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
         if (device_path == NULL) {
             return;
         }
-        uint8_t retries = 0;
-        while (retries < 5) {
-            _rd_fd = open(device_path, O_RDWR);
-            if (_rd_fd != -1) {
-                break;
+        if (strncmp(device_path, "udp:", 4) == 0 ||
+            strncmp(device_path, "tcp:", 4) == 0) {
+            if (!_network_start()) {
+                return;
             }
-            // sleep a bit and retry. There seems to be a NuttX bug
-            // that can cause ttyACM0 to not be available immediately,
-            // but a small delay can fix it
-            hal.scheduler->delay(100);
-            retries++;
-        }
-        _wr_fd = _rd_fd;
-        if (_rd_fd == -1) {
-            fprintf(stdout, "Failed to open UART device %s - %s\n",
-                    device_path, strerror(errno));
-            return;
-        }
-        if (retries != 0) {
-            fprintf(stdout, "WARNING: took %u retries to open UART %s\n", 
-                    (unsigned)retries, device_path);
+        } else if (!_tty_open()) {
             return;
         }
 
-        // always run the file descriptor non-blocking, and deal with
-        // blocking IO in the higher level calls
-        fcntl(_rd_fd, F_SETFL, fcntl(_rd_fd, F_GETFL, 0) | O_NONBLOCK);
-        
         if (rxS < 1024) {
             rxS = 1024;
         }
@@ -104,7 +268,9 @@ void LinuxUARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
     _initialised = false;
     while (_in_timer) hal.scheduler->delay(1);
 
-    if (b != 0 && _rd_fd == _wr_fd) {
+    _poll_failed = false;
+
+    if (b != 0 && _rd_fd == _wr_fd && _device_type == DEVICE_TTY) {
         // set the baud rate
         struct termios t;
         tcgetattr(_rd_fd, &t);
@@ -115,32 +281,17 @@ void LinuxUARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
     }
 
     /*
-      allocate the read buffer
+      allocate the read and write buffers. The sizes are rounded up
+      to a power of two
     */
-    if (rxS != 0 && rxS != _readbuf_size) {
-        _readbuf_size = rxS;
-        if (_readbuf != NULL) {
-            free(_readbuf);
-        }
-        _readbuf = (uint8_t *)malloc(_readbuf_size);
-        _readbuf_head = 0;
-        _readbuf_tail = 0;
+    if (rxS != 0) {
+        _readbuf.set_size(rxS);
     }
-
-    /*
-      allocate the write buffer
-    */
-    if (txS != 0 && txS != _writebuf_size) {
-        _writebuf_size = txS;
-        if (_writebuf != NULL) {
-            free(_writebuf);
-        }
-        _writebuf = (uint8_t *)malloc(_writebuf_size+16);
-        _writebuf_head = 0;
-        _writebuf_tail = 0;
+    if (txS != 0) {
+        _writebuf.set_size(txS);
     }
 
-    if (_writebuf_size != 0 && _readbuf_size != 0) {
+    if (_writebuf.get_size() != 0 && _readbuf.get_size() != 0) {
         _initialised = true;
     }
 }
@@ -157,19 +308,13 @@ void LinuxUARTDriver::end()
     }
     _rd_fd = -1;
     _wr_fd = -1;
-    if (_readbuf) {
-        free(_readbuf);
-        _readbuf = NULL;
-    }
-    if (_writebuf) {
-        free(_writebuf);
-        _writebuf = NULL;
-    }
-    _readbuf_size = _writebuf_size = 0;
-    _writebuf_head = 0;
-    _writebuf_tail = 0;
-    _readbuf_head = 0;
-    _readbuf_tail = 0;
+    if (_listen_fd != -1) {
+        close(_listen_fd);
+        _listen_fd = -1;
+    }
+    _connected = false;
+    _readbuf.set_size(0);
+    _writebuf.set_size(0);
 }
 
 
@@ -197,33 +342,25 @@ void LinuxUARTDriver::set_blocking_writes(bool blocking)
 }
 
 
-/*
-  buffer handling macros
- */
-#define BUF_AVAILABLE(buf) ((buf##_head > (_tail=buf##_tail))? (buf##_size - buf##_head) + _tail: _tail - buf##_head)
-#define BUF_SPACE(buf) (((_head=buf##_head) > buf##_tail)?(_head - buf##_tail) - 1:((buf##_size - buf##_tail) + _head) - 1)
-#define BUF_EMPTY(buf) (buf##_head == buf##_tail)
-#define BUF_ADVANCETAIL(buf, n) buf##_tail = (buf##_tail + n) % buf##_size
-#define BUF_ADVANCEHEAD(buf, n) buf##_head = (buf##_head + n) % buf##_size
-
 /*
   do we have any bytes pending transmission?
  */
 bool LinuxUARTDriver::tx_pending() 
 { 
-    return !BUF_EMPTY(_writebuf);
+    return !_writebuf.empty();
 }
 
 /*
-  return the number of bytes available to be read
+  return the number of bytes available to be read. The buffers can be
+  larger than the int16_t the Stream API returns, so this saturates
  */
 int16_t LinuxUARTDriver::available() 
 { 
     if (!_initialised) {
         return 0;
     }
-    uint16_t _tail;
-    return BUF_AVAILABLE(_readbuf);
+    uint32_t n = _readbuf.available();
+    return n > INT16_MAX ? INT16_MAX : n;
 }
 
 /*
@@ -234,21 +371,19 @@ int16_t LinuxUARTDriver::txspace()
     if (!_initialised) {
         return 0;
     }
-    uint16_t _head;
-    return BUF_SPACE(_writebuf);
+    uint32_t n = _writebuf.space();
+    return n > INT16_MAX ? INT16_MAX : n;
 }
 
 int16_t LinuxUARTDriver::read() 
 { 
     uint8_t c;
-    if (!_initialised || _readbuf == NULL) {
+    if (!_initialised) {
         return -1;
     }
-    if (BUF_EMPTY(_readbuf)) {
+    if (!_readbuf.pop(c)) {
         return -1;
     }
-    c = _readbuf[_readbuf_head];
-    BUF_ADVANCEHEAD(_readbuf, 1);
     return c;
 }
 
@@ -258,16 +393,14 @@ size_t LinuxUARTDriver::write(uint8_t c)
     if (!_initialised) {
         return 0;
     }
-    uint16_t _head;
-
-    while (BUF_SPACE(_writebuf) == 0) {
+    while (!_writebuf.push(c)) {
         if (_nonblocking_writes) {
+            _stats.tx_dropped++;
             return 0;
         }
         hal.scheduler->delay(1);
     }
-    _writebuf[_writebuf_tail] = c;
-    BUF_ADVANCETAIL(_writebuf, 1);
+    _wakeup_uart_thread(1);
     return 1;
 }
 
@@ -291,42 +424,20 @@ size_t LinuxUARTDriver::write(const uint8_t *buffer, size_t size)
         return ret;
     }
 
-    uint16_t _head, space;
-    space = BUF_SPACE(_writebuf);
-    if (space == 0) {
-        return 0;
+    size_t ret = _writebuf.write(buffer, size);
+    if (ret < size) {
+        _stats.tx_dropped += size - ret;
+    }
+    if (ret > 0) {
+        _wakeup_uart_thread(ret);
     }
-    if (size > space) {
-        size = space;
-    }
-    if (_writebuf_tail < _head) {
-        // perform as single memcpy
-        assert(_writebuf_tail+size <= _writebuf_size);
-        memcpy(&_writebuf[_writebuf_tail], buffer, size);
-        BUF_ADVANCETAIL(_writebuf, size);
-        return size;
-    }
-
-    // perform as two memcpy calls
-    uint16_t n = _writebuf_size - _writebuf_tail;
-    if (n > size) n = size;
-    assert(_writebuf_tail+n <= _writebuf_size);
-    memcpy(&_writebuf[_writebuf_tail], buffer, n);
-    BUF_ADVANCETAIL(_writebuf, n);
-    buffer += n;
-    n = size - n;
-    if (n > 0) {
-        assert(_writebuf_tail+n <= _writebuf_size);
-        memcpy(&_writebuf[_writebuf_tail], buffer, n);
-        BUF_ADVANCETAIL(_writebuf, n);
-    }        
-    return size;
+    return ret;
 }
 
 /*
   try writing n bytes, handling an unresponsive port
  */
-int LinuxUARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
+int LinuxUARTDriver::_write_fd(const uint8_t *buf, uint32_t n)
 {
     int ret = 0;
 
@@ -335,78 +446,218 @@ int LinuxUARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
     fds.events = POLLOUT;
     fds.revents = 0;
 
+    bool tcp = (_device_type == DEVICE_TCP_SERVER ||
+                _device_type == DEVICE_TCP_CLIENT);
+
     if (poll(&fds, 1, 0) == 1) {
-        ret = ::write(_wr_fd, buf, n);
+        if (tcp) {
+            // a plain write() to a socket whose peer has reset
+            // raises SIGPIPE, which would kill the process
+            ret = ::send(_wr_fd, buf, n, MSG_NOSIGNAL);
+        } else {
+            ret = ::write(_wr_fd, buf, n);
+        }
     }
 
     if (ret > 0) {
-        BUF_ADVANCEHEAD(_writebuf, ret);
+        _writebuf.advance(ret);
+        _stats.tx_bytes += ret;
         return ret;
     }
 
+    if (ret == -1 && _device_type == DEVICE_UDP && errno != EAGAIN) {
+        // nobody is listening at the other end. Drop the data rather
+        // than letting the buffer fill up
+        _writebuf.advance(n);
+        _stats.tx_dropped += n;
+        return n;
+    }
+
+    if (ret == -1 && tcp && (errno == EPIPE || errno == ECONNRESET)) {
+        _tcp_disconnect();
+    }
+
     return ret;
 }
 
 /*
   try reading n bytes, handling an unresponsive port
  */
-int LinuxUARTDriver::_read_fd(uint8_t *buf, uint16_t n)
+int LinuxUARTDriver::_read_fd(uint8_t *buf, uint32_t n)
 {
     int ret;
     ret = ::read(_rd_fd, buf, n);
     if (ret > 0) {
-        BUF_ADVANCETAIL(_readbuf, ret);
+        _readbuf.commit(ret);
+        _stats.rx_bytes += ret;
+    } else if ((ret == 0 || (ret == -1 && errno == ECONNRESET)) &&
+               (_device_type == DEVICE_TCP_SERVER ||
+                _device_type == DEVICE_TCP_CLIENT)) {
+        _tcp_disconnect();
+    } else if (ret == 0) {
+        // end of file, poll() would keep reporting this as readable
+        _poll_failed = true;
     }
     return ret;
 }
 
+/*
+  read all pending datagrams from a UDP socket. Each datagram must be
+  read in one call, so read into a bounce buffer and only keep
+  datagrams that fit in the read buffer
+ */
+void LinuxUARTDriver::_udp_read(void)
+{
+    uint8_t buf[LINUX_UART_MAX_DATAGRAM];
+
+    while (true) {
+        ssize_t ret = ::recv(_rd_fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (ret <= 0) {
+            break;
+        }
+        if ((uint32_t)ret > _readbuf.space()) {
+            _stats.rx_overflows++;
+            continue;
+        }
+        _readbuf.write(buf, ret);
+        _stats.rx_bytes += ret;
+    }
+}
+
+
+/*
+  wake the UART thread so it starts polling for the port to become
+  writable, if the written bytes just made the write buffer non-empty.
+  This is checked after the write rather than before it, as the UART
+  thread may drain the buffer and go back to sleep in between, for
+  example while a blocking write waits for space
+ */
+void LinuxUARTDriver::_wakeup_uart_thread(uint32_t written)
+{
+    if (_writebuf.get_size() - _writebuf.space() <= written) {
+        ((LinuxScheduler *)hal.scheduler)->wakeup_uart_thread();
+    }
+}
+
+/*
+  return the fd to poll for input, or -1 if we have no room to accept
+  more input
+ */
+int LinuxUARTDriver::_poll_read_fd(void)
+{
+    if (!_initialised || _poll_failed) {
+        return -1;
+    }
+    if (!_connected) {
+        // wait for a client to connect
+        return _listen_fd;
+    }
+    if (_readbuf.space() == 0) {
+        return -1;
+    }
+    return _rd_fd;
+}
+
+/*
+  return the fd to poll for output, or -1 if we have nothing to send
+ */
+int LinuxUARTDriver::_poll_write_fd(void)
+{
+    if (!_initialised || _poll_failed || !_connected || _writebuf.empty()) {
+        return -1;
+    }
+    return _wr_fd;
+}
+
+/*
+  called by the UART thread when poll() reports an error or hangup on
+  one of our descriptors
+ */
+void LinuxUARTDriver::_poll_error(void)
+{
+    switch (_device_type) {
+    case DEVICE_UDP: {
+        // typically ECONNREFUSED as nobody is listening yet. Clear
+        // the error and carry on
+        int err;
+        socklen_t len = sizeof(err);
+        getsockopt(_rd_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        break;
+    }
+    case DEVICE_TCP_SERVER:
+    case DEVICE_TCP_CLIENT:
+        if (_connected) {
+            _tcp_disconnect();
+        }
+        break;
+    default:
+        _poll_failed = true;
+        break;
+    }
+}
 
 /*
-  push any pending bytes to/from the serial port. This is called at
-  1kHz in the timer thread. Doing it this way reduces the system call
+  push any pending bytes to/from the serial port. This is called from
+  the UART thread whenever one of our descriptors is ready, or on its
+  fallback interval. Doing it this way reduces the system call
   overhead in the main task enormously. 
  */
 void LinuxUARTDriver::_timer_tick(void)
 {
-    uint16_t n;
+    uint32_t n;
 
     if (!_initialised) return;
 
     _in_timer = true;
+    _stats.wakeups++;
 
-    // write any pending bytes
-    uint16_t _tail;
-    n = BUF_AVAILABLE(_writebuf);
-    if (n > 0) {
-        if (_tail > _writebuf_head) {
-            // do as a single write
-            _write_fd(&_writebuf[_writebuf_head], n);
-        } else {
-            // split into two writes
-            uint16_t n1 = _writebuf_size - _writebuf_head;
-            int ret = _write_fd(&_writebuf[_writebuf_head], n1);
-            if (ret == n1 && n != n1) {
-                _write_fd(&_writebuf[_writebuf_head], n - n1);                
-            }
+    if (!_connected) {
+        if (_listen_fd != -1) {
+            _tcp_accept();
+        }
+        if (!_connected) {
+            // there is nobody to send to, so discard pending output
+            // rather than blocking the writer
+            n = _writebuf.available();
+            _writebuf.advance(n);
+            _stats.tx_dropped += n;
+            _in_timer = false;
+            return;
+        }
+    }
+
+    // write any pending bytes, in up to two pieces if the data
+    // wraps around the end of the buffer
+    for (uint8_t i=0; i<2; i++) {
+        const uint8_t *p = _writebuf.peek(n);
+        if (p == NULL || _write_fd(p, n) != (int)n) {
+            break;
         }
     }
 
+    if (!_connected) {
+        // the write found the peer had gone away
+        _in_timer = false;
+        return;
+    }
+
+    if (_device_type == DEVICE_UDP) {
+        _udp_read();
+        _in_timer = false;
+        return;
+    }
+
     // try to fill the read buffer
-    uint16_t _head;
-    n = BUF_SPACE(_readbuf);
-    if (n > 0) {
-        if (_readbuf_tail < _head) {
-            // one read will do
-            assert(_readbuf_tail+n <= _readbuf_size);
-            _read_fd(&_readbuf[_readbuf_tail], n);
-        } else {
-            uint16_t n1 = _readbuf_size - _readbuf_tail;
-            assert(_readbuf_tail+n1 <= _readbuf_size);
-            int ret = _read_fd(&_readbuf[_readbuf_tail], n1);
-            if (ret == n1 && n != n1) {
-                assert(_readbuf_tail+(n-n1) <= _readbuf_size);
-                _read_fd(&_readbuf[_readbuf_tail], n - n1);                
+    for (uint8_t i=0; i<2; i++) {
+        uint8_t *p = _readbuf.reserve(n);
+        if (p == NULL) {
+            if (i == 0) {
+                _stats.rx_overflows++;
             }
+            break;
+        }
+        if (_read_fd(p, n) != (int)n) {
+            break;
         }
     }
 
@@ -3,6 +3,10 @@
 #define __AP_HAL_LINUX_UARTDRIVER_H__
 
 #include <AP_HAL_Linux.h>
+#include <utility/RingBuffer.h>
+
+// largest UDP datagram we accept
+#define LINUX_UART_MAX_DATAGRAM 2048
 
 class Linux::LinuxUARTDriver : public AP_HAL::UARTDriver {
 public:
@@ -29,32 +33,68 @@ public:
 
     void _timer_tick(void);
 
+    /*
+      file descriptors the UART thread should poll on, or -1 if there
+      is currently nothing to wait for in that direction
+     */
+    int _poll_read_fd(void);
+    int _poll_write_fd(void);
+    void _poll_error(void);
+
+    struct uart_stats {
+        uint32_t rx_bytes;
+        uint32_t tx_bytes;
+        uint32_t wakeups;
+        uint32_t rx_overflows;  // times the read buffer was full
+        uint32_t tx_dropped;    // bytes dropped by non-blocking writes
+    };
+    void get_stats(struct uart_stats &stats) const { stats = _stats; }
+
 private:
     const char *device_path;
     int _rd_fd;
     int _wr_fd;
+    int _listen_fd;
+
+    enum device_type {
+        DEVICE_TTY,
+        DEVICE_UDP,
+        DEVICE_TCP_SERVER,
+        DEVICE_TCP_CLIENT
+    } _device_type;
+
+    // false while a TCP server is waiting for a client
+    volatile bool _connected;
+
     bool _nonblocking_writes;
     bool _console;
     volatile bool _initialised;
     volatile bool _in_timer;
 
+    // set when the descriptor reports an error or end of file, so
+    // the UART thread stops polling it and only services it on its
+    // fallback interval
+    volatile bool _poll_failed;
+
+    struct uart_stats _stats;
+
     // we use in-task ring buffers to reduce the system call cost
-    // of ::read() and ::write() in the main loop
-    uint8_t *_readbuf;
-    uint16_t _readbuf_size;
-
-    // _head is where the next available data is. _tail is where new
-    // data is put
-    volatile uint16_t _readbuf_head;
-    volatile uint16_t _readbuf_tail;
-
-    uint8_t *_writebuf;
-    uint16_t _writebuf_size;
-    volatile uint16_t _writebuf_head;
-    volatile uint16_t _writebuf_tail;
-
-    int _write_fd(const uint8_t *buf, uint16_t n);
-    int _read_fd(uint8_t *buf, uint16_t n);
+    // of ::read() and ::write() in the main loop. The UART thread
+    // produces into _readbuf and consumes from _writebuf
+    ByteBuffer _readbuf;
+    ByteBuffer _writebuf;
+
+    int _write_fd(const uint8_t *buf, uint32_t n);
+    int _read_fd(uint8_t *buf, uint32_t n);
+    void _wakeup_uart_thread(uint32_t written);
+
+    bool _tty_open(void);
+    bool _network_start(void);
+    bool _ip_connect(const char *host, const char *port, int type);
+    bool _tcp_listen(const char *port);
+    void _tcp_accept(void);
+    void _tcp_disconnect(void);
+    void _udp_read(void);
     uint64_t _last_write_time;
 };
 
@@ -75,6 +75,11 @@ void PX4Scheduler::init(void *unused)
 	pthread_create(&_io_thread_ctx, &thread_attr, (pthread_startroutine_t)&PX4::PX4Scheduler::_io_thread, this);
 }
 
+uint64_t PX4Scheduler::micros64()
+{
+    return hrt_absolute_time() - _sketch_start_time;
+}
+
 uint32_t PX4Scheduler::micros() 
 {
     return (uint32_t)(hrt_absolute_time() - _sketch_start_time);
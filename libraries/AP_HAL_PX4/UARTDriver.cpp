@@ -69,18 +69,12 @@ void PX4UARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
       thrashing of the heap once we are up. The ttyACM0 driver may not
       connect for some time after boot
      */
-	if (rxS != 0 && rxS != _readbuf_size) {
+	if (rxS != 0 && rxS > _readbuf.get_size()) {
         _initialised = false;
         while (_in_timer) {
             hal.scheduler->delay(1);
         }
-		_readbuf_size = rxS;
-		if (_readbuf != NULL) {
-			free(_readbuf);
-		}
-		_readbuf = (uint8_t *)malloc(_readbuf_size);
-		_readbuf_head = 0;
-		_readbuf_tail = 0;
+        _readbuf.set_size(rxS);
 	}
 
     if (b != 0) {
@@ -90,18 +84,12 @@ void PX4UARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
     /*
       allocate the write buffer
      */
-	if (txS != 0 && txS != _writebuf_size) {
+	if (txS != 0 && txS > _writebuf.get_size()) {
         _initialised = false;
         while (_in_timer) {
             hal.scheduler->delay(1);
         }
-		_writebuf_size = txS;
-		if (_writebuf != NULL) {
-			free(_writebuf);
-		}
-		_writebuf = (uint8_t *)malloc(_writebuf_size+16);
-		_writebuf_head = 0;
-		_writebuf_tail = 0;
+        _writebuf.set_size(txS);
 	}
 
 	if (_fd == -1) {
@@ -140,10 +128,10 @@ void PX4UARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
 		tcsetattr(_fd, TCSANOW, &t);
 	}
 
-    if (_writebuf_size != 0 && _readbuf_size != 0 && _fd != -1) {
+    if (_writebuf.get_size() != 0 && _readbuf.get_size() != 0 && _fd != -1) {
         if (!_initialised) {
             ::printf("initialised %s OK %u %u\n", _devpath, 
-                     (unsigned)_writebuf_size, (unsigned)_readbuf_size);
+                     (unsigned)_writebuf.get_size(), (unsigned)_readbuf.get_size());
         }
         _initialised = true;
     }
@@ -201,19 +189,8 @@ void PX4UARTDriver::end()
         close(_fd);
         _fd = -1;
     }
-    if (_readbuf) {
-        free(_readbuf);
-        _readbuf = NULL;
-    }
-    if (_writebuf) {
-        free(_writebuf);
-        _writebuf = NULL;
-    }
-    _readbuf_size = _writebuf_size = 0;
-    _writebuf_head = 0;
-    _writebuf_tail = 0;
-    _readbuf_head = 0;
-    _readbuf_tail = 0;
+    _readbuf.set_size(0);
+    _writebuf.set_size(0);
 }
 
 void PX4UARTDriver::flush() {}
@@ -231,15 +208,6 @@ void PX4UARTDriver::set_blocking_writes(bool blocking)
 
 bool PX4UARTDriver::tx_pending() { return false; }
 
-/*
-  buffer handling macros
- */
-#define BUF_AVAILABLE(buf) ((buf##_head > (_tail=buf##_tail))? (buf##_size - buf##_head) + _tail: _tail - buf##_head)
-#define BUF_SPACE(buf) (((_head=buf##_head) > buf##_tail)?(_head - buf##_tail) - 1:((buf##_size - buf##_tail) + _head) - 1)
-#define BUF_EMPTY(buf) (buf##_head == buf##_tail)
-#define BUF_ADVANCETAIL(buf, n) buf##_tail = (buf##_tail + n) % buf##_size
-#define BUF_ADVANCEHEAD(buf, n) buf##_head = (buf##_head + n) % buf##_size
-
 /*
   return number of bytes available to be read from the buffer
  */
@@ -249,8 +217,8 @@ int16_t PX4UARTDriver::available()
         try_initialise();
 		return 0;
 	}
-    uint16_t _tail;
-    return BUF_AVAILABLE(_readbuf);
+    uint32_t n = _readbuf.available();
+    return n > INT16_MAX ? INT16_MAX : n;
 }
 
 /*
@@ -262,8 +230,8 @@ int16_t PX4UARTDriver::txspace()
         try_initialise();
 		return 0;
 	}
-    uint16_t _head;
-    return BUF_SPACE(_writebuf);
+    uint32_t n = _writebuf.space();
+    return n > INT16_MAX ? INT16_MAX : n;
 }
 
 /*
@@ -276,14 +244,9 @@ int16_t PX4UARTDriver::read()
         try_initialise();
         return -1;
     }
-	if (_readbuf == NULL) {
-		return -1;
-	}
-    if (BUF_EMPTY(_readbuf)) {
+    if (!_readbuf.pop(c)) {
         return -1;
     }
-    c = _readbuf[_readbuf_head];
-    BUF_ADVANCEHEAD(_readbuf, 1);
 	return c;
 }
 
@@ -300,16 +263,12 @@ size_t PX4UARTDriver::write(uint8_t c)
         // not allowed from timers
         return 0;
     }
-    uint16_t _head;
-
-    while (BUF_SPACE(_writebuf) == 0) {
+    while (!_writebuf.push(c)) {
         if (_nonblocking_writes) {
             return 0;
         }
         hal.scheduler->delay(1);
     }
-    _writebuf[_writebuf_tail] = c;
-    BUF_ADVANCETAIL(_writebuf, 1);
     return 1;
 }
 
@@ -339,42 +298,13 @@ size_t PX4UARTDriver::write(const uint8_t *buffer, size_t size)
         return ret;
     }
 
-    uint16_t _head, space;
-    space = BUF_SPACE(_writebuf);
-    if (space == 0) {
-        return 0;
-    }
-    if (size > space) {
-        size = space;
-    }
-    if (_writebuf_tail < _head) {
-        // perform as single memcpy
-        assert(_writebuf_tail+size <= _writebuf_size);
-        memcpy(&_writebuf[_writebuf_tail], buffer, size);
-        BUF_ADVANCETAIL(_writebuf, size);
-        return size;
-    }
-
-    // perform as two memcpy calls
-    uint16_t n = _writebuf_size - _writebuf_tail;
-    if (n > size) n = size;
-    assert(_writebuf_tail+n <= _writebuf_size);
-    memcpy(&_writebuf[_writebuf_tail], buffer, n);
-    BUF_ADVANCETAIL(_writebuf, n);
-    buffer += n;
-    n = size - n;
-    if (n > 0) {
-        assert(_writebuf_tail+n <= _writebuf_size);
-        memcpy(&_writebuf[_writebuf_tail], buffer, n);
-        BUF_ADVANCETAIL(_writebuf, n);
-    }        
-    return size;
+    return _writebuf.write(buffer, size);
 }
 
 /*
   try writing n bytes, handling an unresponsive port
  */
-int PX4UARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
+int PX4UARTDriver::_write_fd(const uint8_t *buf, uint32_t n)
 {
     int ret = 0;
 
@@ -394,7 +324,7 @@ int PX4UARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
                      _devpath, (unsigned)_total_written);
             set_flow_control(FLOW_CONTROL_DISABLE);
         }
-        if (nwrite > n) {
+        if ((uint32_t)nwrite > n) {
             nwrite = n;
         }
         if (nwrite > 0) {
@@ -403,7 +333,7 @@ int PX4UARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
     }
 
     if (ret > 0) {
-        BUF_ADVANCEHEAD(_writebuf, ret);
+        _writebuf.advance(ret);
         _last_write_time = hrt_absolute_time();
         _total_written += ret;
         return ret;
@@ -438,7 +368,7 @@ int PX4UARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
         // discarding bytes, even if this is a blocking port. This
         // prevents the ttyACM0 port blocking startup if the endpoint
         // is not connected
-        BUF_ADVANCEHEAD(_writebuf, n);
+        _writebuf.advance(n);
         return n;
     }
     return ret;
@@ -447,7 +377,7 @@ int PX4UARTDriver::_write_fd(const uint8_t *buf, uint16_t n)
 /*
   try reading n bytes, handling an unresponsive port
  */
-int PX4UARTDriver::_read_fd(uint8_t *buf, uint16_t n)
+int PX4UARTDriver::_read_fd(uint8_t *buf, uint32_t n)
 {
     int ret = 0;
 
@@ -455,7 +385,7 @@ int PX4UARTDriver::_read_fd(uint8_t *buf, uint16_t n)
     // in NuttX on ttyACM0
     int nread = 0;
     if (ioctl(_fd, FIONREAD, (unsigned long)&nread) == 0) {
-        if (nread > n) {
+        if ((uint32_t)nread > n) {
             nread = n;
         }
         if (nread > 0) {
@@ -463,7 +393,7 @@ int PX4UARTDriver::_read_fd(uint8_t *buf, uint16_t n)
         }
     }
     if (ret > 0) {
-        BUF_ADVANCETAIL(_readbuf, ret);
+        _readbuf.commit(ret);
         _total_read += ret;
     }
     return ret;
@@ -477,7 +407,7 @@ int PX4UARTDriver::_read_fd(uint8_t *buf, uint16_t n)
  */
 void PX4UARTDriver::_timer_tick(void)
 {
-    uint16_t n;
+    uint32_t n;
 
     if (!_initialised) return;
 
@@ -488,41 +418,28 @@ void PX4UARTDriver::_timer_tick(void)
 
     _in_timer = true;
 
-    // write any pending bytes
-    uint16_t _tail;
-    n = BUF_AVAILABLE(_writebuf);
-    if (n > 0) {
+    // write any pending bytes, in up to two pieces if the data
+    // wraps around the end of the buffer
+    const uint8_t *wp = _writebuf.peek(n);
+    if (wp != NULL) {
         perf_begin(_perf_uart);
-        if (_tail > _writebuf_head) {
-            // do as a single write
-            _write_fd(&_writebuf[_writebuf_head], n);
-        } else {
-            // split into two writes
-            uint16_t n1 = _writebuf_size - _writebuf_head;
-            int ret = _write_fd(&_writebuf[_writebuf_head], n1);
-            if (ret == n1 && n != n1) {
-                _write_fd(&_writebuf[_writebuf_head], n - n1);                
+        if (_write_fd(wp, n) == (int)n) {
+            wp = _writebuf.peek(n);
+            if (wp != NULL) {
+                _write_fd(wp, n);
             }
         }
         perf_end(_perf_uart);
     }
 
     // try to fill the read buffer
-    uint16_t _head;
-    n = BUF_SPACE(_readbuf);
-    if (n > 0) {
+    uint8_t *rp = _readbuf.reserve(n);
+    if (rp != NULL) {
         perf_begin(_perf_uart);
-        if (_readbuf_tail < _head) {
-            // one read will do
-            assert(_readbuf_tail+n <= _readbuf_size);
-            _read_fd(&_readbuf[_readbuf_tail], n);
-        } else {
-            uint16_t n1 = _readbuf_size - _readbuf_tail;
-            assert(_readbuf_tail+n1 <= _readbuf_size);
-            int ret = _read_fd(&_readbuf[_readbuf_tail], n1);
-            if (ret == n1 && n != n1) {
-                assert(_readbuf_tail+(n-n1) <= _readbuf_size);
-                _read_fd(&_readbuf[_readbuf_tail], n - n1);                
+        if (_read_fd(rp, n) == (int)n) {
+            rp = _readbuf.reserve(n);
+            if (rp != NULL) {
+                _read_fd(rp, n);
             }
         }
         perf_end(_perf_uart);
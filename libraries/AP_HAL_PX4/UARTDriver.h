@@ -3,6 +3,7 @@
 #define __AP_HAL_PX4_UARTDRIVER_H__
 
 #include <AP_HAL_PX4.h>
+#include <utility/RingBuffer.h>
 #include <systemlib/perf_counter.h>
 
 class PX4::PX4UARTDriver : public AP_HAL::UARTDriver {
@@ -49,23 +50,14 @@ private:
     bool _nonblocking_writes;
 
     // we use in-task ring buffers to reduce the system call cost
-    // of ::read() and ::write() in the main loop
-    uint8_t *_readbuf;
-    uint16_t _readbuf_size;
-
-    // _head is where the next available data is. _tail is where new
-    // data is put
-    volatile uint16_t _readbuf_head;
-    volatile uint16_t _readbuf_tail;
-
-    uint8_t *_writebuf;
-    uint16_t _writebuf_size;
-    volatile uint16_t _writebuf_head;
-    volatile uint16_t _writebuf_tail;
+    // of ::read() and ::write() in the main loop. The timer thread
+    // produces into _readbuf and consumes from _writebuf
+    ByteBuffer _readbuf;
+    ByteBuffer _writebuf;
     perf_counter_t  _perf_uart;
 
-    int _write_fd(const uint8_t *buf, uint16_t n);
-    int _read_fd(uint8_t *buf, uint16_t n);
+    int _write_fd(const uint8_t *buf, uint32_t n);
+    int _read_fd(uint8_t *buf, uint32_t n);
     uint64_t _last_write_time;
 
     void try_initialise(void);
@@ -28,6 +28,7 @@
 #include <SITL.h>
 #include <AP_Notify.h>
 #include <AP_AHRS.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_ADC_AnalogSource.h>
@@ -75,6 +75,11 @@ void VRBRAINScheduler::init(void *unused)
 	pthread_create(&_io_thread_ctx, &thread_attr, (pthread_startroutine_t)&VRBRAIN::VRBRAINScheduler::_io_thread, this);
 }
 
+uint64_t VRBRAINScheduler::micros64()
+{
+    return hrt_absolute_time() - _sketch_start_time;
+}
+
 uint32_t VRBRAINScheduler::micros()
 {
     return (uint32_t)(hrt_absolute_time() - _sketch_start_time);
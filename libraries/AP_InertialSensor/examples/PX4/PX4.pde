@@ -24,6 +24,7 @@
 #include <GCS_MAVLink.h>
 #include <AP_Mission.h>
 #include <AP_AHRS.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_ADC_AnalogSource.h>
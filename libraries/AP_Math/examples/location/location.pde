@@ -25,6 +25,7 @@
 #include <AP_AHRS.h>
 #include <SITL.h>
 #include <AP_NavEKF.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_ADC_AnalogSource.h>
@@ -26,6 +26,7 @@
 #include <AP_Declination.h> // ArduPilot Mega Declination Helper Library
 #include <AP_AHRS.h>
 #include <AP_NavEKF.h>
+#include <AP_Buffer.h>
 #include <AP_Airspeed.h>
 #include <AP_Vehicle.h>
 #include <AP_ADC_AnalogSource.h>
@@ -27,6 +27,7 @@
 #include <AP_Airspeed.h>
 #include <AP_Compass.h>
 #include <AP_Param.h>
+#include <AP_Buffer.h>
 
 // #define MATH_CHECK_INDEXES 1
 
@@ -36,11 +37,55 @@
 #include <systemlib/perf_counter.h>
 #endif
 
+/*
+  calculate only the upper triangle of the predicted covariance matrix
+  and mirror it, rather than calculating all of it and averaging the
+  two triangles. Set to 0 to get the full calculation for comparison
+ */
+#ifndef EKF_SYMMETRIC_PREDICTION
+#define EKF_SYMMETRIC_PREDICTION 1
+#endif
+
+// alignment of the covariance matrices, so the copy loops over them
+// can be vectorised on CPUs with SIMD units
+#define EKF_MATRIX_ALIGN __attribute__((aligned(16)))
+
+/*
+  the state history used to recall the states at the time of delayed
+  measurements. The history covers EKF_STATE_HISTORY_SIZE samples
+  spaced at least EKF_STATE_HISTORY_MS apart, which limits the longest
+  sensor delay that can be compensated
+ */
+#ifndef EKF_STATE_HISTORY_SIZE
+#define EKF_STATE_HISTORY_SIZE 50
+#endif
+#ifndef EKF_STATE_HISTORY_MS
+#define EKF_STATE_HISTORY_MS 10
+#endif
+
+/*
+  the filter runs on a delayed fusion time horizon, the largest of the
+  sensor delays, so that measurements are fused in time order against
+  the states at the time they were taken. IMU data and measurements
+  are buffered until the filter reaches them, and an output predictor
+  propagates the outputs from the horizon to the newest IMU data.
+  EKF_IMU_BUFFER_SIZE samples limits how far back the horizon can be
+  at high IMU rates, after which measurements are fused against
+  recalled states as they would be without the horizon
+ */
+#ifndef EKF_IMU_BUFFER_SIZE
+#define EKF_IMU_BUFFER_SIZE 64
+#endif
+#define EKF_OBS_BUFFER_SIZE 16
+
 
 class AP_AHRS;
 
 class NavEKF
 {
+    // the covariance benchmark example drives the prediction directly
+    friend class NavEKF_Benchmark;
+
 public:
     typedef float ftype;
 #if MATH_CHECK_INDEXES
@@ -72,20 +117,65 @@ public:
     typedef ftype Matrix31_50[31][50];
 #endif
 
+    /*
+      the sensor data and vehicle state used by the filter. The filter
+      only reads the sensor drivers and AHRS in CaptureInputs(), so an
+      update can run on a different thread to the drivers by capturing
+      the inputs on the driver thread and passing them across
+     */
+    struct sensor_inputs {
+        uint32_t    imuTime_ms;         // time the IMU data was read
+        float       dtIMU;              // IMU delta time (sec)
+        Vector3f    accel;              // primary accelerometer (m/s^2)
+        Vector3f    accel1;             // IMU1 accelerometer, or primary if either is unhealthy (m/s^2)
+        Vector3f    accel2;             // IMU2 accelerometer, or primary if either is unhealthy (m/s^2)
+        Vector3f    gyro;               // average of the healthy gyros (rad/s)
+        uint8_t     gpsStatus;          // AP_GPS::GPS_Status
+        bool        gpsHaveVertVel;     // true if the GPS reports vertical velocity
+        uint32_t    gpsTime_ms;         // time of the last GPS message
+        Vector3f    gpsVelocity;        // GPS NED velocity (m/s)
+        struct Location gpsLocation;
+        struct Location home;
+        uint32_t    baroTime_ms;        // time of the last baro update
+        float       baroAltitude;       // baro altitude relative to the ground (m)
+        bool        useCompass;         // true if the compass is used for yaw
+        uint32_t    magTime_us;         // time of the last compass update
+        Vector3f    magOffsets;         // compass offsets (milligauss)
+        Vector3f    magField;           // compass field (milligauss)
+        float       magDeclination;     // declination (rad)
+        bool        useAirspeed;        // true if the airspeed sensor is used
+        uint32_t    airspeedTime_ms;    // time of the last airspeed update
+        float       airspeed;           // equivalent airspeed (m/s)
+        float       EAS2TAS;            // equivalent to true airspeed ratio
+        float       roll;               // AHRS roll, used to initialise the attitude (rad)
+        float       pitch;              // AHRS pitch, used to initialise the attitude (rad)
+        Vector3f    trim;               // AHRS trim (rad)
+        bool        staticModeDemanded; // true if the vehicle requires static mode
+        bool        assumeZeroSideslip; // true if sideslip may be assumed to be zero
+    };
+
     // Constructor
     NavEKF(const AP_AHRS *ahrs, AP_Baro &baro);
 
+    // read the sensor data and vehicle state for a filter update or initialisation
+    void CaptureInputs(sensor_inputs &in) const;
+
     // This function is used to initialise the filter whilst moving, using the AHRS DCM solution
     // It should NOT be used to re-initialise after a timeout as DCM will also be corrupted
     void InitialiseFilterDynamic(void);
+    void InitialiseFilterDynamic(const sensor_inputs &in);
 
     // Initialise the states from accelerometer and magnetometer data (if present)
     // This method can only be used when the vehicle is static
     void InitialiseFilterBootstrap(void);
+    void InitialiseFilterBootstrap(const sensor_inputs &in);
 
     // Update Filter States - this should be called whenever new IMU data is available
     void UpdateFilter(void);
 
+    // Update Filter States using inputs captured with CaptureInputs()
+    void UpdateFilter(const sensor_inputs &in);
+
     // Check basic filter health metrics and return a consolidated health status
     bool healthy(void) const;
 
@@ -95,11 +185,11 @@ public:
     // return true if filter is dead-reckoning position
     bool PositionDrifting(void) const;
 
-    // return the last calculated NED position relative to the reference point (m).
+    // return the NED position relative to the reference point (m) at the time of the latest IMU data.
     // return false if no position is available
     bool getPosNED(Vector3f &pos) const;
 
-    // return NED velocity in m/s
+    // return NED velocity in m/s at the time of the latest IMU data
     void getVelNED(Vector3f &vel) const;
 
     // return body axis gyro bias estimates in rad/sec
@@ -117,13 +207,13 @@ public:
     // return body magnetic field estimates in measurement units / 1000
     void getMagXYZ(Vector3f &magXYZ) const;
 
-    // return the last calculated latitude, longitude and height
+    // return the latitude, longitude and height at the time of the latest IMU data
     bool getLLH(struct Location &loc) const;
 
-    // return the Euler roll, pitch and yaw angle in radians
+    // return the Euler roll, pitch and yaw angle in radians at the time of the latest IMU data
     void getEulerAngles(Vector3f &eulers) const;
 
-    // return the transformation matrix from XYZ (body) to NED axes
+    // return the transformation matrix from XYZ (body) to NED axes at the time of the latest IMU data
     void getRotationBodyToNED(Matrix3f &mat) const;
 
     // return the quaternions defining the rotation from NED to XYZ (body) axes
@@ -140,6 +230,7 @@ public:
 private:
     const AP_AHRS *_ahrs;
     AP_Baro &_baro;
+    sensor_inputs _in;              // inputs to the current update
 
     // the states are available in two forms, either as a Vector27, or
     // broken down as individual elements. Both are equivalent (same
@@ -161,6 +252,90 @@ private:
         float       posD2;          // 30
     } &state;
 
+    // IMU data, integrated to delta angles and velocities
+    struct imu_elements {
+        uint32_t    time_ms;        // time the IMU data was read (msec)
+        float       dt;             // time since the previous IMU data (sec)
+        Vector3f    delAng;         // delta angles about the XYZ body axes (rad)
+        Vector3f    delVel1;        // IMU1 delta velocities along the XYZ body axes (m/s)
+        Vector3f    delVel2;        // IMU2 delta velocities along the XYZ body axes (m/s)
+    };
+
+    // output predictor states
+    struct output_elements {
+        Quaternion  quat;
+        Vector3f    velocity;
+        Vector3f    position;
+    };
+
+    // IMU data waiting for the fusion time horizon, along with the output
+    // predictor states at the same time
+    struct horizon_elements {
+        imu_elements    imu;
+        output_elements output;
+    };
+
+    // measurements waiting for the fusion time horizon, time stamped with
+    // the time of the IMU data they were read with
+    struct gps_elements {
+        uint32_t    time_ms;
+        Vector3f    velocity;
+        struct Location location;
+        bool        haveVertVel;
+    };
+    struct baro_elements {
+        uint32_t    time_ms;
+        float       height;
+    };
+    struct mag_elements {
+        uint32_t    time_ms;
+        Vector3f    field;
+        Vector3f    offsets;
+    };
+    struct tas_elements {
+        uint32_t    time_ms;
+        float       tas;
+    };
+
+    // run the filter with the oldest buffered IMU data
+    void UpdateDelayedStates();
+
+    // read new measurements into the buffers that hold them until the fusion time horizon
+    void StoreMeasurements();
+
+    // time from the fusion time horizon to the latest IMU data (msec)
+    uint16_t fusionHorizon_ms() const;
+
+    // take the newest measurement that the fusion time horizon has reached, if any.
+    // delay_ms is the delay of the measurement relative to the IMU data
+    template <typename T, uint8_t N>
+    bool recallMeasurement(AP_Buffer<T,N> &buf, uint16_t delay_ms, T &meas) const {
+        bool found = false;
+        while (!buf.is_empty() && (int32_t)(IMUmsec + delay_ms - buf.front().time_ms) >= 0) {
+            meas = buf.pop_front();
+            found = true;
+        }
+        return found;
+    }
+
+    // propagate the output predictor with the latest IMU data and buffer it
+    void UpdateOutputPredictor();
+
+    // steer the output predictor towards the filter states at the fusion time horizon
+    void CorrectOutputPredictor();
+
+    // apply a reset of the velocity and position states to the output predictor
+    void AlignOutputPredictor();
+
+    // set the output predictor to the filter states and empty the IMU buffer
+    void ResetOutputPredictor();
+
+    // quaternion product a*b
+    static Quaternion quatProduct(const Quaternion &a, const Quaternion &b);
+
+    // quaternion for a rotation vector (rad)
+    static Quaternion rotVecToQuat(const Vector3f &rotVec);
+
     // update the quaternion, velocity and position states using IMU measurements
     void UpdateStrapdownEquationsNED();
 
@@ -173,6 +348,15 @@ private:
     // copy covariances across from covariance prediction calculation and fix numerical errors
     void CopyAndFixCovariances();
 
+    // predicted covariance between states i and j, for i > j
+    ftype nextPOffDiag(uint8_t i, uint8_t j) const {
+#if EKF_SYMMETRIC_PREDICTION
+        return nextP[j][i];
+#else
+        return 0.5f*(nextP[i][j] + nextP[j][i]);
+#endif
+    }
+
     // constrain variances (diagonal terms) in the state covariance matrix
     void ConstrainVariances();
 
@@ -191,6 +375,14 @@ private:
     // fuse sythetic sideslip measurement of zero
     void FuseSideslip();
 
+    // update the state covariance matrix after fusing an observation with sparse Jacobian H
+    void UpdateCovariance(const Vector22 &H, uint32_t Hmask, uint8_t indexLimit);
+
+    // bitmask of the states first to last, for describing the non-zero elements of H
+    static uint32_t stateMask(uint8_t first, uint8_t last) {
+        return ((1UL << (last + 1)) - 1) & ~((1UL << first) - 1);
+    }
+
     // zero specified range of rows in the state covariance matrix
     void zeroRows(Matrix22 &covMat, uint8_t first, uint8_t last);
 
@@ -203,9 +395,14 @@ private:
     // Reset the stored state history and store the current state
     void StoreStatesReset(void);
 
-    // recall state vector stored at closest time to the one specified by msec
+    // recall state vector at the time specified by msec, interpolating between stored states
     void RecallStates(state_elements &statesForFusion, uint32_t msec);
 
+    // index into storedStates of the n'th oldest stored state
+    uint16_t storedStateIndex(uint16_t n) const {
+        return (storeIndex + EKF_STATE_HISTORY_SIZE - storeCount + n) % EKF_STATE_HISTORY_SIZE;
+    }
+
     // calculate nav to body quaternions from body to nav rotation matrix
     void quat2Tbn(Matrix3f &Tbn, const Quaternion &quat) const;
 
@@ -218,7 +415,7 @@ private:
     // initialise the covariance matrix
     void CovarianceInit();
 
-    // update IMU delta angle and delta velocity measurements
+    // integrate the latest IMU data to delta angles and velocities
     void readIMUData();
 
     // check for new valid GPS data and update stored measurement if available
@@ -341,11 +538,9 @@ private:
     bool magTimeout;                // boolean true if magnetometer measurements have failed for too long and have timed out
 
     Vector31 Kfusion;               // Kalman gain vector
-    Matrix22 KH;                    // intermediate result used for covariance updates
-    Matrix22 KHP;                   // intermediate result used for covariance updates
-    Matrix22 P;                     // covariance matrix
-    VectorN<state_elements,50> storedStates;       // state vectors stored for the last 50 time steps
-    uint32_t statetimeStamp[50];    // time stamp for each state vector stored
+    Matrix22 P EKF_MATRIX_ALIGN;    // covariance matrix
+    state_elements storedStates[EKF_STATE_HISTORY_SIZE]; // ring buffer of past state vectors, oldest first from storedStateIndex(0)
+    uint32_t statetimeStamp[EKF_STATE_HISTORY_SIZE]; // time stamp for each state vector stored
     Vector3f correctedDelAng;       // delta angles about the xyz body axes corrected for errors (rad)
     Vector3f correctedDelVel12;     // delta velocities along the XYZ body axes for weighted average of IMU1 and IMU2 corrected for errors (m/s)
     Vector3f correctedDelVel1;      // delta velocities along the XYZ body axes for IMU1 corrected for errors (m/s)
@@ -421,7 +616,8 @@ private:
     uint32_t velFailTime;           // time stamp when GPS velocity measurement last failed covaraiance consistency check (msec)
     uint32_t posFailTime;           // time stamp when GPS position measurement last failed covaraiance consistency check (msec)
     uint32_t hgtFailTime;           // time stamp when height measurement last failed covaraiance consistency check (msec)
-    uint8_t storeIndex;             // State vector storage index
+    uint16_t storeIndex;            // State vector storage index of the next state to be stored
+    uint16_t storeCount;            // number of states stored in the history
     uint32_t lastStateStoreTime_ms; // time of last state vector storage
     uint32_t lastFixTime_ms;        // time of last GPS fix used to determine if new data has arrived
     uint32_t secondLastFixTime_ms;  // time of second last GPS fix used to determine how long since last update
@@ -429,7 +625,19 @@ private:
     Vector3f lastAngRate;           // angular rate from previous IMU sample used for trapezoidal integrator
     Vector3f lastAccel1;            // acceleration from previous IMU1 sample used for trapezoidal integrator
     Vector3f lastAccel2;            // acceleration from previous IMU2 sample used for trapezoidal integrator
-    Matrix22 nextP;                 // Predicted covariance matrix before addition of process noise to diagonals
+    imu_elements imuDataNew;        // latest IMU data
+    AP_Buffer<horizon_elements, EKF_IMU_BUFFER_SIZE> imuBuffer; // IMU data and outputs waiting for the fusion time horizon
+    AP_Buffer<gps_elements, EKF_OBS_BUFFER_SIZE> gpsBuffer;     // GPS measurements waiting for the fusion time horizon
+    AP_Buffer<baro_elements, EKF_OBS_BUFFER_SIZE> baroBuffer;   // height measurements waiting for the fusion time horizon
+    AP_Buffer<mag_elements, EKF_OBS_BUFFER_SIZE> magBuffer;     // magnetometer measurements waiting for the fusion time horizon
+    AP_Buffer<tas_elements, EKF_OBS_BUFFER_SIZE> tasBuffer;     // airspeed measurements waiting for the fusion time horizon
+    uint32_t lastGpsMsgTime_ms;     // time of last GPS message used to determine if new data has arrived
+    output_elements outputState;    // output predictor states at the time of the latest IMU data
+    output_elements outputDelayed;  // output predictor states at the fusion time horizon
+    Vector3f outputVelOffset;       // velocity corrections made to the buffered outputs since they were buffered (m/s)
+    Vector3f outputPosOffset;       // position corrections made to the buffered outputs since they were buffered (m)
+    Vector3f delAngCorrection;      // delta angle added to each IMU sample to steer the output attitude to the filter (rad)
+    Matrix22 nextP EKF_MATRIX_ALIGN; // Predicted covariance matrix before addition of process noise to diagonals
     Vector22 processNoise;          // process noise added to diagonals of predicted covariance matrix
     Vector15 SF;                    // intermediate variables used to calculate predicted covariance matrix
     Vector8 SG;                     // intermediate variables used to calculate predicted covariance matrix
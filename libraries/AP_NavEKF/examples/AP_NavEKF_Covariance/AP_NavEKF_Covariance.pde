@@ -0,0 +1,182 @@
+/// -*- tab-width: 4; Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+/*
+  benchmark of the EKF covariance prediction
+
+  Runs the covariance prediction on a slowly turning, accelerating
+  vehicle and reports the time and CPU cycles per call, along with a
+  digest of the final covariance matrix.
+
+  To compare the symmetric prediction with the full calculation, build
+  once as normal and once with
+    make linux EXTRAFLAGS=-DEKF_SYMMETRIC_PREDICTION=0
+  The digests of the two builds should agree to float precision
+ */
+
+// Libraries
+#include <AP_HAL.h>
+#include <AP_HAL_AVR.h>
+#include <AP_HAL_AVR_SITL.h>
+#include <AP_HAL_Empty.h>
+#include <AP_HAL_PX4.h>
+#include <AP_HAL_Linux.h>
+
+#include <AP_Common.h>
+#include <AP_Param.h>
+#include <AP_Progmem.h>
+#include <AP_Math.h>
+#include <AP_ADC.h>
+#include <AP_ADC_AnalogSource.h>
+#include <AP_InertialSensor.h>
+#include <AP_Baro.h>
+#include <AP_GPS.h>
+#include <AP_Compass.h>
+#include <AP_Declination.h>
+#include <AP_Airspeed.h>
+#include <AP_AHRS.h>
+#include <AP_NavEKF.h>
+#include <Filter.h>
+#include <AP_Buffer.h>
+#include <AP_Notify.h>
+#include <AP_Vehicle.h>
+#include <AP_Mission.h>
+#include <GCS_MAVLink.h>
+#include <DataFlash.h>
+#include <SITL.h>
+
+const AP_HAL::HAL& hal = AP_HAL_BOARD_DRIVER;
+
+#if HAL_CPU_CLASS >= HAL_CPU_CLASS_150
+
+static AP_InertialSensor_HIL ins;
+static AP_Baro_HIL baro;
+static AP_GPS gps;
+static AP_AHRS_DCM ahrs(ins, baro, gps);
+static NavEKF ekf(&ahrs, baro);
+
+#define NUM_CALLS 2000
+
+// time between covariance predictions in seconds
+#define PREDICTION_DT 0.02f
+
+#if defined(__i386__) || defined(__x86_64__)
+#define HAVE_CYCLE_COUNTER 1
+static uint64_t cycles(void) { return __builtin_ia32_rdtsc(); }
+#else
+#define HAVE_CYCLE_COUNTER 0
+static uint64_t cycles(void) { return 0; }
+#endif
+
+/*
+  access to the EKF internals needed to drive the prediction step
+  without sensors
+ */
+class NavEKF_Benchmark
+{
+public:
+    // start from the initial covariances, level and heading north at 15m/s
+    static void init(NavEKF &ekf) {
+        memset(ekf.states, 0, sizeof(ekf.states));
+        ekf.states[0] = 1.0f;
+        ekf.states[4] = 15.0f;
+        ekf.states[16] = 0.22f;
+        ekf.states[18] = -0.53f;
+        ekf.CovarianceInit();
+        ekf.hgtRate = 0.0f;
+        ekf.onGround = false;
+        ekf.staticMode = false;
+        ekf.dtIMU = 0.01f;
+    }
+
+    // run one prediction for step n, returning the cycles taken
+    static uint32_t predict(NavEKF &ekf, uint16_t n) {
+        float t = n * PREDICTION_DT;
+        ekf.dt = PREDICTION_DT;
+        ekf.summedDelAng = Vector3f(0.02f * sinf(t), 0.01f * cosf(0.5f * t), 0.1f) * PREDICTION_DT;
+        ekf.summedDelVel = Vector3f(1.5f * cosf(t), 1.5f * sinf(t), -9.81f) * PREDICTION_DT;
+
+        // bank and turn so the quaternion terms all contribute
+        Quaternion q;
+        q.from_euler(0.3f * sinf(0.2f * t), 0.1f * cosf(0.2f * t), 0.1f * t);
+        ekf.states[0] = q.q1;
+        ekf.states[1] = q.q2;
+        ekf.states[2] = q.q3;
+        ekf.states[3] = q.q4;
+
+        uint64_t start = cycles();
+        ekf.CovariancePrediction();
+        return (uint32_t)(cycles() - start);
+    }
+
+    // sum and largest magnitude of the covariance terms
+    static void digest(const NavEKF &ekf, double &trace, double &sum, float &maxterm) {
+        trace = sum = 0;
+        maxterm = 0;
+        for (uint8_t i=0; i<=21; i++) {
+            trace += ekf.P[i][i];
+            for (uint8_t j=0; j<=21; j++) {
+                sum += fabsf(ekf.P[i][j]);
+                if (fabsf(ekf.P[i][j]) > maxterm) {
+                    maxterm = fabsf(ekf.P[i][j]);
+                }
+            }
+        }
+    }
+};
+
+void setup()
+{
+    ahrs.set_fly_forward(true);
+
+    hal.console->println("EKF covariance prediction benchmark");
+}
+
+void loop()
+{
+    hal.console->printf("%s prediction, %u calls\n",
+                        EKF_SYMMETRIC_PREDICTION ? "Symmetric" : "Full",
+                        (unsigned)NUM_CALLS);
+
+    NavEKF_Benchmark::init(ekf);
+    uint64_t total_cycles = 0;
+    uint32_t min_cycles = 0xFFFFFFFF;
+    uint32_t start = hal.scheduler->micros();
+    for (uint16_t n=0; n<NUM_CALLS; n++) {
+        uint32_t c = NavEKF_Benchmark::predict(ekf, n);
+        total_cycles += c;
+        if (c < min_cycles) {
+            min_cycles = c;
+        }
+    }
+    uint32_t usec = hal.scheduler->micros() - start;
+
+    hal.console->printf("%.2f us per call\n", usec / (float)NUM_CALLS);
+#if HAVE_CYCLE_COUNTER
+    hal.console->printf("%lu cycles per call, %lu minimum\n",
+                        (unsigned long)(total_cycles / NUM_CALLS),
+                        (unsigned long)min_cycles);
+#endif
+
+    double trace, sum;
+    float maxterm;
+    NavEKF_Benchmark::digest(ekf, trace, sum, maxterm);
+    hal.console->printf("trace %.3f sum %.3f max %.3f\n", trace, sum, maxterm);
+
+    hal.console->println("Test will repeat in 5 seconds");
+    hal.scheduler->delay(5000);
+}
+
+#else
+
+void setup()
+{
+    hal.console->println("The EKF is not supported on this board");
+}
+
+void loop()
+{
+    hal.scheduler->delay(1000);
+}
+
+#endif // HAL_CPU_CLASS
+
+AP_HAL_MAIN();
@@ -24,8 +24,26 @@
 #include <AP_Scheduler.h>
 #include <AP_Param.h>
 
+#if AP_SCHEDULER_WORKERS
+#include <sched.h>
+#include <unistd.h>
+
+// worker threads run below the main thread priority
+#define AP_SCHEDULER_WORKER_PRIORITY 10
+#endif
+
 extern const AP_HAL::HAL& hal;
 
+#if AP_SCHEDULER_WORKERS
+/*
+  deadline of the task running on the current worker thread, used by
+  time_available_usec() when called from a worker
+ */
+static __thread bool worker_in_task;
+static __thread uint32_t worker_task_started;
+static __thread uint32_t worker_task_allowed;
+#endif
+
 const AP_Param::GroupInfo AP_Scheduler::var_info[] PROGMEM = {
     // @Param: DEBUG
     // @DisplayName: Scheduler debug level
@@ -33,6 +51,25 @@ const AP_Param::GroupInfo AP_Scheduler::var_info[] PROGMEM = {
     // @Values: 0:Disabled,2:ShowSlips,3:ShowOverruns
     // @User: Advanced
     AP_GROUPINFO("DEBUG",    0, AP_Scheduler, _debug, 0),
+
+#if AP_SCHEDULER_WORKERS
+    // @Param: WORKERS
+    // @DisplayName: Scheduler worker threads
+    // @Description: Number of worker threads used to run tasks that are flagged as safe to run concurrently with the main loop. Each worker is pinned to a CPU other than the first one. Set to 0 to run all tasks on the main thread. Takes effect on reboot.
+    // @Range: 0 3
+    // @User: Advanced
+    AP_GROUPINFO("WORKERS",  1, AP_Scheduler, _num_workers, 0),
+#endif
+
+#if AP_SCHEDULER_TIMER_SPEED
+    // @Param: TIMER_HZ
+    // @DisplayName: Scheduler timer rate
+    // @Description: Rate of the timer thread that polls the sensors, such as the IMU. Set to 0 for the board default of 200Hz. Takes effect on reboot.
+    // @Units: Hz
+    // @Range: 0 4000
+    // @User: Advanced
+    AP_GROUPINFO("TIMER_HZ", 2, AP_Scheduler, _timer_hz, 0),
+#endif
     AP_GROUPEND
 };
 
@@ -44,6 +81,17 @@ void AP_Scheduler::init(const AP_Scheduler::Task *tasks, uint8_t num_tasks)
     _last_run = new uint16_t[_num_tasks];
     memset(_last_run, 0, sizeof(_last_run[0]) * _num_tasks);
     _tick_counter = 0;
+#if AP_SCHEDULER_TASK_STATS
+    reset_task_stats();
+#endif
+#if AP_SCHEDULER_TIMER_SPEED
+    if (_timer_hz > 0) {
+        hal.scheduler->set_timer_speed(_timer_hz);
+    }
+#endif
+#if AP_SCHEDULER_WORKERS
+    start_workers();
+#endif
 }
 
 // one tick has passed
@@ -70,6 +118,11 @@ void AP_Scheduler::run(uint16_t time_available)
 
             if (dt >= interval_ticks*2) {
                 // we've slipped a whole run of this task!
+#if AP_SCHEDULER_TASK_STATS
+                if (i < AP_SCHEDULER_MAX_TASK_STATS) {
+                    _task_stats[i].slips++;
+                }
+#endif
                 if (_debug > 1) {
                     hal.console->printf_P(PSTR("Scheduler slip task[%u] (%u/%u/%u)\n"), 
                                           (unsigned)i, 
@@ -78,6 +131,19 @@ void AP_Scheduler::run(uint16_t time_available)
                                           (unsigned)_task_time_allowed);
                 }
             }
+
+#if AP_SCHEDULER_WORKERS
+            if (_worker_state != NULL &&
+                (pgm_read_byte(&_tasks[i].flags) & AP_SCHEDULER_FLAG_WORKER)) {
+                // hand it to the worker pool. If the previous run
+                // has not finished yet we try again on the next
+                // tick, which shows up as a slip if it persists
+                if (dispatch_to_worker(i)) {
+                    _last_run[i] = _tick_counter;
+                }
+                continue;
+            }
+#endif
             
             if (_task_time_allowed <= time_available) {
                 // run it
@@ -92,9 +158,18 @@ void AP_Scheduler::run(uint16_t time_available)
                 // work out how long the event actually took
                 now = hal.scheduler->micros();
                 uint32_t time_taken = now - _task_time_started;
+
+#if AP_SCHEDULER_TASK_STATS
+                update_task_stats(i, time_taken);
+#endif
                 
                 if (time_taken > _task_time_allowed) {
                     // the event overran!
+#if AP_SCHEDULER_TASK_STATS
+                    if (i < AP_SCHEDULER_MAX_TASK_STATS) {
+                        _task_stats[i].overruns++;
+                    }
+#endif
                     if (_debug > 2) {
                         hal.console->printf_P(PSTR("Scheduler overrun task[%u] (%u/%u)\n"), 
                                               (unsigned)i, 
@@ -126,6 +201,15 @@ update_spare_ticks:
  */
 uint16_t AP_Scheduler::time_available_usec(void)
 {
+#if AP_SCHEDULER_WORKERS
+    if (worker_in_task) {
+        uint32_t wdt = hal.scheduler->micros() - worker_task_started;
+        if (wdt > worker_task_allowed) {
+            return 0;
+        }
+        return worker_task_allowed - wdt;
+    }
+#endif
     uint32_t dt = hal.scheduler->micros() - _task_time_started;
     if (dt > _task_time_allowed) {
         return 0;
@@ -144,3 +228,199 @@ float AP_Scheduler::load_average(uint32_t tick_time_usec) const
     uint32_t used_time = tick_time_usec - (_spare_micros/_spare_ticks);
     return used_time / (float)tick_time_usec;
 }
+
+#if AP_SCHEDULER_TASK_STATS
+/*
+  record the execution time of one run of a task
+ */
+void AP_Scheduler::update_task_stats(uint8_t task, uint32_t time_taken)
+{
+    if (task >= AP_SCHEDULER_MAX_TASK_STATS) {
+        return;
+    }
+    struct task_stats &stats = _task_stats[task];
+    stats.count++;
+    stats.total_time_us += time_taken;
+    if (time_taken > stats.max_time_us) {
+        stats.max_time_us = time_taken;
+    }
+
+    // find the log2 bucket, starting at 16us
+    uint8_t bucket = 0;
+    time_taken >>= 4;
+    while (time_taken != 0 && bucket < AP_SCHEDULER_HIST_BUCKETS-1) {
+        time_taken >>= 1;
+        bucket++;
+    }
+    if (stats.histogram[bucket] != 0xFFFF) {
+        stats.histogram[bucket]++;
+    }
+}
+
+/*
+  get the statistics for one task
+ */
+bool AP_Scheduler::get_task_stats(uint8_t task, struct task_stats &stats) const
+{
+    if (task >= _num_tasks || task >= AP_SCHEDULER_MAX_TASK_STATS) {
+        return false;
+    }
+    stats = _task_stats[task];
+    return true;
+}
+
+void AP_Scheduler::reset_task_stats(void)
+{
+#if AP_SCHEDULER_WORKERS
+    if (_worker_state != NULL) {
+        pthread_mutex_lock(&_worker_mutex);
+        memset(_task_stats, 0, sizeof(_task_stats));
+        pthread_mutex_unlock(&_worker_mutex);
+        return;
+    }
+#endif
+    memset(_task_stats, 0, sizeof(_task_stats));
+}
+#endif // AP_SCHEDULER_TASK_STATS
+
+#if AP_SCHEDULER_WORKERS
+/*
+  start the worker pool. Workers are pinned to CPUs 1 to N so that
+  CPU 0 is left for the main loop
+ */
+void AP_Scheduler::start_workers(void)
+{
+    _worker_state = NULL;
+
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int8_t nworkers = _num_workers;
+    if (nworkers > AP_SCHEDULER_MAX_WORKERS) {
+        nworkers = AP_SCHEDULER_MAX_WORKERS;
+    }
+    if (ncpus > 1 && nworkers > ncpus-1) {
+        nworkers = ncpus-1;
+    }
+    if (nworkers <= 0 || ncpus <= 1) {
+        return;
+    }
+
+    uint8_t num_flagged = 0;
+    for (uint8_t i=0; i<_num_tasks; i++) {
+        if (pgm_read_byte(&_tasks[i].flags) & AP_SCHEDULER_FLAG_WORKER) {
+            num_flagged++;
+        }
+    }
+    if (num_flagged == 0) {
+        return;
+    }
+
+    // the main thread may block on this mutex, so use priority
+    // inheritance to avoid being held up by a low priority worker
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&_worker_mutex, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    pthread_cond_init(&_worker_cond, NULL);
+
+    uint8_t *state = new uint8_t[_num_tasks];
+    memset(state, WORKER_TASK_IDLE, _num_tasks);
+
+    uint8_t started = 0;
+    for (uint8_t w=0; w<nworkers; w++) {
+        pthread_attr_t thread_attr;
+        struct sched_param param;
+        cpu_set_t cpus;
+
+        pthread_attr_init(&thread_attr);
+        param.sched_priority = AP_SCHEDULER_WORKER_PRIORITY;
+        (void)pthread_attr_setschedparam(&thread_attr, &param);
+        pthread_attr_setschedpolicy(&thread_attr, SCHED_FIFO);
+        CPU_ZERO(&cpus);
+        CPU_SET(w+1, &cpus);
+        (void)pthread_attr_setaffinity_np(&thread_attr, sizeof(cpus), &cpus);
+
+        if (pthread_create(&_worker_ctx[w], &thread_attr, &AP_Scheduler::worker_thread, this) == 0) {
+            started++;
+        }
+        pthread_attr_destroy(&thread_attr);
+    }
+
+    if (started == 0) {
+        delete[] state;
+        return;
+    }
+    _worker_state = state;
+    hal.console->printf_P(PSTR("Scheduler: %u workers for %u tasks\n"),
+                          (unsigned)started, (unsigned)num_flagged);
+}
+
+/*
+  queue a task for the worker pool. Returns false if the previous
+  run of the task is still queued or running
+ */
+bool AP_Scheduler::dispatch_to_worker(uint8_t task)
+{
+    bool queued = false;
+    pthread_mutex_lock(&_worker_mutex);
+    if (_worker_state[task] == WORKER_TASK_IDLE) {
+        _worker_state[task] = WORKER_TASK_QUEUED;
+        pthread_cond_signal(&_worker_cond);
+        queued = true;
+    }
+    pthread_mutex_unlock(&_worker_mutex);
+    return queued;
+}
+
+void *AP_Scheduler::worker_thread(void *arg)
+{
+    ((AP_Scheduler *)arg)->worker_loop();
+    return NULL;
+}
+
+/*
+  main loop of a worker thread. Each task is only ever queued once,
+  so a task never runs on two workers at the same time
+ */
+void AP_Scheduler::worker_loop(void)
+{
+    pthread_mutex_lock(&_worker_mutex);
+    while (true) {
+        uint8_t i;
+        for (i=0; i<_num_tasks; i++) {
+            if (_worker_state[i] == WORKER_TASK_QUEUED) {
+                break;
+            }
+        }
+        if (i == _num_tasks) {
+            pthread_cond_wait(&_worker_cond, &_worker_mutex);
+            continue;
+        }
+        _worker_state[i] = WORKER_TASK_RUNNING;
+        pthread_mutex_unlock(&_worker_mutex);
+
+        worker_task_allowed = pgm_read_word(&_tasks[i].max_time_micros);
+        worker_task_started = hal.scheduler->micros();
+        worker_in_task = true;
+        task_fn_t func = (task_fn_t)pgm_read_pointer(&_tasks[i].function);
+        func();
+        worker_in_task = false;
+        uint32_t time_taken = hal.scheduler->micros() - worker_task_started;
+
+        pthread_mutex_lock(&_worker_mutex);
+        _worker_state[i] = WORKER_TASK_IDLE;
+#if AP_SCHEDULER_TASK_STATS
+        update_task_stats(i, time_taken);
+        if (time_taken > worker_task_allowed && i < AP_SCHEDULER_MAX_TASK_STATS) {
+            _task_stats[i].overruns++;
+        }
+#endif
+        if (time_taken > worker_task_allowed && _debug > 2) {
+            hal.console->printf_P(PSTR("Scheduler overrun worker task[%u] (%u/%u)\n"),
+                                  (unsigned)i,
+                                  (unsigned)time_taken,
+                                  (unsigned)worker_task_allowed);
+        }
+    }
+}
+#endif // AP_SCHEDULER_WORKERS
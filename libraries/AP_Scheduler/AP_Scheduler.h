@@ -23,8 +23,50 @@
 #ifndef AP_SCHEDULER_H
 #define AP_SCHEDULER_H
 
+#include <AP_HAL.h>
 #include <AP_Param.h>
 
+// per-task timing statistics cost about 50 bytes per task, so are
+// only kept on boards with RAM to spare
+#if HAL_CPU_CLASS >= HAL_CPU_CLASS_75
+#define AP_SCHEDULER_TASK_STATS 1
+#else
+#define AP_SCHEDULER_TASK_STATS 0
+#endif
+
+// maximum number of tasks we keep statistics for
+#define AP_SCHEDULER_MAX_TASK_STATS 48
+
+// number of buckets in the task execution time histogram. Bucket 0
+// holds runs under 16us, bucket n holds runs of 2^(n+3) to
+// 2^(n+4)-1us, and the last bucket holds everything from 1024us up
+#define AP_SCHEDULER_HIST_BUCKETS 8
+
+// task flag: the task may be run on a worker thread, concurrently
+// with the main loop. Only set this on tasks that share no state with
+// tasks run from the main thread
+#define AP_SCHEDULER_FLAG_WORKER 1
+
+// on Linux boards tasks flagged with AP_SCHEDULER_FLAG_WORKER can be
+// dispatched to a pool of worker threads pinned to the other cores
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+#define AP_SCHEDULER_WORKERS 1
+#include <pthread.h>
+#else
+#define AP_SCHEDULER_WORKERS 0
+#endif
+
+// maximum number of worker threads
+#define AP_SCHEDULER_MAX_WORKERS 3
+
+// on Linux boards the rate of the HAL timer thread, which polls the
+// sensors, is set with SCHED_TIMER_HZ
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+#define AP_SCHEDULER_TIMER_SPEED 1
+#else
+#define AP_SCHEDULER_TIMER_SPEED 0
+#endif
+
 /*
   A task scheduler for APM main loops
 
@@ -44,6 +86,7 @@ public:
 		task_fn_t function;
 		uint16_t interval_ticks;
 		uint16_t max_time_micros;
+		uint8_t flags;
 	};
 
 	// initialise scheduler
@@ -60,6 +103,14 @@ public:
 	// return the number of microseconds available for the current task
 	uint16_t time_available_usec(void);
 
+    // return true if flagged tasks are being run on worker threads,
+    // so must not also be called from the main thread
+#if AP_SCHEDULER_WORKERS
+    bool using_workers(void) const { return _worker_state != NULL; }
+#else
+    bool using_workers(void) const { return false; }
+#endif
+
     // return debug parameter
     uint8_t debug(void) { return _debug; }
 
@@ -70,6 +121,31 @@ public:
 
 	static const struct AP_Param::GroupInfo var_info[];
 
+#if AP_SCHEDULER_TASK_STATS
+    /*
+      execution statistics for one task, accumulated since the last
+      call to reset_task_stats()
+     */
+    struct task_stats {
+        uint32_t count;
+        uint32_t total_time_us;
+        uint32_t max_time_us;
+        uint16_t slips;
+        uint16_t overruns;
+        uint16_t histogram[AP_SCHEDULER_HIST_BUCKETS];
+    };
+
+    // return the number of tasks in the task table
+    uint8_t num_tasks(void) const { return _num_tasks; }
+
+    // get statistics for one task. Returns false if no statistics
+    // are kept for that task
+    bool get_task_stats(uint8_t task, struct task_stats &stats) const;
+
+    // clear statistics for all tasks
+    void reset_task_stats(void);
+#endif
+
 private:
 	// used to enable scheduler debugging
 	AP_Int8 _debug;
@@ -98,6 +174,41 @@ private:
 
     // number of ticks that _spare_micros is counted over
     uint8_t _spare_ticks;
+
+#if AP_SCHEDULER_TIMER_SPEED
+    // rate of the HAL timer thread in Hz, 0 for the board default
+    AP_Int16 _timer_hz;
+#endif
+
+#if AP_SCHEDULER_WORKERS
+    // number of worker threads to start
+    AP_Int8 _num_workers;
+
+    enum worker_task_state {
+        WORKER_TASK_IDLE    = 0,
+        WORKER_TASK_QUEUED  = 1,
+        WORKER_TASK_RUNNING = 2
+    };
+
+    // state of each task in the worker pool, or NULL if no workers
+    // have been started
+    volatile uint8_t *_worker_state;
+
+    pthread_t _worker_ctx[AP_SCHEDULER_MAX_WORKERS];
+    pthread_mutex_t _worker_mutex;
+    pthread_cond_t _worker_cond;
+
+    void start_workers(void);
+    bool dispatch_to_worker(uint8_t task);
+    void worker_loop(void);
+    static void *worker_thread(void *arg);
+#endif
+
+#if AP_SCHEDULER_TASK_STATS
+    struct task_stats _task_stats[AP_SCHEDULER_MAX_TASK_STATS];
+
+    void update_task_stats(uint8_t task, uint32_t time_taken);
+#endif
 };
 
 #endif // AP_SCHEDULER_H
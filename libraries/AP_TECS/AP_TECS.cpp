@@ -711,6 +711,9 @@ void AP_TECS::update_pitch_throttle(int32_t hgt_dem_cm,
 // log the contents of the log_tuning structure to dataflash
 void AP_TECS::log_data(DataFlash_Class &dataflash, uint8_t msgid)
 {
+    if (!dataflash.ShouldLog(msgid)) {
+        return;
+    }
     log_tuning.head1 = HEAD_BYTE1;
     log_tuning.head2 = HEAD_BYTE2;
     log_tuning.msgid = msgid;
@@ -12,11 +12,57 @@
 #include <AP_InertialSensor.h>
 #include <AP_Baro.h>
 #include <AP_AHRS.h>
+#include <AP_Scheduler.h>
 #include <stdint.h>
 
+/*
+  number of message types that can use the compact encoding at
+  once. Set to 0 to leave the compact encoding out of the build
+ */
+#ifndef DATAFLASH_COMPACT_TYPES
+# if HAL_CPU_CLASS < HAL_CPU_CLASS_75
+#  define DATAFLASH_COMPACT_TYPES 2
+# else
+#  define DATAFLASH_COMPACT_TYPES 8
+# endif
+#endif
+
+// longest message that can use the compact encoding
+#define DATAFLASH_COMPACT_MAX_LEN 64
+
+// a full message is written every this many messages of a compact
+// type, so a reader can recover from lost or corrupt data
+#define DATAFLASH_COMPACT_KEYFRAME 50
+
+// number of compact message types the log reader can decode at once
+#if DATAFLASH_COMPACT_TYPES
+#define DATAFLASH_COMPACT_READ_TYPES DATAFLASH_COMPACT_TYPES
+#else
+#define DATAFLASH_COMPACT_READ_TYPES 1
+#endif
+
+/*
+  per message type rate limiting, set with the LOG_RATEn_MSG and
+  LOG_RATEn_HZ parameters. Set to 0 to leave it out of the build
+ */
+#ifndef DATAFLASH_RATE_LIMIT
+# define DATAFLASH_RATE_LIMIT (HAL_CPU_CLASS >= HAL_CPU_CLASS_75)
+#endif
+
+// number of message types with a rate parameter, and with a default
+// rate set by the vehicle
+#define DATAFLASH_RATE_SLOTS    6
+#define DATAFLASH_RATE_DEFAULTS 4
+
 class DataFlash_Class
 {
 public:
+#if DATAFLASH_RATE_LIMIT
+    DataFlash_Class() {
+        AP_Param::setup_object_defaults(this, var_info);
+    }
+#endif
+
     // initialisation
     virtual void Init(const struct LogStructure *structure, uint8_t num_types);
     virtual bool CardInserted(void) = 0;
@@ -30,6 +76,7 @@ public:
 
     // high level interface
     virtual uint16_t find_last_log(void) = 0;
+    virtual uint16_t find_next_log(uint16_t log_num);
     virtual void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page) = 0;
     virtual void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc) = 0;
     virtual int16_t get_log_data(uint16_t log_num, uint16_t page, uint32_t offset, uint16_t len, uint8_t *data) = 0;
@@ -60,11 +107,82 @@ public:
 #endif
     void Log_Write_MavCmd(uint16_t cmd_total, const mavlink_mission_item_t& mav_cmd);
     void Log_Write_Radio(const mavlink_radio_t &packet);
+#if AP_SCHEDULER_TASK_STATS
+    void Log_Write_Scheduler(const AP_Scheduler &scheduler);
+#endif
+    void Log_Write_Thread_Latency(void);
     void Log_Write_Message(const char *message);
     void Log_Write_Message_P(const prog_char_t *message);
 
+    /*
+      the compact encoding. Message types chosen with SetCompact()
+      are written by WritePacket() as deltas against the previous
+      message of the same type where that is smaller. SetCompact()
+      should be called before StartNewLog(), and returns false if the
+      type can't be compacted or there is no free slot
+     */
+    bool SetCompact(uint8_t msg_type);
+    void SetCompactCommon(void);
+    void ClearCompact(void);
+    void WritePacket(const void *pBuffer, uint16_t size);
+
+    // the compact codec, shared with the log readers
+    static bool compact_encoding(const char *format, uint8_t msg_len, char *encoding);
+    static int16_t compact_encode(const char *encoding, const uint8_t *msg, const uint8_t *ref,
+                                  uint8_t *out, uint8_t max_len);
+    static int16_t compact_decode(const char *encoding, uint8_t msg_len,
+                                  const uint8_t *in, uint16_t in_len, uint8_t *msg);
+
+    /*
+      rate limiting. ShouldLog() is called before a message is
+      built, and returns false if its type has a rate limit and it is
+      too soon for the next one. SetDefaultRate() sets the rate used
+      when the type has no rate parameter, and UpdateRates() picks up
+      parameter changes
+     */
+#if DATAFLASH_RATE_LIMIT
+    bool ShouldLog(uint8_t msg_type) {
+        if ((_rate_mask[msg_type>>5] & (1UL<<(msg_type&31))) == 0) {
+            return true;
+        }
+        return rate_check(msg_type);
+    }
+    void SetDefaultRate(uint8_t msg_type, uint16_t rate_hz);
+    void UpdateRates(void);
+    void Log_Write_Rate_Stats(void);
+
+    static const struct AP_Param::GroupInfo var_info[];
+#else
+    bool ShouldLog(uint8_t) { return true; }
+    void SetDefaultRate(uint8_t, uint16_t) {}
+    void UpdateRates(void) {}
+    void Log_Write_Rate_Stats(void) {}
+#endif
+
     bool logging_started(void) const { return log_write_started; }
 
+#if HAL_OS_POSIX_IO
+    /*
+      statistics for backends that buffer writes, and so may have to
+      drop messages when the storage can't keep up. All counts are
+      since boot
+     */
+    struct write_stats {
+        uint32_t dropped_msgs;
+        uint32_t dropped_bytes;
+        uint32_t bytes_written;
+        uint32_t buf_size;
+        uint32_t buf_min_free;
+        uint32_t fsyncs;
+    };
+    virtual bool get_write_stats(struct write_stats &) const { return false; }
+
+    // number of messages of one type dropped since boot
+    virtual uint16_t get_dropped_msgs(uint8_t) const { return 0; }
+
+    void Log_Write_DataFlash_Stats(void);
+#endif
+
 	/*
       every logged packet starts with 3 bytes
     */
@@ -73,17 +191,49 @@ public:
     };
 
 protected:
+    struct compact_state {
+        uint8_t msg_type;
+        uint8_t msg_len;
+        // writer: messages left before the next full message
+        // reader: non-zero if ref holds the last message of the type
+        uint8_t count;
+        char encoding[16];
+        // the last message, which the next is encoded against
+        uint8_t ref[DATAFLASH_COMPACT_MAX_LEN];
+    };
+
+    /*
+      what a log reader needs to follow the compact messages in a
+      log. Start with num_types zero at the beginning of the log
+     */
+    struct compact_reader {
+        uint8_t num_types;
+        struct compact_state types[DATAFLASH_COMPACT_READ_TYPES];
+    };
+
     /*
-    read and print a log entry using the format strings from the given structure
+    read and print a log entry using the format strings from the given
+    structure. Compact messages are decoded against the previous
+    message of their type held in reader. Returns false if the type is
+    not known, as happens when a damaged part of the log is scanned
     */
-    void _print_log_entry(uint8_t msg_type, 
+    bool _print_log_entry(uint8_t msg_type, struct compact_reader &reader,
                           void (*print_mode)(AP_HAL::BetterStream *port, uint8_t mode),
                           AP_HAL::BetterStream *port);
+    bool _print_compact_entry(struct compact_reader &reader,
+                              void (*print_mode)(AP_HAL::BetterStream *port, uint8_t mode),
+                              AP_HAL::BetterStream *port);
+    void _print_log_message(uint8_t i, const uint8_t *pkt,
+                            void (*print_mode)(AP_HAL::BetterStream *port, uint8_t mode),
+                            AP_HAL::BetterStream *port);
+    struct compact_state *_compact_reader_type(struct compact_reader &reader, uint8_t msg_type,
+                                               const char *encoding);
     
     void Log_Fill_Format(const struct LogStructure *structure, struct log_Format &pkt);
     void Log_Write_Parameter(const AP_Param *ap, const AP_Param::ParamToken &token, 
                              enum ap_var_type type);
     void Log_Write_Parameters(void);
+    void Log_Write_Formats(void);
     virtual uint16_t start_new_log(void) = 0;
 
     const struct LogStructure *_structures;
@@ -91,6 +241,45 @@ protected:
     bool _writes_enabled;
     bool log_write_started;
 
+#if DATAFLASH_COMPACT_TYPES
+    struct compact_state _compact[DATAFLASH_COMPACT_TYPES];
+    uint8_t _num_compact;
+#if HAL_OS_POSIX_IO
+    uint32_t _compact_drops;
+#endif
+    void Log_Write_Format_Compact(const struct compact_state &c);
+    void Write_Compact(struct compact_state &c, const uint8_t *msg);
+#endif
+
+#if DATAFLASH_RATE_LIMIT
+    AP_Int16 _rate_msg[DATAFLASH_RATE_SLOTS];
+    AP_Int16 _rate_hz[DATAFLASH_RATE_SLOTS];
+
+    struct rate_default {
+        uint8_t msg_type;
+        uint16_t rate_hz;
+    } _rate_default[DATAFLASH_RATE_DEFAULTS];
+    uint8_t _num_rate_defaults;
+
+    // the limit in force for each limited type, with what it has
+    // kept and dropped
+    struct rate_state {
+        uint8_t msg_type;
+        uint16_t rate_hz;
+        uint32_t interval_us;
+        uint32_t next_us;
+        uint32_t kept;
+        uint32_t dropped;
+    } _rate[DATAFLASH_RATE_SLOTS+DATAFLASH_RATE_DEFAULTS];
+    uint8_t _num_rates;
+
+    // bitmask of the limited types, so others cost one test
+    uint32_t _rate_mask[8];
+
+    bool rate_check(uint8_t msg_type);
+    void rate_add(const struct rate_state *old, uint8_t num_old, uint8_t msg_type, uint16_t rate_hz);
+#endif
+
     /*
       read a block
     */
@@ -151,6 +340,23 @@ struct PACKED log_Format {
     char labels[64];
 };
 
+/*
+  the compact encoding of a message type, with one character per
+  field of its format:
+    B, H, I : a raw 1, 2 or 4 byte field
+    N, Z    : a raw 16 or 64 byte field
+    h, i    : a 2 or 4 byte integer stored as a zig-zag varint of
+              its difference from the previous message of the type
+  A compact message is HEAD_BYTE1, HEAD_BYTE2, LOG_COMPACT_MSG, the
+  message type, then the encoded fields. Any full message of the type
+  resets the reference the next compact message is decoded against
+ */
+struct PACKED log_Format_Compact {
+    LOG_PACKET_HEADER;
+    uint8_t type;
+    char encoding[16];
+};
+
 struct PACKED log_Parameter {
     LOG_PACKET_HEADER;
     char name[16];
@@ -352,6 +558,57 @@ struct PACKED log_Radio {
     uint16_t fixed;
 };
 
+struct PACKED log_Scheduler {
+    LOG_PACKET_HEADER;
+    uint32_t time_ms;
+    uint8_t  task;
+    uint32_t count;
+    uint32_t total_time_us;
+    uint32_t max_time_us;
+    uint16_t slips;
+    uint16_t overruns;
+    uint16_t hist[8];
+};
+
+struct PACKED log_DataFlash_Stats {
+    LOG_PACKET_HEADER;
+    uint32_t time_ms;
+    uint32_t dropped_msgs;
+    uint32_t dropped_bytes;
+    uint32_t bytes_written;
+    uint32_t buf_size;
+    uint32_t buf_min_free;
+    uint32_t fsyncs;
+};
+
+struct PACKED log_DataFlash_Drops {
+    LOG_PACKET_HEADER;
+    uint32_t time_ms;
+    uint8_t  msg_type;
+    uint16_t dropped_msgs;
+};
+
+struct PACKED log_DataFlash_Rate {
+    LOG_PACKET_HEADER;
+    uint32_t time_ms;
+    uint8_t  msg_type;
+    uint16_t rate_hz;
+    uint32_t kept;
+    uint32_t dropped;
+};
+
+struct PACKED log_Thread_Latency {
+    LOG_PACKET_HEADER;
+    uint32_t time_ms;
+    uint8_t  thread;
+    uint32_t count;
+    uint32_t min_usec;
+    uint32_t avg_usec;
+    uint32_t max_usec;
+    uint32_t p99_usec;
+    uint32_t overruns;
+};
+
 #define LOG_COMMON_STRUCTURES \
     { LOG_FORMAT_MSG, sizeof(log_Format), \
       "FMT", "BBnNZ",      "Type,Length,Name,Format,Columns" },    \
@@ -390,7 +647,19 @@ struct PACKED log_Radio {
     { LOG_CMD_MSG, sizeof(log_Cmd), \
       "CMD", "IHHHfffffff","TimeMS,CTot,CNum,CId,Prm1,Prm2,Prm3,Prm4,Lat,Lng,Alt" }, \
     { LOG_RADIO_MSG, sizeof(log_Radio), \
-      "RAD", "IBBBBBHH", "TimeMS,RSSI,RemRSSI,TxBuf,Noise,RemNoise,RxErrors,Fixed" }
+      "RAD", "IBBBBBHH", "TimeMS,RSSI,RemRSSI,TxBuf,Noise,RemNoise,RxErrors,Fixed" }, \
+    { LOG_SCHED_MSG, sizeof(log_Scheduler), \
+      "SCHD", "IBIIIHHHHHHHHHH", "TimeMS,Task,N,TotT,MaxT,Slip,Ovr,H0,H1,H2,H3,H4,H5,H6,H7" }, \
+    { LOG_DF_STATS_MSG, sizeof(log_DataFlash_Stats), \
+      "DFST", "IIIIIII", "TimeMS,DrpM,DrpB,Wrt,BufSz,MinFree,Sync" }, \
+    { LOG_DF_DROPS_MSG, sizeof(log_DataFlash_Drops), \
+      "DFDR", "IBH", "TimeMS,Type,Drops" }, \
+    { LOG_FORMAT_COMPACT_MSG, sizeof(log_Format_Compact), \
+      "FMTC", "BN", "Type,Encoding" }, \
+    { LOG_DF_RATE_MSG, sizeof(log_DataFlash_Rate), \
+      "DFRT", "IBHII", "TimeMS,Type,Rate,Kept,Drop" }, \
+    { LOG_THREAD_LATENCY_MSG, sizeof(log_Thread_Latency), \
+      "TLAT", "IBIIIIII", "TimeMS,Thr,N,Min,Avg,Max,P99,Ovr" }
 
 // message types 0 to 100 reversed for vehicle specific use
 
@@ -414,6 +683,14 @@ struct PACKED log_Radio {
 #define LOG_GPS2_MSG	  144
 #define LOG_CMD_MSG       145
 #define LOG_RADIO_MSG	  146
+#define LOG_SCHED_MSG     147
+#define LOG_DF_STATS_MSG  148
+#define LOG_DF_DROPS_MSG  149
+#define LOG_FORMAT_COMPACT_MSG 150
+// variable length, so has no FMT entry. See log_Format_Compact
+#define LOG_COMPACT_MSG   151
+#define LOG_DF_RATE_MSG   152
+#define LOG_THREAD_LATENCY_MSG 153
 
 // message types 200 to 210 reversed for GPS driver use
 // message types 211 to 220 reversed for autotune use
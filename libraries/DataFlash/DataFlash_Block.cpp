@@ -104,6 +104,39 @@ void DataFlash_Block::StartRead(uint16_t PageAdr)
     df_Read_BufferIdx = sizeof(ph);
 }
 
+/*
+  read the header of a page, using the cache if we can. Unlike
+  StartRead() this doesn't leave the read position at the page when
+  the cache is hit
+ */
+void DataFlash_Block::ReadPageHeader(uint16_t PageAdr, struct PageHeader &ph)
+{
+    uint8_t slot = (PageAdr ^ (PageAdr >> 4) ^ (PageAdr >> 8)) & (DF_HEADER_CACHE_SIZE-1);
+    struct PageHeaderCache &c = df_HeaderCache[slot];
+    if (c.PageAdr == PageAdr) {
+        ph = c.ph;
+        return;
+    }
+    StartRead(PageAdr);
+    ph.FileNumber = df_FileNumber;
+    ph.FilePage   = df_FilePage;
+    c.PageAdr = PageAdr;
+    c.ph = ph;
+}
+
+/*
+  forget all cached page headers and log boundaries
+ */
+void DataFlash_Block::InvalidateCache(void)
+{
+    // pages are numbered from 1, so 0 marks an empty slot
+    memset(df_HeaderCache, 0, sizeof(df_HeaderCache));
+    memset(df_BoundsCache, 0, sizeof(df_BoundsCache));
+    df_BoundsNext = 0;
+    df_LastPageValid = false;
+    df_NumLogsValid = false;
+}
+
 void DataFlash_Block::ReadBlock(void *pBuffer, uint16_t size)
 {
     while (size > 0) {
@@ -173,6 +206,7 @@ void DataFlash_Block::EraseAll()
     log_write_started = false;
     FinishWrite();
     hal.scheduler->delay(100);
+    InvalidateCache();
 }
 
 /*
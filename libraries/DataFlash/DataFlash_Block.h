@@ -9,9 +9,23 @@
 
 #include <stdint.h>
 
+/*
+  sizes of the page header cache and the log boundary cache. These
+  make listing logs fast, but cost 6 bytes per entry of RAM
+ */
+#if HAL_CPU_CLASS <= HAL_CPU_CLASS_16
+#define DF_HEADER_CACHE_SIZE 16
+#define DF_BOUNDS_CACHE_SIZE 4
+#else
+#define DF_HEADER_CACHE_SIZE 64
+#define DF_BOUNDS_CACHE_SIZE 16
+#endif
+
 class DataFlash_Block : public DataFlash_Class
 {
 public:
+    DataFlash_Block() { InvalidateCache(); }
+
     // initialisation
     virtual void Init(const struct LogStructure *structure, uint8_t num_types) = 0;
     virtual bool CardInserted(void) = 0;
@@ -58,6 +72,30 @@ private:
     // offset from adding FMT messages to log data
     bool adding_fmt_headers;
 
+    /*
+      page headers and log boundaries found while searching for logs.
+      Reading stops logging, and logging only restarts through
+      start_new_log(), so these stay valid until the flash is next
+      written by start_new_log(), EraseAll() or the flush of the last
+      partial page in get_log_boundaries()
+     */
+    struct PageHeaderCache {
+        uint16_t PageAdr;
+        struct PageHeader ph;
+    };
+    struct LogBoundaries {
+        uint16_t log_num;
+        uint16_t start_page;
+        uint16_t end_page;
+    };
+    struct PageHeaderCache df_HeaderCache[DF_HEADER_CACHE_SIZE];
+    struct LogBoundaries df_BoundsCache[DF_BOUNDS_CACHE_SIZE];
+    uint8_t df_BoundsNext;
+    bool df_LastPageValid;
+    uint16_t df_LastPage;
+    bool df_NumLogsValid;
+    uint16_t df_NumLogs;
+
     /*
       functions implemented by the board specific backends
      */
@@ -82,6 +120,8 @@ private:
 
     // internal high level functions
     void StartRead(uint16_t PageAdr);
+    void ReadPageHeader(uint16_t PageAdr, struct PageHeader &ph);
+    void InvalidateCache(void);
     uint16_t find_last_page(void);
     uint16_t find_last_page_of_log(uint16_t log_number);
     bool check_wrapped(void);
@@ -24,6 +24,9 @@
 #include <stdio.h>
 #include <time.h>
 #include <dirent.h>
+#if DATAFLASH_FILE_WRITEV
+#include <sys/uio.h>
+#endif
 
 extern const AP_HAL::HAL& hal;
 
@@ -36,13 +39,15 @@ extern const AP_HAL::HAL& hal;
 DataFlash_File::DataFlash_File(const char *log_directory) :
     _write_fd(-1),
     _read_fd(-1),
+    _write_log_num(0),
     _read_offset(0),
     _write_offset(0),
     _initialised(false),
     _log_directory(log_directory),
-    _writebuf(NULL),
-    _writebuf_size(16*1024),
-#if defined(CONFIG_ARCH_BOARD_PX4FMU_V1)
+    _writebuf_size(DATAFLASH_FILE_BUFSIZE),
+#if defined(DATAFLASH_FILE_CHUNK)
+    _writebuf_chunk(DATAFLASH_FILE_CHUNK),
+#elif defined(CONFIG_ARCH_BOARD_PX4FMU_V1)
     // V1 gets IO errors with larger than 512 byte writes
     _writebuf_chunk(512),
 #elif defined(CONFIG_ARCH_BOARD_VRBRAIN_V4)
@@ -54,15 +59,34 @@ DataFlash_File::DataFlash_File(const char *log_directory) :
 #else
     _writebuf_chunk(4096),
 #endif
-    _writebuf_head(0),
-    _writebuf_tail(0),
-    _last_write_time(0)
+    _last_write_time(0),
+    _last_fsync_ms(0),
+    _dropped_msgs(0),
+    _dropped_bytes(0),
+    _buf_min_free(0),
+    _bytes_written(0),
+    _fsyncs(0),
+    _prealloc_end(0),
+    _rotate_size(DATAFLASH_FILE_ROTATE_SIZE),
+    _rotate_ms(DATAFLASH_FILE_ROTATE_MS),
+    _log_buffered(0),
+    _log_start_ms(0),
+    _rotate_offset(0),
+    _quota_mb(DATAFLASH_FILE_QUOTA_MB),
+    _prune_check_offset(0),
+    _log_index(NULL),
+    _log_count(0),
+    _log_highest(0),
+    _last_log_num(0)
 #if CONFIG_HAL_BOARD == HAL_BOARD_PX4 || CONFIG_HAL_BOARD == HAL_BOARD_VRBRAIN
     ,_perf_write(perf_alloc(PC_ELAPSED, "DF_write")),
     _perf_fsync(perf_alloc(PC_ELAPSED, "DF_fsync")),
     _perf_errors(perf_alloc(PC_COUNT, "DF_errors"))
 #endif
-{}
+{
+    memset(_dropped_by_type, 0, sizeof(_dropped_by_type));
+    pthread_mutex_init(&_file_mutex, NULL);
+}
 
 
 // initialisation
@@ -96,14 +120,29 @@ void DataFlash_File::Init(const struct LogStructure *structure, uint8_t num_type
         hal.console->printf("Failed to create log directory %s", _log_directory);
         return;
     }
-    if (_writebuf != NULL) {
-        free(_writebuf);
+    if (_log_index == NULL) {
+        _log_index = (struct log_index_entry *)calloc(MAX_LOG_FILES+1, sizeof(_log_index[0]));
+        if (_log_index == NULL) {
+            return;
+        }
     }
-    _writebuf = (uint8_t *)malloc(_writebuf_size);
-    if (_writebuf == NULL) {
+    _build_log_index();
+#if DATAFLASH_FILE_PREALLOC
+    if (_log_present(_last_log_num)) {
+        // release any space allocated past the end of a log that
+        // wasn't closed, for example after a power loss
+        char *fname = _log_file_name(_last_log_num);
+        if (fname != NULL) {
+            ::truncate(fname, _log_index[_last_log_num].size);
+            free(fname);
+        }
+    }
+#endif
+    if (!_writebuf.set_size(_writebuf_size)) {
         return;
     }
-    _writebuf_head = _writebuf_tail = 0;
+    _writebuf.clear();
+    _buf_min_free = _writebuf.get_size();
     _initialised = true;
     hal.scheduler->register_io_process(AP_HAL_MEMBERPROC(&DataFlash_File::_io_timer));
 }
@@ -148,66 +187,80 @@ char *DataFlash_File::_lastlog_file_name(void)
 // remove all log files
 void DataFlash_File::EraseAll()
 {
-    uint16_t log_num;
+    pthread_mutex_lock(&_file_mutex);
     stop_logging();
-    for (log_num=0; log_num<MAX_LOG_FILES; log_num++) {
-        char *fname = _log_file_name(log_num);
-        if (fname == NULL) {
-            break;
+    if (_log_index != NULL) {
+        for (uint16_t log_num=1; log_num<=MAX_LOG_FILES; log_num++) {
+            if (_log_index[log_num].size == 0) {
+                continue;
+            }
+            char *fname = _log_file_name(log_num);
+            if (fname == NULL) {
+                break;
+            }
+            unlink(fname);
+            free(fname);
         }
-        unlink(fname);
-        free(fname);
+        memset(_log_index, 0, (MAX_LOG_FILES+1)*sizeof(_log_index[0]));
     }
+    _log_count = 0;
+    _log_highest = 0;
+    _last_log_num = 0;
     char *fname = _lastlog_file_name();
     if (fname != NULL) {
         unlink(fname);
         free(fname);
     }
+    pthread_mutex_unlock(&_file_mutex);
 }
 
-/*
-  buffer handling macros
- */
-#define BUF_AVAILABLE(buf) ((buf##_head > (_tail=buf##_tail))? (buf##_size - buf##_head) + _tail: _tail - buf##_head)
-#define BUF_SPACE(buf) (((_head=buf##_head) > buf##_tail)?(_head - buf##_tail) - 1:((buf##_size - buf##_tail) + _head) - 1)
-#define BUF_EMPTY(buf) (buf##_head == buf##_tail)
-#define BUF_ADVANCETAIL(buf, n) buf##_tail = (buf##_tail + n) % buf##_size
-#define BUF_ADVANCEHEAD(buf, n) buf##_head = (buf##_head + n) % buf##_size
-
-
 /* Write a block of data at current offset */
 void DataFlash_File::WriteBlock(const void *pBuffer, uint16_t size)
 {
     if (_write_fd == -1 || !_initialised || !_writes_enabled) {
         return;
     }
-    uint16_t _head;
-    uint16_t space = BUF_SPACE(_writebuf);
+    if (_rotate_offset == 0 &&
+        ((_rotate_size != 0 && _log_buffered >= _rotate_size) ||
+         (_rotate_ms != 0 && hal.scheduler->millis() - _log_start_ms >= _rotate_ms))) {
+        _start_rotation((const uint8_t *)pBuffer, size);
+    }
+    uint32_t space = _writebuf.space();
     if (space < size) {
-        // discard the whole write, to keep the log consistent
+        // discard the whole write, to keep the log consistent, and
+        // account for it against the message type
+        _dropped_msgs++;
+        _dropped_bytes += size;
+        if (size >= sizeof(struct log_Header)) {
+            uint8_t msgid = ((const struct log_Header *)pBuffer)->msgid;
+            if (_dropped_by_type[msgid] != 0xFFFF) {
+                _dropped_by_type[msgid]++;
+            }
+        }
         return;
     }
+    _writebuf.write((const uint8_t *)pBuffer, size);
+    _log_buffered += size;
+    if (space - size < _buf_min_free) {
+        _buf_min_free = space - size;
+    }
+}
 
-    if (_writebuf_tail < _head) {
-        // perform as single memcpy
-        assert(_writebuf_tail+size <= _writebuf_size);
-        memcpy(&_writebuf[_writebuf_tail], pBuffer, size);
-        BUF_ADVANCETAIL(_writebuf, size);
-    } else {
-        // perform as two memcpy calls
-        uint16_t n = _writebuf_size - _writebuf_tail;
-        if (n > size) n = size;
-        assert(_writebuf_tail+n <= _writebuf_size);
-        memcpy(&_writebuf[_writebuf_tail], pBuffer, n);
-        BUF_ADVANCETAIL(_writebuf, n);
-        pBuffer = (const void *)(((const uint8_t *)pBuffer) + n);
-        n = size - n;
-        if (n > 0) {
-            assert(_writebuf_tail+n <= _writebuf_size);
-            memcpy(&_writebuf[_writebuf_tail], pBuffer, n);
-            BUF_ADVANCETAIL(_writebuf, n);
-        }
+/*
+  get write buffer statistics
+ */
+bool DataFlash_File::get_write_stats(struct write_stats &stats) const
+{
+    if (!_initialised) {
+        return false;
     }
+    stats.dropped_msgs  = _dropped_msgs;
+    stats.dropped_bytes = _dropped_bytes;
+    stats.bytes_written = _bytes_written;
+    stats.buf_size      = _writebuf.get_size();
+    stats.buf_min_free  = _buf_min_free;
+    stats.fsyncs        = _fsyncs;
+    return true;
 }
 
 /*
@@ -226,9 +279,9 @@ void DataFlash_File::ReadBlock(void *pkt, uint16_t size)
 
 
 /*
-  find the highest log number
+  read the number of the most recently started log from LASTLOG.TXT
  */
-uint16_t DataFlash_File::find_last_log(void)
+uint16_t DataFlash_File::_read_lastlog(void)
 {
     unsigned ret = 0;
     char *fname = _lastlog_file_name();
@@ -246,12 +299,103 @@ uint16_t DataFlash_File::find_last_log(void)
         }
         fclose(f);    
     }
+    if (ret > MAX_LOG_FILES) {
+        ret = 0;
+    }
     return ret;
 }
 
+/*
+  build the log index from the log directory. This is the only place
+  we stat() logs other than the one being written
+ */
+void DataFlash_File::_build_log_index(void)
+{
+    memset(_log_index, 0, (MAX_LOG_FILES+1)*sizeof(_log_index[0]));
+    _log_count = 0;
+    _log_highest = 0;
+    _last_log_num = _read_lastlog();
+
+    DIR *d = opendir(_log_directory);
+    if (d == NULL) {
+        return;
+    }
+    for (struct dirent *de=readdir(d); de; de=readdir(d)) {
+        // log files are named NN.BIN
+        char *end = NULL;
+        unsigned long log_num = strtoul(de->d_name, &end, 10);
+        if (end == de->d_name || strcasecmp(end, ".BIN") != 0 ||
+            log_num == 0 || log_num > MAX_LOG_FILES) {
+            continue;
+        }
+        char *fname = _log_file_name(log_num);
+        if (fname == NULL) {
+            break;
+        }
+        struct stat st;
+        if (::stat(fname, &st) == 0 && st.st_size > 0) {
+            _log_index[log_num].size = st.st_size;
+            _log_index[log_num].time_utc = st.st_mtime;
+            _log_count++;
+            if (log_num > _log_highest) {
+                _log_highest = log_num;
+            }
+        }
+        free(fname);
+    }
+    closedir(d);
+}
+
+/*
+  return true if a log is in the index. The log being written is
+  always present, even before any data has reached the file
+ */
+bool DataFlash_File::_log_present(uint16_t log_num) const
+{
+    if (_log_index == NULL || log_num == 0 || log_num > MAX_LOG_FILES) {
+        return false;
+    }
+    return _log_index[log_num].size != 0 || log_num == _write_log_num;
+}
+
+/*
+  find the highest log number
+ */
+uint16_t DataFlash_File::find_last_log(void)
+{
+    pthread_mutex_lock(&_file_mutex);
+    uint16_t ret = _log_highest;
+    pthread_mutex_unlock(&_file_mutex);
+    return ret;
+}
+
+/*
+  find the next log after log_num. Log numbers need not be
+  consecutive
+ */
+uint16_t DataFlash_File::find_next_log(uint16_t log_num)
+{
+    uint16_t ret = 0;
+    pthread_mutex_lock(&_file_mutex);
+    for (uint16_t i=log_num+1; i<=_log_highest; i++) {
+        if (_log_present(i)) {
+            ret = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_file_mutex);
+    return ret;
+}
 
 uint32_t DataFlash_File::_get_log_size(uint16_t log_num)
 {
+    if (!_log_present(log_num)) {
+        return 0;
+    }
+    if (log_num != _write_log_num) {
+        return _log_index[log_num].size;
+    }
+    // the log being written is still growing
     char *fname = _log_file_name(log_num);
     if (fname == NULL) {
         return 0;
@@ -267,6 +411,12 @@ uint32_t DataFlash_File::_get_log_size(uint16_t log_num)
 
 uint32_t DataFlash_File::_get_log_time(uint16_t log_num)
 {
+    if (!_log_present(log_num)) {
+        return 0;
+    }
+    if (log_num != _write_log_num) {
+        return _log_index[log_num].time_utc;
+    }
     char *fname = _log_file_name(log_num);
     if (fname == NULL) {
         return 0;
@@ -286,7 +436,9 @@ uint32_t DataFlash_File::_get_log_time(uint16_t log_num)
 void DataFlash_File::get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page)
 {
     start_page = 0;
+    pthread_mutex_lock(&_file_mutex);
     end_page = _get_log_size(log_num) / DATAFLASH_PAGE_SIZE;
+    pthread_mutex_unlock(&_file_mutex);
 }
 
 /*
@@ -297,6 +449,7 @@ int16_t DataFlash_File::get_log_data(uint16_t log_num, uint16_t page, uint32_t o
     if (!_initialised) {
         return -1;
     }
+    pthread_mutex_lock(&_file_mutex);
     if (_read_fd != -1 && log_num != _read_fd_log_num) {
         ::close(_read_fd);
         _read_fd = -1;
@@ -304,17 +457,20 @@ int16_t DataFlash_File::get_log_data(uint16_t log_num, uint16_t page, uint32_t o
     if (_read_fd == -1) {
         char *fname = _log_file_name(log_num);
         if (fname == NULL) {
+            pthread_mutex_unlock(&_file_mutex);
             return -1;
         }
         stop_logging();
         _read_fd = ::open(fname, O_RDONLY);
         free(fname);
         if (_read_fd == -1) {
+            pthread_mutex_unlock(&_file_mutex);
             return -1;            
         }
         _read_offset = 0;
         _read_fd_log_num = log_num;
     }
+    pthread_mutex_unlock(&_file_mutex);
     uint32_t ofs = page * (uint32_t)DATAFLASH_PAGE_SIZE + offset;
 
     /*
@@ -349,83 +505,273 @@ int16_t DataFlash_File::get_log_data(uint16_t log_num, uint16_t page, uint32_t o
  */
 void DataFlash_File::get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc)
 {
+    pthread_mutex_lock(&_file_mutex);
     size = _get_log_size(log_num);
     time_utc = _get_log_time(log_num);
+    pthread_mutex_unlock(&_file_mutex);
 }
 
 
 
 /*
-  get the number of logs - note that the log numbers must be consecutive
+  get the number of logs
  */
 uint16_t DataFlash_File::get_num_logs(void)
 {
-    uint16_t ret;
-    uint16_t high = find_last_log();
-    for (ret=0; ret<high; ret++) {
-        if (_get_log_size(high - ret) <= 0) {
-            break;
-        }
-    }
+    pthread_mutex_lock(&_file_mutex);
+    uint16_t ret = _log_count;
+    pthread_mutex_unlock(&_file_mutex);
     return ret;
 }
 
 /*
-  stop logging
+  stop logging. Called with _file_mutex held
  */
 void DataFlash_File::stop_logging(void)
 {
+    int fd = -1;
     if (_write_fd != -1) {
-        int fd = _write_fd;
+        fd = _write_fd;
         _write_fd = -1;
         log_write_started = false;
+    }
+    if (_write_log_num != 0) {
+        uint16_t log_num = _write_log_num;
+        _write_log_num = 0;
+        _close_log(fd, log_num);
+    } else if (fd != -1) {
         ::close(fd);
     }
 }
 
-
 /*
-  start writing to a new log file
+  close a log file, if it is open, and record its final size in the
+  index. Empty logs are dropped, and their number is re-used for the
+  next log
  */
-uint16_t DataFlash_File::start_new_log(void)
+void DataFlash_File::_close_log(int fd, uint16_t log_num)
 {
-    stop_logging();
-
-    if (_read_fd != -1) {
-        ::close(_read_fd);
-        _read_fd = -1;
+    if (fd != -1) {
+        ::close(fd);
     }
+    uint32_t size = 0;
+    uint32_t time_utc = 0;
+    char *fname = _log_file_name(log_num);
+    if (fname != NULL) {
+        struct stat st;
+        if (::stat(fname, &st) == 0) {
+            size = st.st_size;
+            time_utc = st.st_mtime;
+#if DATAFLASH_FILE_PREALLOC
+            // release the space allocated past the end of the log.
+            // This is done by name once the file is closed, so it
+            // can't race with a write from the IO thread
+            ::truncate(fname, size);
+#endif
+        }
+        free(fname);
+    }
+    _log_index[log_num].size = size;
+    _log_index[log_num].time_utc = time_utc;
+    if (size == 0) {
+        _log_count--;
+        while (_log_highest > 0 && !_log_present(_log_highest)) {
+            _log_highest--;
+        }
+    }
+}
 
-    uint16_t log_num = find_last_log();
+/*
+  create the file for the next log, and record it in the index and
+  LASTLOG.TXT. Returns the file descriptor, or -1 on failure
+ */
+int DataFlash_File::_create_log(uint16_t &log_num)
+{
+    log_num = _last_log_num;
     // re-use empty logs if possible
-    if (_get_log_size(log_num) > 0 || log_num == 0) {
+    if (_log_present(log_num) || log_num == 0) {
         log_num++;
     }
     if (log_num > MAX_LOG_FILES) {
         log_num = 1;
     }
     char *fname = _log_file_name(log_num);
-    _write_fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fname == NULL) {
+        return -1;
+    }
+    int fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0666);
     free(fname);
-    if (_write_fd == -1) {
+    if (fd == -1) {
+        return -1;
+    }
+
+    // the file has been truncated, so it stays in the index only as
+    // the log being written
+    if (!_log_present(log_num)) {
+        _log_count++;
+    }
+    _log_index[log_num].size = 0;
+    _log_index[log_num].time_utc = 0;
+    _last_log_num = log_num;
+    if (log_num > _log_highest) {
+        _log_highest = log_num;
+    }
+
+    // now update lastlog.txt with the new log number
+    fname = _lastlog_file_name();
+    if (fname != NULL) {
+        FILE *f = ::fopen(fname, "w");
+        if (f != NULL) {
+            fprintf(f, "%u\r\n", (unsigned)log_num);
+            fclose(f);
+        }
+        free(fname);
+    }
+    return fd;
+}
+
+/*
+  start writing to a new log file
+ */
+uint16_t DataFlash_File::start_new_log(void)
+{
+    pthread_mutex_lock(&_file_mutex);
+    stop_logging();
+
+    if (_read_fd != -1) {
+        ::close(_read_fd);
+        _read_fd = -1;
+    }
+    if (_log_index == NULL) {
+        pthread_mutex_unlock(&_file_mutex);
+        return 0xFFFF;
+    }
+
+    uint16_t log_num;
+    int fd = _create_log(log_num);
+    if (fd == -1) {
         _initialised = false;
+        pthread_mutex_unlock(&_file_mutex);
         return 0xFFFF;
     }
     _write_offset = 0;
-    _writebuf_head = 0;
-    _writebuf_tail = 0;
+    _prealloc_end = 0;
+    _writebuf.clear();
+    _log_buffered = 0;
+    _log_start_ms = hal.scheduler->millis();
+    _rotate_offset = 0;
+    _write_log_num = log_num;
+    _write_fd = fd;
     log_write_started = true;
 
-    // now update lastlog.txt with the new log number
-    fname = _lastlog_file_name();
-    FILE *f = ::fopen(fname, "w");
-    fprintf(f, "%u\r\n", (unsigned)log_num);
-    fclose(f);    
-    free(fname);
+    // make room for the new log in the background
+    _prune_check_offset = 0;
+    pthread_mutex_unlock(&_file_mutex);
 
     return log_num;
 }
 
+/*
+  called by the main thread between messages when the current file
+  has reached its size or time limit. Everything buffered so far goes
+  to the current file, and the log formats are written again to start
+  the next one, so each file can be read on its own and the files of
+  a log can be joined back together. If there isn't room in the
+  buffer for the formats the rotation waits for a later message
+ */
+void DataFlash_File::_start_rotation(const uint8_t *msg, uint16_t size)
+{
+    if (size < sizeof(struct log_Header) || msg[2] == LOG_COMPACT_MSG) {
+        // a compact message has already been encoded against the
+        // last one, so has to go in the same file
+        return;
+    }
+    uint32_t needed = size + _num_types * (uint32_t)sizeof(struct log_Format);
+#if DATAFLASH_COMPACT_TYPES
+    needed += _num_compact * (uint32_t)sizeof(struct log_Format_Compact);
+#endif
+    if (_log_buffered == 0 || _writebuf.space() < needed) {
+        return;
+    }
+    _rotate_offset = _log_buffered;
+    _log_buffered = 0;
+    _log_start_ms = hal.scheduler->millis();
+    Log_Write_Formats();
+}
+
+/*
+  called by the IO thread once everything before the rotation point
+  has been written, to continue the log in a new file. If the new
+  file can't be created logging carries on in the current one
+ */
+void DataFlash_File::_rotate_log(void)
+{
+    uint16_t log_num;
+    int fd = _create_log(log_num);
+    if (fd == -1) {
+        _rotate_offset = 0;
+        return;
+    }
+    int old_fd = _write_fd;
+    uint16_t old_log_num = _write_log_num;
+    _write_offset = 0;
+    _prealloc_end = 0;
+    _write_log_num = log_num;
+    _write_fd = fd;
+    _close_log(old_fd, old_log_num);
+    _rotate_offset = 0;
+    _prune_check_offset = 0;
+}
+
+/*
+  return true if log_num is open for reading, for download or for
+  printing
+ */
+bool DataFlash_File::_log_being_read(uint16_t log_num) const
+{
+    return _read_fd != -1 && _read_fd_log_num == log_num;
+}
+
+/*
+  remove the oldest logs until the total size of the logs is within
+  the quota. The log being written and a log being read are never
+  removed. Called by the IO thread, so the unlink() calls don't
+  delay the main thread
+ */
+void DataFlash_File::_prune_logs(void)
+{
+    uint64_t quota = _quota_mb * (uint64_t)1024 * 1024;
+    uint64_t total = _write_offset;
+    for (uint16_t log_num=1; log_num<=MAX_LOG_FILES; log_num++) {
+        if (log_num != _write_log_num) {
+            total += _log_index[log_num].size;
+        }
+    }
+    // log numbers wrap, so the oldest log is the first one after
+    // the current log
+    uint16_t log_num = _write_log_num;
+    for (uint16_t i=1; i<MAX_LOG_FILES && total > quota; i++) {
+        log_num = log_num % MAX_LOG_FILES + 1;
+        if (log_num == _write_log_num || _log_index[log_num].size == 0 ||
+            _log_being_read(log_num)) {
+            continue;
+        }
+        char *fname = _log_file_name(log_num);
+        if (fname == NULL) {
+            break;
+        }
+        ::unlink(fname);
+        free(fname);
+        total -= _log_index[log_num].size;
+        _log_index[log_num].size = 0;
+        _log_index[log_num].time_utc = 0;
+        _log_count--;
+    }
+    while (_log_highest > 0 && !_log_present(_log_highest)) {
+        _log_highest--;
+    }
+}
+
 /*
   Read the log and print it on port
 */
@@ -438,20 +784,24 @@ void DataFlash_File::LogReadProcess(uint16_t log_num,
     if (!_initialised) {
         return;
     }
+    pthread_mutex_lock(&_file_mutex);
     if (_read_fd != -1) {
         ::close(_read_fd);
         _read_fd = -1;
     }
     char *fname = _log_file_name(log_num);
     if (fname == NULL) {
+        pthread_mutex_unlock(&_file_mutex);
         return;
     }
     _read_fd = ::open(fname, O_RDONLY);
     free(fname);
     if (_read_fd == -1) {
+        pthread_mutex_unlock(&_file_mutex);
         return;
     }
     _read_fd_log_num = log_num;
+    pthread_mutex_unlock(&_file_mutex);
     _read_offset = 0;
     if (start_page != 0) {
         ::lseek(_read_fd, start_page * DATAFLASH_PAGE_SIZE, SEEK_SET);
@@ -459,6 +809,9 @@ void DataFlash_File::LogReadProcess(uint16_t log_num,
     }
 
     uint8_t log_counter = 0;
+    uint32_t skipped = 0;
+    struct compact_reader reader;
+    reader.num_types = 0;
 
     while (true) {
         uint8_t data;
@@ -473,20 +826,30 @@ void DataFlash_File::LogReadProcess(uint16_t log_num,
             case 0:
                 if (data == HEAD_BYTE1) {
                     log_step++;
+                } else {
+                    skipped++;
                 }
                 break;
 
             case 1:
                 if (data == HEAD_BYTE2) {
                     log_step++;
+                } else if (data == HEAD_BYTE1) {
+                    // the first header byte may have been damaged data
+                    skipped++;
                 } else {
+                    skipped += 2;
                     log_step = 0;
                 }
                 break;
 
             case 2:
                 log_step = 0;
-                _print_log_entry(data, print_mode, port);
+                if (!_print_log_entry(data, reader, print_mode, port)) {
+                    // not a message, resync on the next header
+                    skipped += 3;
+                    break;
+                }
                 log_counter++;
                 if (log_counter == 10) {
                     log_counter = 0;
@@ -499,8 +862,13 @@ void DataFlash_File::LogReadProcess(uint16_t log_num,
         }
     }
 
+    pthread_mutex_lock(&_file_mutex);
     ::close(_read_fd);
     _read_fd = -1;
+    pthread_mutex_unlock(&_file_mutex);
+    if (skipped != 0) {
+        port->printf_P(PSTR("Skipped %lu bytes of damaged log\n"), (unsigned long)skipped);
+    }
 }
 
 /*
@@ -527,7 +895,6 @@ void DataFlash_File::ShowDeviceInfo(AP_HAL::BetterStream *port)
 void DataFlash_File::ListAvailableLogs(AP_HAL::BetterStream *port)
 {
     uint16_t num_logs = get_num_logs();
-    int16_t last_log_num = find_last_log();
 
     if (num_logs == 0) {
         port->printf_P(PSTR("\nNo logs\n\n"));
@@ -535,28 +902,22 @@ void DataFlash_File::ListAvailableLogs(AP_HAL::BetterStream *port)
     }
     port->printf_P(PSTR("\n%u logs\n"), (unsigned)num_logs);
 
-    for (uint16_t i=num_logs; i>=1; i--) {
-        uint16_t log_num = last_log_num - i + 1;
-        off_t size;
-
+    for (uint16_t log_num=find_next_log(0); log_num != 0; log_num=find_next_log(log_num)) {
+        uint32_t size, time_utc;
+        get_log_info(log_num, size, time_utc);
         char *filename = _log_file_name(log_num);
         if (filename != NULL) {
-            size = _get_log_size(log_num);
-            if (size != 0) {
-                struct stat st;
-                if (stat(filename, &st) == 0) {
-                    struct tm *tm = gmtime(&st.st_mtime);
-                    port->printf_P(PSTR("Log %u in %s of size %u %u/%u/%u %u:%u\n"), 
-                                   (unsigned)log_num, 
-                                   filename,
-                                   (unsigned)size,
-                                   (unsigned)tm->tm_year+1900,
-                                   (unsigned)tm->tm_mon+1,
-                                   (unsigned)tm->tm_mday,
-                                   (unsigned)tm->tm_hour,
-                                   (unsigned)tm->tm_min);
-                }
-            }
+            time_t t = time_utc;
+            struct tm *tm = gmtime(&t);
+            port->printf_P(PSTR("Log %u in %s of size %u %u/%u/%u %u:%u\n"), 
+                           (unsigned)log_num, 
+                           filename,
+                           (unsigned)size,
+                           (unsigned)tm->tm_year+1900,
+                           (unsigned)tm->tm_mon+1,
+                           (unsigned)tm->tm_mday,
+                           (unsigned)tm->tm_hour,
+                           (unsigned)tm->tm_min);
             free(filename);
         }
     }
@@ -566,17 +927,41 @@ void DataFlash_File::ListAvailableLogs(AP_HAL::BetterStream *port)
 
 void DataFlash_File::_io_timer(void)
 {
-    uint16_t _tail;
+    if (pthread_mutex_trylock(&_file_mutex) != 0) {
+        // the main thread is changing files
+        return;
+    }
+    _io_write();
+    pthread_mutex_unlock(&_file_mutex);
+}
+
+/*
+  write buffered data to the log, and rotate and prune logs. Called
+  by the IO thread with _file_mutex held
+ */
+void DataFlash_File::_io_write(void)
+{
     if (_write_fd == -1 || !_initialised) {
         return;
     }
 
-    uint16_t nbytes = BUF_AVAILABLE(_writebuf);
+    if (_quota_mb != 0 && _write_offset >= _prune_check_offset) {
+        _prune_check_offset = _write_offset + 1024*1024UL;
+        _prune_logs();
+    }
+
+    uint32_t rotate_offset = _rotate_offset;
+    if (rotate_offset != 0 && _write_offset >= rotate_offset) {
+        _rotate_log();
+        rotate_offset = 0;
+    }
+
+    uint32_t nbytes = _writebuf.available();
     if (nbytes == 0) {
         return;
     }
     uint32_t tnow = hal.scheduler->micros();
-    if (nbytes < _writebuf_chunk && 
+    if (nbytes < _writebuf_chunk && rotate_offset == 0 &&
         tnow - _last_write_time < 2000000UL) {
         // write in 512 byte chunks, but always write at least once
         // per 2 seconds if data is available
@@ -586,13 +971,32 @@ void DataFlash_File::_io_timer(void)
     perf_begin(_perf_write);
 
     _last_write_time = tnow;
+#if DATAFLASH_FILE_WRITEV
+    // if the buffer is more than half full then drain as much as we
+    // can, rather than letting the main thread start dropping messages
+    if (nbytes > _writebuf_chunk && nbytes < _writebuf.get_size()/2) {
+        nbytes = _writebuf_chunk;
+    }
+#else
     if (nbytes > _writebuf_chunk) {
         // be kind to the FAT PX4 filesystem
         nbytes = _writebuf_chunk;
     }
-    if (_writebuf_head > _tail) {
-        // only write to the end of the buffer
-        nbytes = min(nbytes, _writebuf_size - _writebuf_head);
+#endif
+
+    const uint8_t *head, *wrapped;
+    uint32_t contiguous, wrapped_len;
+    _writebuf.peek(head, contiguous, wrapped, wrapped_len);
+#if !DATAFLASH_FILE_WRITEV
+    // only write to the end of the buffer
+    wrapped_len = 0;
+#endif
+    if (nbytes > contiguous + wrapped_len) {
+        nbytes = contiguous + wrapped_len;
+    }
+    if (rotate_offset != 0 && nbytes > rotate_offset - _write_offset) {
+        // stop at the start of the next file
+        nbytes = rotate_offset - _write_offset;
     }
 
     // try to align writes on a 512 byte boundary to avoid filesystem
@@ -604,8 +1008,35 @@ void DataFlash_File::_io_timer(void)
         }
     }
 
-    assert(_writebuf_head+nbytes <= _writebuf_size);
-    ssize_t nwritten = ::write(_write_fd, &_writebuf[_writebuf_head], nbytes);
+#if DATAFLASH_FILE_PREALLOC
+    if (_write_offset + nbytes > _prealloc_end) {
+        // allocate the next extent. FALLOC_FL_KEEP_SIZE leaves the
+        // file size alone, so the file never shows unwritten space
+        // and nothing needs fixing if we lose power. If the
+        // filesystem can't do it we stop trying for this file
+        if (::fallocate(_write_fd, FALLOC_FL_KEEP_SIZE, _prealloc_end, DATAFLASH_FILE_PREALLOC) == 0) {
+            _prealloc_end += DATAFLASH_FILE_PREALLOC;
+        } else {
+            _prealloc_end = 0xFFFFFFFF;
+        }
+    }
+#endif
+
+    ssize_t nwritten;
+#if DATAFLASH_FILE_WRITEV
+    if (nbytes > contiguous) {
+        // the data wraps, so write both parts in one call
+        struct iovec iov[2];
+        iov[0].iov_base = (void *)head;
+        iov[0].iov_len  = contiguous;
+        iov[1].iov_base = (void *)wrapped;
+        iov[1].iov_len  = nbytes - contiguous;
+        nwritten = ::writev(_write_fd, iov, 2);
+    } else
+#endif
+    {
+        nwritten = ::write(_write_fd, head, nbytes);
+    }
     if (nwritten <= 0) {
         perf_count(_perf_errors);
         close(_write_fd);
@@ -613,16 +1044,26 @@ void DataFlash_File::_io_timer(void)
         _initialised = false;
     } else {
         _write_offset += nwritten;
+        _bytes_written += nwritten;
+        _writebuf.advance(nwritten);
         /*
           the best strategy for minimising corruption on microSD cards
           seems to be to write in 4k chunks and fsync the file on each
           chunk, ensuring the directory entry is updated after each
-          write.
+          write. Boards with a larger buffer fsync periodically
+          instead, as a sync per chunk limits the write rate
          */
 #if CONFIG_HAL_BOARD != HAL_BOARD_AVR_SITL
-        ::fsync(_write_fd);
+        uint32_t now_ms = hal.scheduler->millis();
+        if (DATAFLASH_FILE_FSYNC_MS == 0 ||
+            now_ms - _last_fsync_ms >= DATAFLASH_FILE_FSYNC_MS) {
+            perf_begin(_perf_fsync);
+            ::fsync(_write_fd);
+            perf_end(_perf_fsync);
+            _last_fsync_ms = now_ms;
+            _fsyncs++;
+        }
 #endif
-        BUF_ADVANCEHEAD(_writebuf, nwritten);
     }
     perf_end(_perf_write);
 }
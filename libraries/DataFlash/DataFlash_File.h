@@ -10,6 +10,9 @@
 #ifndef DataFlash_File_h
 #define DataFlash_File_h
 
+#include <utility/RingBuffer.h>
+#include <pthread.h>
+
 #if CONFIG_HAL_BOARD == HAL_BOARD_PX4 || CONFIG_HAL_BOARD == HAL_BOARD_VRBRAIN
 #include <systemlib/perf_counter.h>
 #else
@@ -18,6 +21,65 @@
 #define perf_count(x)
 #endif
 
+/*
+  write buffer tuning. Boards with plenty of RAM and a real filesystem
+  use a large buffer drained with writev() in big batches and only
+  fsync() periodically. Others write small chunks and fsync() each
+  one, which is the most robust approach on microSD with FAT. All of
+  these can be overridden at build time, eg. with EXTRAFLAGS in
+  config.mk
+ */
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_AVR_SITL
+#ifndef DATAFLASH_FILE_BUFSIZE
+#define DATAFLASH_FILE_BUFSIZE   (512*1024UL)
+#endif
+#ifndef DATAFLASH_FILE_CHUNK
+#define DATAFLASH_FILE_CHUNK     (64*1024UL)
+#endif
+#ifndef DATAFLASH_FILE_FSYNC_MS
+#define DATAFLASH_FILE_FSYNC_MS  1000
+#endif
+#define DATAFLASH_FILE_WRITEV    1
+#if defined(__linux__) && !defined(DATAFLASH_FILE_PREALLOC)
+#define DATAFLASH_FILE_PREALLOC  (8*1024*1024UL)
+#endif
+#else
+#ifndef DATAFLASH_FILE_BUFSIZE
+#define DATAFLASH_FILE_BUFSIZE   (16*1024UL)
+#endif
+#ifndef DATAFLASH_FILE_FSYNC_MS
+#define DATAFLASH_FILE_FSYNC_MS  0
+#endif
+#define DATAFLASH_FILE_WRITEV    0
+#endif
+
+/*
+  log files are grown in extents of this many bytes with fallocate(),
+  so the filesystem doesn't have to allocate space on every write.
+  Unused space is released when the log is closed. Only available on
+  Linux, 0 to disable
+ */
+#ifndef DATAFLASH_FILE_PREALLOC
+#define DATAFLASH_FILE_PREALLOC  0
+#endif
+
+/*
+  the log is continued in a new file when the current file reaches
+  DATAFLASH_FILE_ROTATE_SIZE bytes or has been written for
+  DATAFLASH_FILE_ROTATE_MS. Once the logs take more than
+  DATAFLASH_FILE_QUOTA_MB the oldest are removed. 0 disables each of
+  these
+ */
+#ifndef DATAFLASH_FILE_ROTATE_SIZE
+#define DATAFLASH_FILE_ROTATE_SIZE 0
+#endif
+#ifndef DATAFLASH_FILE_ROTATE_MS
+#define DATAFLASH_FILE_ROTATE_MS   0
+#endif
+#ifndef DATAFLASH_FILE_QUOTA_MB
+#define DATAFLASH_FILE_QUOTA_MB    0
+#endif
+
 
 class DataFlash_File : public DataFlash_Class
 {
@@ -38,6 +100,7 @@ public:
 
     // high level interface
     uint16_t find_last_log(void);
+    uint16_t find_next_log(uint16_t log_num);
     void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page);
     void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc);
     int16_t get_log_data(uint16_t log_num, uint16_t page, uint32_t offset, uint16_t len, uint8_t *data);
@@ -51,9 +114,14 @@ public:
     void ShowDeviceInfo(AP_HAL::BetterStream *port);
     void ListAvailableLogs(AP_HAL::BetterStream *port);
 
+    // write statistics
+    bool get_write_stats(struct write_stats &stats) const;
+    uint16_t get_dropped_msgs(uint8_t msg_type) const { return _dropped_by_type[msg_type]; }
+
 private:
     int _write_fd;
     int _read_fd;
+    uint16_t _write_log_num;
     uint16_t _read_fd_log_num;
     uint32_t _read_offset;
     uint32_t _write_offset;
@@ -65,13 +133,43 @@ private:
     */
     void ReadBlock(void *pkt, uint16_t size);
 
-    // write buffer
-    uint8_t *_writebuf;
-    const uint16_t _writebuf_size;
-    const uint16_t _writebuf_chunk;
-    volatile uint16_t _writebuf_head;
-    volatile uint16_t _writebuf_tail;
+    // write buffer, filled by the main thread and drained by the IO
+    // thread
+    ByteBuffer _writebuf;
+    const uint32_t _writebuf_size;
+    const uint32_t _writebuf_chunk;
     uint32_t _last_write_time;
+    uint32_t _last_fsync_ms;
+
+    // write statistics. The drop counts and minimum free space are
+    // updated by the main thread, the rest by the IO thread
+    uint32_t _dropped_msgs;
+    uint32_t _dropped_bytes;
+    uint32_t _buf_min_free;
+    uint32_t _bytes_written;
+    uint32_t _fsyncs;
+    uint16_t _dropped_by_type[256];
+
+    // end of the space allocated for the log being written
+    uint32_t _prealloc_end;
+
+    /*
+      log rotation. The main thread counts the bytes it has buffered
+      for the current file, and when a limit is reached it sets
+      _rotate_offset to that count and writes the log formats, which
+      go to the new file. The IO thread switches files when it has
+      written up to _rotate_offset, and then clears it
+     */
+    const uint32_t _rotate_size;
+    const uint32_t _rotate_ms;
+    uint32_t _log_buffered;
+    uint32_t _log_start_ms;
+    volatile uint32_t _rotate_offset;
+
+    // the IO thread checks the logs against the quota each time the
+    // current file grows past _prune_check_offset
+    const uint32_t _quota_mb;
+    uint32_t _prune_check_offset;
 
     /* construct a file name given a log number. Caller must free. */
     char *_log_file_name(uint16_t log_num);
@@ -79,9 +177,46 @@ private:
     uint32_t _get_log_size(uint16_t log_num);
     uint32_t _get_log_time(uint16_t log_num);
 
+    /*
+      index of the log directory, built once at startup and kept up to
+      date as logs are started, stopped and erased, so listing logs
+      doesn't need a stat() per log. Indexed by log number, with a
+      size of zero for logs that don't exist
+     */
+    struct log_index_entry {
+        uint32_t size;
+        uint32_t time_utc;
+    };
+    struct log_index_entry *_log_index;
+    uint16_t _log_count;
+    uint16_t _log_highest;
+
+    // the most recently started log, from LASTLOG.TXT
+    uint16_t _last_log_num;
+
+    /*
+      the IO thread rotates and prunes logs, so the open files, the
+      log index and LASTLOG.TXT are only changed with this held. The
+      IO thread never waits for it, as on SITL it runs from a signal
+      handler, and instead tries again on its next call
+     */
+    pthread_mutex_t _file_mutex;
+
+    uint16_t _read_lastlog(void);
+    void _build_log_index(void);
+    bool _log_present(uint16_t log_num) const;
+
     void stop_logging(void);
+    bool _log_being_read(uint16_t log_num) const;
+
+    int _create_log(uint16_t &log_num);
+    void _close_log(int fd, uint16_t log_num);
+    void _start_rotation(const uint8_t *msg, uint16_t size);
+    void _rotate_log(void);
+    void _prune_logs(void);
 
     void _io_timer(void);
+    void _io_write(void);
 
 #if CONFIG_HAL_BOARD == HAL_BOARD_PX4 || CONFIG_HAL_BOARD == HAL_BOARD_VRBRAIN
     // performance counters
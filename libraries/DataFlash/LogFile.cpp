@@ -26,32 +26,40 @@ uint16_t DataFlash_Block::get_num_logs(void)
     uint16_t lastpage;
     uint16_t last;
     uint16_t first;
+    struct PageHeader ph;
 
-    if (find_last_page() == 1) {
+    if (df_NumLogsValid) {
+        return df_NumLogs;
+    }
+    df_NumLogsValid = true;
+    df_NumLogs = 0;
+
+    lastpage = find_last_page();
+    if (lastpage == 1) {
         return 0;
     }
 
-    StartRead(1);
+    ReadPageHeader(1, ph);
 
-    if (GetFileNumber() == 0xFFFF) {
+    if (ph.FileNumber == 0xFFFF) {
         return 0;
     }
 
-    lastpage = find_last_page();
-    StartRead(lastpage);
-    last = GetFileNumber();
-    StartRead(lastpage + 2);
-    first = GetFileNumber();
+    ReadPageHeader(lastpage, ph);
+    last = ph.FileNumber;
+    ReadPageHeader(lastpage + 2, ph);
+    first = ph.FileNumber;
     if(first > last) {
-        StartRead(1);
-        first = GetFileNumber();
+        ReadPageHeader(1, ph);
+        first = ph.FileNumber;
     }
 
     if (last == first) {
-        return 1;
+        df_NumLogs = 1;
+    } else {
+        df_NumLogs = last - first + 1;
     }
-
-    return (last - first + 1);
+    return df_NumLogs;
 }
 
 
@@ -70,6 +78,7 @@ uint16_t DataFlash_Block::start_new_log(void)
         StartWrite(1);
         //Serial.println("start log from 0");
         log_write_started = true;
+        InvalidateCache();
         return 1;
     }
 
@@ -91,6 +100,7 @@ uint16_t DataFlash_Block::start_new_log(void)
         StartWrite(last_page + 1);
     }
     log_write_started = true;
+    InvalidateCache();
     return new_log_num;
 }
 
@@ -98,18 +108,30 @@ uint16_t DataFlash_Block::start_new_log(void)
 // The first page may be greater than the last page if the DataFlash has been filled and partially overwritten.
 void DataFlash_Block::get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page)
 {
-    uint16_t num = get_num_logs();
+    uint16_t num;
     uint16_t look;
+    struct PageHeader ph;
 
     if (df_BufferIdx != 0) {
         FinishWrite();
         hal.scheduler->delay(100);
+        // anything found before the last page was flushed is stale
+        InvalidateCache();
     }
 
+    for (uint8_t i=0; i<DF_BOUNDS_CACHE_SIZE; i++) {
+        if (df_BoundsCache[i].log_num == log_num && log_num != 0) {
+            start_page = df_BoundsCache[i].start_page;
+            end_page = df_BoundsCache[i].end_page;
+            return;
+        }
+    }
+
+    num = get_num_logs();
     if(num == 1)
     {
-        StartRead(df_NumPages);
-        if (GetFileNumber() == 0xFFFF)
+        ReadPageHeader(df_NumPages, ph);
+        if (ph.FileNumber == 0xFFFF)
         {
             start_page = 1;
             end_page = find_last_page_of_log((uint16_t)log_num);
@@ -120,8 +142,8 @@ void DataFlash_Block::get_log_boundaries(uint16_t log_num, uint16_t & start_page
 
     } else {
         if(log_num==1) {
-            StartRead(df_NumPages);
-            if(GetFileNumber() == 0xFFFF) {
+            ReadPageHeader(df_NumPages, ph);
+            if(ph.FileNumber == 0xFFFF) {
                 start_page = 1;
             } else {
                 start_page = find_last_page() + 1;
@@ -145,6 +167,12 @@ void DataFlash_Block::get_log_boundaries(uint16_t log_num, uint16_t & start_page
     if (end_page == 0) {
         end_page = start_page;
     }
+
+    struct LogBoundaries &b = df_BoundsCache[df_BoundsNext];
+    b.log_num = log_num;
+    b.start_page = start_page;
+    b.end_page = end_page;
+    df_BoundsNext = (df_BoundsNext + 1) % DF_BOUNDS_CACHE_SIZE;
 }
 
 // find log size and time
@@ -162,8 +190,9 @@ void DataFlash_Block::get_log_info(uint16_t log_num, uint32_t &size, uint32_t &t
 
 bool DataFlash_Block::check_wrapped(void)
 {
-    StartRead(df_NumPages);
-    if(GetFileNumber() == 0xFFFF)
+    struct PageHeader ph;
+    ReadPageHeader(df_NumPages, ph);
+    if(ph.FileNumber == 0xFFFF)
         return 0;
     else
         return 1;
@@ -173,9 +202,9 @@ bool DataFlash_Block::check_wrapped(void)
 // This funciton finds the last log number
 uint16_t DataFlash_Block::find_last_log(void)
 {
-    uint16_t last_page = find_last_page();
-    StartRead(last_page);
-    return GetFileNumber();
+    struct PageHeader ph;
+    ReadPageHeader(find_last_page(), ph);
+    return ph.FileNumber;
 }
 
 // This function finds the last page of the last file
@@ -187,14 +216,19 @@ uint16_t DataFlash_Block::find_last_page(void)
     uint32_t look_hash;
     uint32_t bottom_hash;
     uint32_t top_hash;
+    struct PageHeader ph;
+
+    if (df_LastPageValid) {
+        return df_LastPage;
+    }
 
-    StartRead(bottom);
-    bottom_hash = ((int32_t)GetFileNumber()<<16) | GetFilePage();
+    ReadPageHeader(bottom, ph);
+    bottom_hash = ((int32_t)ph.FileNumber<<16) | ph.FilePage;
 
     while(top-bottom > 1) {
         look = (top+bottom)/2;
-        StartRead(look);
-        look_hash = (int32_t)GetFileNumber()<<16 | GetFilePage();
+        ReadPageHeader(look, ph);
+        look_hash = (int32_t)ph.FileNumber<<16 | ph.FilePage;
         if (look_hash >= 0xFFFF0000) look_hash = 0;
 
         if(look_hash < bottom_hash) {
@@ -207,16 +241,14 @@ uint16_t DataFlash_Block::find_last_page(void)
         }
     }
 
-    StartRead(top);
-    top_hash = ((int32_t)GetFileNumber()<<16) | GetFilePage();
+    ReadPageHeader(top, ph);
+    top_hash = ((int32_t)ph.FileNumber<<16) | ph.FilePage;
     if (top_hash >= 0xFFFF0000) {
         top_hash = 0;
     }
-    if (top_hash > bottom_hash) {
-        return top;
-    }
-
-    return bottom;
+    df_LastPage = (top_hash > bottom_hash) ? top : bottom;
+    df_LastPageValid = true;
+    return df_LastPage;
 }
 
 // This function finds the last page of a particular log file
@@ -227,11 +259,12 @@ uint16_t DataFlash_Block::find_last_page_of_log(uint16_t log_number)
     uint16_t top;
     uint32_t look_hash;
     uint32_t check_hash;
+    struct PageHeader ph;
 
     if(check_wrapped())
     {
-        StartRead(1);
-        bottom = GetFileNumber();
+        ReadPageHeader(1, ph);
+        bottom = ph.FileNumber;
         if (bottom > log_number)
         {
             bottom = find_last_page();
@@ -250,8 +283,8 @@ uint16_t DataFlash_Block::find_last_page_of_log(uint16_t log_number)
     while(top-bottom > 1)
     {
         look = (top+bottom)/2;
-        StartRead(look);
-        look_hash = (int32_t)GetFileNumber()<<16 | GetFilePage();
+        ReadPageHeader(look, ph);
+        look_hash = (int32_t)ph.FileNumber<<16 | ph.FilePage;
         if (look_hash >= 0xFFFF0000) look_hash = 0;
 
         if(look_hash > check_hash) {
@@ -263,37 +296,188 @@ uint16_t DataFlash_Block::find_last_page_of_log(uint16_t log_number)
         }
     }
 
-    StartRead(top);
-    if (GetFileNumber() == log_number) return top;
+    ReadPageHeader(top, ph);
+    if (ph.FileNumber == log_number) return top;
 
-    StartRead(bottom);
-    if (GetFileNumber() == log_number) return bottom;
+    ReadPageHeader(bottom, ph);
+    if (ph.FileNumber == log_number) return bottom;
 
     return -1;
 }
 
 #define PGM_UINT8(addr) pgm_read_byte((const prog_char *)addr)
 
+static uint8_t compact_field_size(char c);
+
 /*
   read and print a log entry using the format strings from the given structure
  */
-void DataFlash_Class::_print_log_entry(uint8_t msg_type,
+bool DataFlash_Class::_print_log_entry(uint8_t msg_type, struct compact_reader &reader,
                                        void (*print_mode)(AP_HAL::BetterStream *port, uint8_t mode),
                                        AP_HAL::BetterStream *port)
 {
     uint8_t i;
+    if (msg_type == LOG_COMPACT_MSG) {
+        return _print_compact_entry(reader, print_mode, port);
+    }
     for (i=0; i<_num_types; i++) {
         if (msg_type == PGM_UINT8(&_structures[i].msg_type)) {
             break;
         }
     }
     if (i == _num_types) {
-        port->printf_P(PSTR("UNKN, %u\n"), (unsigned)msg_type);
-        return;
+        return false;
     }
     uint8_t msg_len = PGM_UINT8(&_structures[i].msg_len) - 3;
     uint8_t pkt[msg_len];
     ReadBlock(pkt, msg_len);
+
+    if (msg_type == LOG_FORMAT_COMPACT_MSG) {
+        // the encoding of a compact type
+        _compact_reader_type(reader, pkt[0], (const char *)&pkt[1]);
+    } else {
+        // a full message is the reference for the next compact one
+        for (uint8_t t=0; t<reader.num_types; t++) {
+            struct compact_state &c = reader.types[t];
+            if (c.msg_type == msg_type && c.msg_len == msg_len+3) {
+                memcpy(&c.ref[3], pkt, msg_len);
+                c.count = 1;
+                break;
+            }
+        }
+    }
+
+    _print_log_message(i, pkt, print_mode, port);
+    return true;
+}
+
+/*
+  find or add a type in the compact reader, with the encoding given
+  or, if that is NULL, the encoding we would use for the type
+  ourselves. Returns NULL if the type can't be added
+ */
+struct DataFlash_Class::compact_state *DataFlash_Class::_compact_reader_type(struct compact_reader &reader,
+                                                                             uint8_t msg_type,
+                                                                             const char *encoding)
+{
+    struct compact_state *c = NULL;
+    for (uint8_t t=0; t<reader.num_types; t++) {
+        if (reader.types[t].msg_type == msg_type) {
+            c = &reader.types[t];
+            if (encoding == NULL) {
+                return c;
+            }
+            break;
+        }
+    }
+    uint8_t i;
+    for (i=0; i<_num_types; i++) {
+        if (msg_type == PGM_UINT8(&_structures[i].msg_type)) {
+            break;
+        }
+    }
+    if (i == _num_types) {
+        return NULL;
+    }
+    uint8_t msg_len = PGM_UINT8(&_structures[i].msg_len);
+    if (msg_len > DATAFLASH_COMPACT_MAX_LEN) {
+        return NULL;
+    }
+    if (c == NULL) {
+        if (reader.num_types >= DATAFLASH_COMPACT_READ_TYPES) {
+            return NULL;
+        }
+        c = &reader.types[reader.num_types];
+    }
+    if (encoding != NULL) {
+        memcpy(c->encoding, encoding, sizeof(c->encoding));
+    } else {
+        char format[17];
+        strncpy_P(format, _structures[i].format, 16);
+        format[16] = 0;
+        if (!compact_encoding(format, msg_len, c->encoding)) {
+            return NULL;
+        }
+    }
+    if (c == &reader.types[reader.num_types]) {
+        reader.num_types++;
+    }
+    c->msg_type = msg_type;
+    c->msg_len = msg_len;
+    c->count = 0;
+    c->ref[0] = HEAD_BYTE1;
+    c->ref[1] = HEAD_BYTE2;
+    c->ref[2] = msg_type;
+    return c;
+}
+
+/*
+  read a compact message and print it decoded against the previous
+  message of its type. The fields are read one at a time following
+  the encoding, so the whole message is consumed even if there is no
+  previous message to decode it against
+ */
+bool DataFlash_Class::_print_compact_entry(struct compact_reader &reader,
+                                           void (*print_mode)(AP_HAL::BetterStream *port, uint8_t mode),
+                                           AP_HAL::BetterStream *port)
+{
+    uint8_t type;
+    ReadBlock(&type, 1);
+    struct compact_state *c = _compact_reader_type(reader, type, NULL);
+    if (c == NULL) {
+        return false;
+    }
+
+    uint8_t in[DATAFLASH_COMPACT_MAX_LEN];
+    uint8_t n = 0;
+    for (uint8_t f=0; f<16 && c->encoding[f] != 0; f++) {
+        char e = c->encoding[f];
+        if (e == 'h' || e == 'i') {
+            uint8_t b;
+            do {
+                if (n >= sizeof(in)) {
+                    return false;
+                }
+                ReadBlock(&b, 1);
+                in[n++] = b;
+            } while (b & 0x80);
+        } else {
+            uint8_t size = compact_field_size(e);
+            if (size == 0 || n + size > sizeof(in)) {
+                return false;
+            }
+            ReadBlock(&in[n], size);
+            n += size;
+        }
+    }
+
+    if (c->count == 0 ||
+        compact_decode(c->encoding, c->msg_len, in, n, c->ref) != n) {
+        // no reference to decode against, so just note it
+        c->count = 0;
+        port->printf_P(PSTR("COMPACT, %u\n"), (unsigned)type);
+        return true;
+    }
+
+    uint8_t i;
+    for (i=0; i<_num_types; i++) {
+        if (type == PGM_UINT8(&_structures[i].msg_type)) {
+            break;
+        }
+    }
+    _print_log_message(i, &c->ref[3], print_mode, port);
+    return true;
+}
+
+/*
+  print one message, without its header, using the format strings
+  of structure i
+ */
+void DataFlash_Class::_print_log_message(uint8_t i, const uint8_t *pkt,
+                                         void (*print_mode)(AP_HAL::BetterStream *port, uint8_t mode),
+                                         AP_HAL::BetterStream *port)
+{
+    uint8_t msg_len = PGM_UINT8(&_structures[i].msg_len) - 3;
     port->printf_P(PSTR("%S, "), _structures[i].name);
     for (uint8_t ofs=0, fmt_ofs=0; ofs<msg_len; fmt_ofs++) {
         char fmt = PGM_UINT8(&_structures[i].format[fmt_ofs]);
@@ -447,6 +631,9 @@ void DataFlash_Block::LogReadProcess(uint16_t log_num,
     uint8_t log_step = 0;
     uint16_t page = start_page;
     bool first_entry = true;
+    uint32_t skipped = 0;
+    struct compact_reader reader;
+    reader.num_types = 0;
 
     if (df_BufferIdx != 0) {
         FinishWrite();
@@ -464,13 +651,19 @@ void DataFlash_Block::LogReadProcess(uint16_t log_num,
 			case 0:
 				if (data == HEAD_BYTE1) {
 					log_step++;
+                } else {
+                    skipped++;
                 }
 				break;
 
 			case 1:
 				if (data == HEAD_BYTE2) {
 					log_step++;
+                } else if (data == HEAD_BYTE1) {
+                    // the first header byte may have been damaged data
+                    skipped++;
                 } else {
+                    skipped += 2;
 					log_step = 0;
 				}
 				break;
@@ -481,17 +674,23 @@ void DataFlash_Block::LogReadProcess(uint16_t log_num,
                     _print_log_formats(port);
                 }
                 first_entry = false;
-                _print_log_entry(data, print_mode, port);
+                if (!_print_log_entry(data, reader, print_mode, port)) {
+                    // not a message, resync on the next header
+                    skipped += 3;
+                }
                 break;
 		}
         uint16_t new_page = GetPage();
         if (new_page != page) {
             if (new_page == end_page+1 || new_page == start_page) {
-                return;
+                break;
             }
             page = new_page;
         }
 	}
+    if (skipped != 0) {
+        port->printf_P(PSTR("Skipped %lu bytes of damaged log\n"), (unsigned long)skipped);
+    }
 }
 
 /*
@@ -557,12 +756,35 @@ void DataFlash_Block::ListAvailableLogs(AP_HAL::BetterStream *port)
     port->println();
 }
 
+/*
+  find the next log number after log_num, or 0 if there are no more
+  logs. By default logs are numbered consecutively up to
+  find_last_log()
+ */
+uint16_t DataFlash_Class::find_next_log(uint16_t log_num)
+{
+    uint16_t num_logs = get_num_logs();
+    if (num_logs == 0) {
+        return 0;
+    }
+    uint16_t last_log_num = find_last_log();
+    uint16_t first_log_num = last_log_num + 1 - num_logs;
+    if (log_num < first_log_num) {
+        return first_log_num;
+    }
+    if (log_num >= last_log_num) {
+        return 0;
+    }
+    return log_num + 1;
+}
+
 // This function starts a new log file in the DataFlash, and writes
 // the format of supported messages in the log, plus all parameters
 uint16_t DataFlash_Class::StartNewLog(void)
 {
     uint16_t ret;
     ret = start_new_log();
+    UpdateRates();
 
     // write log formats so the log is self-describing
     for (uint8_t i=0; i<_num_types; i++) {
@@ -571,11 +793,37 @@ uint16_t DataFlash_Class::StartNewLog(void)
         hal.scheduler->delay(10);
     }
 
+#if DATAFLASH_COMPACT_TYPES
+    // the compact encodings, each starting with a full message
+    for (uint8_t i=0; i<_num_compact; i++) {
+        Log_Write_Format_Compact(_compact[i]);
+        _compact[i].count = 0;
+    }
+#endif
+
     // and all current parameters
     Log_Write_Parameters();
     return ret;
 }
 
+/*
+  write the log formats again part way through a log, for backends
+  that continue a log in a new file. Compact types restart with a full
+  message so the new file can be decoded on its own
+ */
+void DataFlash_Class::Log_Write_Formats(void)
+{
+    for (uint8_t i=0; i<_num_types; i++) {
+        Log_Write_Format(&_structures[i]);
+    }
+#if DATAFLASH_COMPACT_TYPES
+    for (uint8_t i=0; i<_num_compact; i++) {
+        Log_Write_Format_Compact(_compact[i]);
+        _compact[i].count = 0;
+    }
+#endif
+}
+
 // add new logging formats to the log. Used by libraries that want to
 // add their own log messages
 void DataFlash_Class::AddLogFormats(const struct LogStructure *structures, uint8_t num_types)
@@ -586,6 +834,538 @@ void DataFlash_Class::AddLogFormats(const struct LogStructure *structures, uint8
     }
 }
 
+/*
+  size of a field in the compact encoding
+ */
+static uint8_t compact_field_size(char c)
+{
+    switch (c) {
+    case 'B':
+        return 1;
+    case 'H':
+    case 'h':
+        return 2;
+    case 'I':
+    case 'i':
+        return 4;
+    case 'N':
+        return 16;
+    case 'Z':
+        return 64;
+    }
+    return 0;
+}
+
+/*
+  choose the compact encoding for a message format. Integers other
+  than bytes are delta encoded, and everything else is stored raw.
+  Returns false if the format has a field we don't know or doesn't
+  match the message length
+ */
+bool DataFlash_Class::compact_encoding(const char *format, uint8_t msg_len, char *encoding)
+{
+    uint8_t len = sizeof(struct log_Header);
+    memset(encoding, 0, 16);
+    for (uint8_t i=0; i<16 && format[i] != 0; i++) {
+        char e;
+        switch (format[i]) {
+        case 'b':
+        case 'B':
+        case 'M':
+            e = 'B';
+            break;
+        case 'h':
+        case 'H':
+        case 'c':
+        case 'C':
+            e = 'h';
+            break;
+        case 'i':
+        case 'I':
+        case 'e':
+        case 'E':
+        case 'L':
+            e = 'i';
+            break;
+        case 'f':
+        case 'n':
+            e = 'I';
+            break;
+        case 'N':
+            e = 'N';
+            break;
+        case 'Z':
+            e = 'Z';
+            break;
+        default:
+            return false;
+        }
+        encoding[i] = e;
+        len += compact_field_size(e);
+    }
+    return len == msg_len;
+}
+
+/*
+  encode a message against the previous message of the same type,
+  returning the encoded length, or -1 if it would be longer than
+  max_len. Deltas are taken modulo the field size, so wrapping
+  counters cost no more than small steps
+ */
+int16_t DataFlash_Class::compact_encode(const char *encoding, const uint8_t *msg, const uint8_t *ref,
+                                        uint8_t *out, uint8_t max_len)
+{
+    uint8_t n = 0;
+    uint8_t ofs = sizeof(struct log_Header);
+    for (uint8_t i=0; i<16 && encoding[i] != 0; i++) {
+        char e = encoding[i];
+        uint8_t size = compact_field_size(e);
+        if (e == 'h' || e == 'i') {
+            uint32_t v = 0, r = 0;
+            memcpy(&v, &msg[ofs], size);
+            memcpy(&r, &ref[ofs], size);
+            int32_t d;
+            if (size == 2) {
+                d = (int16_t)(uint16_t)(v - r);
+            } else {
+                d = (int32_t)(v - r);
+            }
+            // zig-zag, so small negative deltas are small too
+            uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            do {
+                if (n >= max_len) {
+                    return -1;
+                }
+                uint8_t b = z & 0x7F;
+                z >>= 7;
+                out[n++] = z ? (b | 0x80) : b;
+            } while (z != 0);
+        } else {
+            if (n + size > max_len) {
+                return -1;
+            }
+            memcpy(&out[n], &msg[ofs], size);
+            n += size;
+        }
+        ofs += size;
+    }
+    return n;
+}
+
+/*
+  decode a compact message. On entry msg holds the previous message of
+  the type, and on success it holds the decoded message. Returns the
+  number of bytes of in used, or -1 if the data is bad or too short,
+  in which case msg may be partly updated
+ */
+int16_t DataFlash_Class::compact_decode(const char *encoding, uint8_t msg_len,
+                                        const uint8_t *in, uint16_t in_len, uint8_t *msg)
+{
+    uint16_t n = 0;
+    uint8_t ofs = sizeof(struct log_Header);
+    for (uint8_t i=0; i<16 && encoding[i] != 0; i++) {
+        char e = encoding[i];
+        uint8_t size = compact_field_size(e);
+        if (size == 0 || ofs + size > msg_len) {
+            return -1;
+        }
+        if (e == 'h' || e == 'i') {
+            uint32_t z = 0;
+            uint8_t shift = 0;
+            uint8_t b;
+            do {
+                if (n >= in_len || shift > 28) {
+                    return -1;
+                }
+                b = in[n++];
+                z |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+            uint32_t r = 0;
+            memcpy(&r, &msg[ofs], size);
+            r += d;
+            memcpy(&msg[ofs], &r, size);
+        } else {
+            if (n + size > in_len) {
+                return -1;
+            }
+            memcpy(&msg[ofs], &in[n], size);
+            n += size;
+        }
+        ofs += size;
+    }
+    if (ofs != msg_len) {
+        return -1;
+    }
+    return n;
+}
+
+/*
+  use the compact encoding for a message type
+ */
+bool DataFlash_Class::SetCompact(uint8_t msg_type)
+{
+#if DATAFLASH_COMPACT_TYPES
+    for (uint8_t i=0; i<_num_compact; i++) {
+        if (_compact[i].msg_type == msg_type) {
+            return true;
+        }
+    }
+    if (_num_compact >= DATAFLASH_COMPACT_TYPES) {
+        return false;
+    }
+    for (uint8_t i=0; i<_num_types; i++) {
+        if (msg_type != PGM_UINT8(&_structures[i].msg_type)) {
+            continue;
+        }
+        uint8_t msg_len = PGM_UINT8(&_structures[i].msg_len);
+        if (msg_len > DATAFLASH_COMPACT_MAX_LEN) {
+            return false;
+        }
+        struct compact_state &c = _compact[_num_compact];
+        char format[17];
+        strncpy_P(format, _structures[i].format, 16);
+        format[16] = 0;
+        if (!compact_encoding(format, msg_len, c.encoding)) {
+            return false;
+        }
+        c.msg_type = msg_type;
+        c.msg_len = msg_len;
+        c.count = 0;
+        _num_compact++;
+        if (log_write_started) {
+            Log_Write_Format_Compact(c);
+        }
+        return true;
+    }
+#else
+    (void)msg_type;
+#endif
+    return false;
+}
+
+/*
+  use the compact encoding for the high rate common messages. On
+  AVR only the slots that are free are used
+ */
+void DataFlash_Class::SetCompactCommon(void)
+{
+    SetCompact(LOG_IMU_MSG);
+#if AP_AHRS_NAVEKF_AVAILABLE
+    SetCompact(LOG_EKF1_MSG);
+    SetCompact(LOG_EKF2_MSG);
+    SetCompact(LOG_EKF3_MSG);
+    SetCompact(LOG_EKF4_MSG);
+#endif
+    SetCompact(LOG_IMU2_MSG);
+}
+
+/*
+  write all message types in full
+ */
+void DataFlash_Class::ClearCompact(void)
+{
+#if DATAFLASH_COMPACT_TYPES
+    _num_compact = 0;
+#endif
+}
+
+/*
+  write a complete message, using the compact encoding if it is
+  enabled for the type
+ */
+void DataFlash_Class::WritePacket(const void *pBuffer, uint16_t size)
+{
+#if DATAFLASH_COMPACT_TYPES
+    const uint8_t *msg = (const uint8_t *)pBuffer;
+    for (uint8_t i=0; i<_num_compact; i++) {
+        if (_compact[i].msg_type == msg[2] && _compact[i].msg_len == size) {
+            Write_Compact(_compact[i], msg);
+            return;
+        }
+    }
+#endif
+    WriteBlock(pBuffer, size);
+}
+
+#if DATAFLASH_COMPACT_TYPES
+void DataFlash_Class::Write_Compact(struct compact_state &c, const uint8_t *msg)
+{
+#if HAL_OS_POSIX_IO
+    // a dropped message leaves the reader with the wrong reference,
+    // so after any drop every type starts again with a full message
+    struct write_stats stats;
+    if (get_write_stats(stats) && stats.dropped_msgs != _compact_drops) {
+        _compact_drops = stats.dropped_msgs;
+        for (uint8_t i=0; i<_num_compact; i++) {
+            _compact[i].count = 0;
+        }
+    }
+#endif
+    if (c.count != 0) {
+        uint8_t pkt[4+DATAFLASH_COMPACT_MAX_LEN];
+        // only worth writing if it is shorter than the full message
+        int16_t n = compact_encode(c.encoding, msg, c.ref, &pkt[4], c.msg_len - 5);
+        if (n >= 0) {
+            pkt[0] = HEAD_BYTE1;
+            pkt[1] = HEAD_BYTE2;
+            pkt[2] = LOG_COMPACT_MSG;
+            pkt[3] = c.msg_type;
+            WriteBlock(pkt, n + 4);
+            memcpy(c.ref, msg, c.msg_len);
+            c.count--;
+            return;
+        }
+    }
+    WriteBlock(msg, c.msg_len);
+    memcpy(c.ref, msg, c.msg_len);
+    c.count = DATAFLASH_COMPACT_KEYFRAME;
+}
+
+/*
+  write the compact encoding of a message type to the log
+ */
+void DataFlash_Class::Log_Write_Format_Compact(const struct compact_state &c)
+{
+    struct log_Format_Compact pkt;
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.head1 = HEAD_BYTE1;
+    pkt.head2 = HEAD_BYTE2;
+    pkt.msgid = LOG_FORMAT_COMPACT_MSG;
+    pkt.type = c.msg_type;
+    memcpy(pkt.encoding, c.encoding, sizeof(pkt.encoding));
+    WriteBlock(&pkt, sizeof(pkt));
+}
+#endif // DATAFLASH_COMPACT_TYPES
+
+#if DATAFLASH_RATE_LIMIT
+const AP_Param::GroupInfo DataFlash_Class::var_info[] PROGMEM = {
+    // @Param: RATE1_MSG
+    // @DisplayName: Rate limited message type 1
+    // @Description: Log message type to limit to LOG_RATE1_HZ, as listed in the FMT messages of a log. The FMT and FMTC format messages are always written. 0 for none
+    // @Range: 0 255
+    // @User: Advanced
+    AP_GROUPINFO("RATE1_MSG", 0, DataFlash_Class, _rate_msg[0], 0),
+
+    // @Param: RATE1_HZ
+    // @DisplayName: Rate limit 1
+    // @Description: Maximum rate to log message type LOG_RATE1_MSG at. Messages are only written as often as the vehicle code asks for them, so this can only lower the rate. 0 stops the type being logged
+    // @Units: Hz
+    // @Range: 0 1000
+    // @User: Advanced
+    AP_GROUPINFO("RATE1_HZ",  1, DataFlash_Class, _rate_hz[0], 0),
+
+    // @Param: RATE2_MSG
+    // @DisplayName: Rate limited message type 2
+    // @Description: Log message type to limit to LOG_RATE2_HZ. 0 for none
+    // @Range: 0 255
+    // @User: Advanced
+    AP_GROUPINFO("RATE2_MSG", 2, DataFlash_Class, _rate_msg[1], 0),
+
+    // @Param: RATE2_HZ
+    // @DisplayName: Rate limit 2
+    // @Description: Maximum rate to log message type LOG_RATE2_MSG at. 0 stops the type being logged
+    // @Units: Hz
+    // @Range: 0 1000
+    // @User: Advanced
+    AP_GROUPINFO("RATE2_HZ",  3, DataFlash_Class, _rate_hz[1], 0),
+
+    // @Param: RATE3_MSG
+    // @DisplayName: Rate limited message type 3
+    // @Description: Log message type to limit to LOG_RATE3_HZ. 0 for none
+    // @Range: 0 255
+    // @User: Advanced
+    AP_GROUPINFO("RATE3_MSG", 4, DataFlash_Class, _rate_msg[2], 0),
+
+    // @Param: RATE3_HZ
+    // @DisplayName: Rate limit 3
+    // @Description: Maximum rate to log message type LOG_RATE3_MSG at. 0 stops the type being logged
+    // @Units: Hz
+    // @Range: 0 1000
+    // @User: Advanced
+    AP_GROUPINFO("RATE3_HZ",  5, DataFlash_Class, _rate_hz[2], 0),
+
+    // @Param: RATE4_MSG
+    // @DisplayName: Rate limited message type 4
+    // @Description: Log message type to limit to LOG_RATE4_HZ. 0 for none
+    // @Range: 0 255
+    // @User: Advanced
+    AP_GROUPINFO("RATE4_MSG", 6, DataFlash_Class, _rate_msg[3], 0),
+
+    // @Param: RATE4_HZ
+    // @DisplayName: Rate limit 4
+    // @Description: Maximum rate to log message type LOG_RATE4_MSG at. 0 stops the type being logged
+    // @Units: Hz
+    // @Range: 0 1000
+    // @User: Advanced
+    AP_GROUPINFO("RATE4_HZ",  7, DataFlash_Class, _rate_hz[3], 0),
+
+    // @Param: RATE5_MSG
+    // @DisplayName: Rate limited message type 5
+    // @Description: Log message type to limit to LOG_RATE5_HZ. 0 for none
+    // @Range: 0 255
+    // @User: Advanced
+    AP_GROUPINFO("RATE5_MSG", 8, DataFlash_Class, _rate_msg[4], 0),
+
+    // @Param: RATE5_HZ
+    // @DisplayName: Rate limit 5
+    // @Description: Maximum rate to log message type LOG_RATE5_MSG at. 0 stops the type being logged
+    // @Units: Hz
+    // @Range: 0 1000
+    // @User: Advanced
+    AP_GROUPINFO("RATE5_HZ",  9, DataFlash_Class, _rate_hz[4], 0),
+
+    // @Param: RATE6_MSG
+    // @DisplayName: Rate limited message type 6
+    // @Description: Log message type to limit to LOG_RATE6_HZ. 0 for none
+    // @Range: 0 255
+    // @User: Advanced
+    AP_GROUPINFO("RATE6_MSG", 10, DataFlash_Class, _rate_msg[5], 0),
+
+    // @Param: RATE6_HZ
+    // @DisplayName: Rate limit 6
+    // @Description: Maximum rate to log message type LOG_RATE6_MSG at. 0 stops the type being logged
+    // @Units: Hz
+    // @Range: 0 1000
+    // @User: Advanced
+    AP_GROUPINFO("RATE6_HZ",  11, DataFlash_Class, _rate_hz[5], 0),
+
+    AP_GROUPEND
+};
+
+/*
+  set the rate a message type is limited to when it has no rate
+  parameter, for vehicles that call a Log_Write function faster than
+  its usual rate
+ */
+void DataFlash_Class::SetDefaultRate(uint8_t msg_type, uint16_t rate_hz)
+{
+    uint8_t i;
+    for (i=0; i<_num_rate_defaults; i++) {
+        if (_rate_default[i].msg_type == msg_type) {
+            break;
+        }
+    }
+    if (i == DATAFLASH_RATE_DEFAULTS) {
+        return;
+    }
+    if (i == _num_rate_defaults) {
+        _num_rate_defaults++;
+    }
+    _rate_default[i].msg_type = msg_type;
+    _rate_default[i].rate_hz = rate_hz;
+    UpdateRates();
+}
+
+/*
+  add a rate limit, keeping the statistics and timing of the old
+  limit for the type if there was one
+ */
+void DataFlash_Class::rate_add(const struct rate_state *old, uint8_t num_old, uint8_t msg_type, uint16_t rate_hz)
+{
+    for (uint8_t i=0; i<_num_rates; i++) {
+        if (_rate[i].msg_type == msg_type) {
+            // a parameter overrides the default
+            return;
+        }
+    }
+    struct rate_state &r = _rate[_num_rates++];
+    memset(&r, 0, sizeof(r));
+    for (uint8_t i=0; i<num_old; i++) {
+        if (old[i].msg_type == msg_type) {
+            r = old[i];
+            break;
+        }
+    }
+    r.msg_type = msg_type;
+    r.rate_hz = rate_hz;
+    r.interval_us = rate_hz ? 1000000UL / rate_hz : 0;
+    _rate_mask[msg_type>>5] |= 1UL<<(msg_type&31);
+}
+
+/*
+  rebuild the rate limits from the parameters and defaults. Called
+  when a log starts and regularly by the vehicle so parameter changes
+  take effect
+ */
+void DataFlash_Class::UpdateRates(void)
+{
+    struct rate_state old[DATAFLASH_RATE_SLOTS+DATAFLASH_RATE_DEFAULTS];
+    uint8_t num_old = _num_rates;
+    memcpy(old, _rate, sizeof(old));
+
+    _num_rates = 0;
+    memset(_rate_mask, 0, sizeof(_rate_mask));
+    for (uint8_t i=0; i<DATAFLASH_RATE_SLOTS; i++) {
+        int16_t msg_type = _rate_msg[i];
+        if (msg_type <= 0 || msg_type > 255) {
+            continue;
+        }
+        rate_add(old, num_old, msg_type, _rate_hz[i] > 0 ? _rate_hz[i] : 0);
+    }
+    for (uint8_t i=0; i<_num_rate_defaults; i++) {
+        rate_add(old, num_old, _rate_default[i].msg_type, _rate_default[i].rate_hz);
+    }
+}
+
+/*
+  decide if a message of a limited type is due. Messages are kept on
+  a fixed grid of the rate interval, so the average rate is right
+  even when the caller's loop doesn't divide evenly into it
+ */
+bool DataFlash_Class::rate_check(uint8_t msg_type)
+{
+    for (uint8_t i=0; i<_num_rates; i++) {
+        struct rate_state &r = _rate[i];
+        if (r.msg_type != msg_type) {
+            continue;
+        }
+        if (r.interval_us == 0) {
+            r.dropped++;
+            return false;
+        }
+        uint32_t now = hal.scheduler->micros();
+        if ((int32_t)(now - r.next_us) < 0) {
+            r.dropped++;
+            return false;
+        }
+        r.next_us += r.interval_us;
+        if ((int32_t)(now - r.next_us) >= 0) {
+            // we've fallen more than an interval behind, so don't
+            // try to catch up
+            r.next_us = now + r.interval_us;
+        }
+        r.kept++;
+        return true;
+    }
+    return true;
+}
+
+/*
+  log how many messages of each limited type have been kept and
+  dropped since boot
+ */
+void DataFlash_Class::Log_Write_Rate_Stats(void)
+{
+    if (!ShouldLog(LOG_DF_RATE_MSG)) {
+        return;
+    }
+    uint32_t now = hal.scheduler->millis();
+    for (uint8_t i=0; i<_num_rates; i++) {
+        struct log_DataFlash_Rate pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_DF_RATE_MSG),
+            time_ms  : now,
+            msg_type : _rate[i].msg_type,
+            rate_hz  : _rate[i].rate_hz,
+            kept     : _rate[i].kept,
+            dropped  : _rate[i].dropped
+        };
+        WriteBlock(&pkt, sizeof(pkt));
+    }
+}
+#endif // DATAFLASH_RATE_LIMIT
+
 /*
   write a structure format to the log
  */
@@ -618,6 +1398,9 @@ void DataFlash_Class::Log_Write_Format(const struct LogStructure *s)
  */
 void DataFlash_Class::Log_Write_Parameter(const char *name, float value)
 {
+    if (!ShouldLog(LOG_PARAMETER_MSG)) {
+        return;
+    }
     struct log_Parameter pkt = {
         LOG_PACKET_HEADER_INIT(LOG_PARAMETER_MSG),
         name  : {},
@@ -664,6 +1447,9 @@ void DataFlash_Class::Log_Write_Parameters(void)
 // Write an GPS packet
 void DataFlash_Class::Log_Write_GPS(const AP_GPS &gps, uint8_t i, int32_t relative_alt)
 {
+    if (!ShouldLog(i == 0 ? LOG_GPS_MSG : LOG_GPS2_MSG)) {
+        return;
+    }
     if (i == 0) {
         const struct Location &loc = gps.location(i);
         struct log_GPS pkt = {
@@ -682,7 +1468,7 @@ void DataFlash_Class::Log_Write_GPS(const AP_GPS &gps, uint8_t i, int32_t relati
             vel_z         : gps.velocity(i).z,
             apm_time      : hal.scheduler->millis()
         };
-        WriteBlock(&pkt, sizeof(pkt));
+        WritePacket(&pkt, sizeof(pkt));
     }
 #if HAL_CPU_CLASS > HAL_CPU_CLASS_16
     if (i > 0) {
@@ -704,7 +1490,7 @@ void DataFlash_Class::Log_Write_GPS(const AP_GPS &gps, uint8_t i, int32_t relati
             dgps_numch    : 0,
             dgps_age      : 0
         };
-        WriteBlock(&pkt2, sizeof(pkt2));
+        WritePacket(&pkt2, sizeof(pkt2));
     }
 #endif
 }
@@ -712,6 +1498,9 @@ void DataFlash_Class::Log_Write_GPS(const AP_GPS &gps, uint8_t i, int32_t relati
 // Write an RCIN packet
 void DataFlash_Class::Log_Write_RCIN(void)
 {
+    if (!ShouldLog(LOG_RCIN_MSG)) {
+        return;
+    }
     uint32_t timestamp = hal.scheduler->millis();
     struct log_RCIN pkt = {
         LOG_PACKET_HEADER_INIT(LOG_RCIN_MSG),
@@ -731,12 +1520,15 @@ void DataFlash_Class::Log_Write_RCIN(void)
         chan13        : hal.rcin->read(12),
         chan14        : hal.rcin->read(13)
     };
-    WriteBlock(&pkt, sizeof(pkt));
+    WritePacket(&pkt, sizeof(pkt));
 }
 
 // Write an SERVO packet
 void DataFlash_Class::Log_Write_RCOUT(void)
 {
+    if (!ShouldLog(LOG_RCOUT_MSG)) {
+        return;
+    }
     struct log_RCOUT pkt = {
         LOG_PACKET_HEADER_INIT(LOG_RCOUT_MSG),
         timestamp     : hal.scheduler->millis(),
@@ -749,12 +1541,15 @@ void DataFlash_Class::Log_Write_RCOUT(void)
         chan7         : hal.rcout->read(6),
         chan8         : hal.rcout->read(7)
     };
-    WriteBlock(&pkt, sizeof(pkt));
+    WritePacket(&pkt, sizeof(pkt));
 }
 
 // Write a BARO packet
 void DataFlash_Class::Log_Write_Baro(AP_Baro &baro)
 {
+    if (!ShouldLog(LOG_BARO_MSG)) {
+        return;
+    }
     struct log_BARO pkt = {
         LOG_PACKET_HEADER_INIT(LOG_BARO_MSG),
         timestamp     : hal.scheduler->millis(),
@@ -769,20 +1564,22 @@ void DataFlash_Class::Log_Write_Baro(AP_Baro &baro)
 void DataFlash_Class::Log_Write_IMU(const AP_InertialSensor &ins)
 {
     uint32_t tstamp = hal.scheduler->millis();
-    const Vector3f &gyro = ins.get_gyro(0);
-    const Vector3f &accel = ins.get_accel(0);
-    struct log_IMU pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_IMU_MSG),
-        timestamp : tstamp,
-        gyro_x  : gyro.x,
-        gyro_y  : gyro.y,
-        gyro_z  : gyro.z,
-        accel_x : accel.x,
-        accel_y : accel.y,
-        accel_z : accel.z
-    };
-    WriteBlock(&pkt, sizeof(pkt));
-    if (ins.get_gyro_count() < 2 && ins.get_accel_count() < 2) {
+    if (ShouldLog(LOG_IMU_MSG)) {
+        const Vector3f &gyro = ins.get_gyro(0);
+        const Vector3f &accel = ins.get_accel(0);
+        struct log_IMU pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_IMU_MSG),
+            timestamp : tstamp,
+            gyro_x  : gyro.x,
+            gyro_y  : gyro.y,
+            gyro_z  : gyro.z,
+            accel_x : accel.x,
+            accel_y : accel.y,
+            accel_z : accel.z
+        };
+        WritePacket(&pkt, sizeof(pkt));
+    }
+    if ((ins.get_gyro_count() < 2 && ins.get_accel_count() < 2) || !ShouldLog(LOG_IMU2_MSG)) {
         return;
     }
     const Vector3f &gyro2 = ins.get_gyro(1);
@@ -797,12 +1594,15 @@ void DataFlash_Class::Log_Write_IMU(const AP_InertialSensor &ins)
         accel_y : accel2.y,
         accel_z : accel2.z
     };
-    WriteBlock(&pkt2, sizeof(pkt2));
+    WritePacket(&pkt2, sizeof(pkt2));
 }
 
 // Write a text message to the log
 void DataFlash_Class::Log_Write_Message(const char *message)
 {
+    if (!ShouldLog(LOG_MESSAGE_MSG)) {
+        return;
+    }
     struct log_Message pkt = {
         LOG_PACKET_HEADER_INIT(LOG_MESSAGE_MSG),
         msg  : {}
@@ -814,6 +1614,9 @@ void DataFlash_Class::Log_Write_Message(const char *message)
 // Write a text message to the log
 void DataFlash_Class::Log_Write_Message_P(const prog_char_t *message)
 {
+    if (!ShouldLog(LOG_MESSAGE_MSG)) {
+        return;
+    }
     struct log_Message pkt = {
         LOG_PACKET_HEADER_INIT(LOG_MESSAGE_MSG),
         msg  : {}
@@ -826,6 +1629,9 @@ void DataFlash_Class::Log_Write_Message_P(const prog_char_t *message)
 void DataFlash_Class::Log_Write_Power(void)
 {
 #if CONFIG_HAL_BOARD == HAL_BOARD_PX4
+    if (!ShouldLog(LOG_POWR_MSG)) {
+        return;
+    }
     struct log_POWR pkt = {
         LOG_PACKET_HEADER_INIT(LOG_POWR_MSG),
         time_ms : hal.scheduler->millis(),
@@ -840,6 +1646,9 @@ void DataFlash_Class::Log_Write_Power(void)
 // Write an AHRS2 packet
 void DataFlash_Class::Log_Write_AHRS2(AP_AHRS &ahrs)
 {
+    if (!ShouldLog(LOG_AHR2_MSG)) {
+        return;
+    }
     Vector3f euler;
     struct Location loc;
     if (!ahrs.get_secondary_attitude(euler) || !ahrs.get_secondary_position(loc)) {
@@ -861,111 +1670,115 @@ void DataFlash_Class::Log_Write_AHRS2(AP_AHRS &ahrs)
 #if AP_AHRS_NAVEKF_AVAILABLE
 void DataFlash_Class::Log_Write_EKF(AP_AHRS_NavEKF &ahrs)
 {
-	// Write first EKF packet
-    Vector3f euler;
-    Vector3f posNED;
-    Vector3f velNED;
-    Vector3f dAngBias;
-    Vector3f dVelBias;
-    Vector3f gyroBias;
-    ahrs.get_NavEKF().getEulerAngles(euler);
-    ahrs.get_NavEKF().getVelNED(velNED);
-    ahrs.get_NavEKF().getPosNED(posNED);
-    ahrs.get_NavEKF().getGyroBias(gyroBias);
-    struct log_EKF1 pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_EKF1_MSG),
-        time_ms : hal.scheduler->millis(),
-        roll    : (int16_t)(100*degrees(euler.x)), // roll angle (centi-deg)
-        pitch   : (int16_t)(100*degrees(euler.y)), // pitch angle (centi-deg)
-        yaw     : (uint16_t)wrap_360_cd(100*degrees(euler.z)), // yaw angle (centi-deg)
-        velN    : (float)(velNED.x), // velocity North (m/s)
-        velE    : (float)(velNED.y), // velocity East (m/s)
-        velD    : (float)(velNED.z), // velocity Down (m/s)
-        posN    : (float)(posNED.x), // metres North
-        posE    : (float)(posNED.y), // metres East
-        posD    : (float)(posNED.z), // metres Down
-        gyrX    : (int8_t)(60*degrees(gyroBias.x)), // deg/min
-        gyrY    : (int8_t)(60*degrees(gyroBias.y)), // deg/min
-        gyrZ    : (int8_t)(60*degrees(gyroBias.z))  // deg/min
-    };
-    WriteBlock(&pkt, sizeof(pkt));
+    // the EKF may be updating on its own thread, so log the state it
+    // last published rather than reading the filter
+    struct AP_AHRS_NavEKF::ekf_log_data ekf;
+    ahrs.get_ekf_log_data(ekf);
+
+    // Write first EKF packet
+    if (ShouldLog(LOG_EKF1_MSG)) {
+        const Vector3f &euler = ekf.euler;
+        const Vector3f &posNED = ekf.posNED;
+        const Vector3f &velNED = ekf.velNED;
+        const Vector3f &gyroBias = ekf.gyroBias;
+        struct log_EKF1 pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_EKF1_MSG),
+            time_ms : hal.scheduler->millis(),
+            roll    : (int16_t)(100*degrees(euler.x)), // roll angle (centi-deg)
+            pitch   : (int16_t)(100*degrees(euler.y)), // pitch angle (centi-deg)
+            yaw     : (uint16_t)wrap_360_cd(100*degrees(euler.z)), // yaw angle (centi-deg)
+            velN    : (float)(velNED.x), // velocity North (m/s)
+            velE    : (float)(velNED.y), // velocity East (m/s)
+            velD    : (float)(velNED.z), // velocity Down (m/s)
+            posN    : (float)(posNED.x), // metres North
+            posE    : (float)(posNED.y), // metres East
+            posD    : (float)(posNED.z), // metres Down
+            gyrX    : (int8_t)(60*degrees(gyroBias.x)), // deg/min
+            gyrY    : (int8_t)(60*degrees(gyroBias.y)), // deg/min
+            gyrZ    : (int8_t)(60*degrees(gyroBias.z))  // deg/min
+        };
+        WritePacket(&pkt, sizeof(pkt));
+    }
 
-	// Write second EKF packet
-    Vector3f accelBias;
-    Vector3f wind;
-    Vector3f magNED;
-    Vector3f magXYZ;
-    ahrs.get_NavEKF().getAccelBias(accelBias);
-    ahrs.get_NavEKF().getWind(wind);
-    ahrs.get_NavEKF().getMagNED(magNED);
-    ahrs.get_NavEKF().getMagXYZ(magXYZ);
-    struct log_EKF2 pkt2 = {
-        LOG_PACKET_HEADER_INIT(LOG_EKF2_MSG),
-        time_ms : hal.scheduler->millis(),
-        accX    : (int8_t)(100*accelBias.x),
-        accY    : (int8_t)(100*accelBias.y),
-        accZ    : (int8_t)(100*accelBias.z),
-        windN   : (int16_t)(100*wind.x),
-        windE   : (int16_t)(100*wind.y),
-        magN    : (int16_t)(magNED.x),
-        magE    : (int16_t)(magNED.y),
-        magD    : (int16_t)(magNED.z),
-        magX    : (int16_t)(magXYZ.x),
-        magY    : (int16_t)(magXYZ.y),
-        magZ    : (int16_t)(magXYZ.z)
-    };
-    WriteBlock(&pkt2, sizeof(pkt2));
-
-	// Write third EKF packet
-	Vector3f velInnov;
-	Vector3f posInnov;
-	Vector3f magInnov;
-	float tasInnov;
-    ahrs.get_NavEKF().getInnovations(velInnov, posInnov, magInnov, tasInnov);
-    struct log_EKF3 pkt3 = {
-        LOG_PACKET_HEADER_INIT(LOG_EKF3_MSG),
-        time_ms : hal.scheduler->millis(),
-        innovVN : (int16_t)(100*velInnov.x),
-        innovVE : (int16_t)(100*velInnov.y),
-        innovVD : (int16_t)(100*velInnov.z),
-        innovPN : (int16_t)(100*posInnov.x),
-        innovPE : (int16_t)(100*posInnov.y),
-        innovPD : (int16_t)(100*posInnov.z),
-        innovMX : (int16_t)(magInnov.x),
-        innovMY : (int16_t)(magInnov.y),
-        innovMZ : (int16_t)(magInnov.z),
-        innovVT : (int16_t)(100*tasInnov)
-    };
-    WriteBlock(&pkt3, sizeof(pkt3));
+    // Write second EKF packet
+    if (ShouldLog(LOG_EKF2_MSG)) {
+        const Vector3f &accelBias = ekf.accelBias;
+        const Vector3f &wind = ekf.wind;
+        const Vector3f &magNED = ekf.magNED;
+        const Vector3f &magXYZ = ekf.magXYZ;
+        struct log_EKF2 pkt2 = {
+            LOG_PACKET_HEADER_INIT(LOG_EKF2_MSG),
+            time_ms : hal.scheduler->millis(),
+            accX    : (int8_t)(100*accelBias.x),
+            accY    : (int8_t)(100*accelBias.y),
+            accZ    : (int8_t)(100*accelBias.z),
+            windN   : (int16_t)(100*wind.x),
+            windE   : (int16_t)(100*wind.y),
+            magN    : (int16_t)(magNED.x),
+            magE    : (int16_t)(magNED.y),
+            magD    : (int16_t)(magNED.z),
+            magX    : (int16_t)(magXYZ.x),
+            magY    : (int16_t)(magXYZ.y),
+            magZ    : (int16_t)(magXYZ.z)
+        };
+        WritePacket(&pkt2, sizeof(pkt2));
+    }
+
+    // Write third EKF packet
+    if (ShouldLog(LOG_EKF3_MSG)) {
+        const Vector3f &velInnov = ekf.velInnov;
+        const Vector3f &posInnov = ekf.posInnov;
+        const Vector3f &magInnov = ekf.magInnov;
+        float tasInnov = ekf.tasInnov;
+        struct log_EKF3 pkt3 = {
+            LOG_PACKET_HEADER_INIT(LOG_EKF3_MSG),
+            time_ms : hal.scheduler->millis(),
+            innovVN : (int16_t)(100*velInnov.x),
+            innovVE : (int16_t)(100*velInnov.y),
+            innovVD : (int16_t)(100*velInnov.z),
+            innovPN : (int16_t)(100*posInnov.x),
+            innovPE : (int16_t)(100*posInnov.y),
+            innovPD : (int16_t)(100*posInnov.z),
+            innovMX : (int16_t)(magInnov.x),
+            innovMY : (int16_t)(magInnov.y),
+            innovMZ : (int16_t)(magInnov.z),
+            innovVT : (int16_t)(100*tasInnov)
+        };
+        WritePacket(&pkt3, sizeof(pkt3));
+    }
 	
-	// Write fourth EKF packet
-    float velVar;
-    float posVar;
-    float hgtVar;
-	Vector3f magVar;
-	float tasVar;
-    Vector2f offset;
-    ahrs.get_NavEKF().getVariances(velVar, posVar, hgtVar, magVar, tasVar, offset);
-    struct log_EKF4 pkt4 = {
-        LOG_PACKET_HEADER_INIT(LOG_EKF4_MSG),
-        time_ms : hal.scheduler->millis(),
-        sqrtvarV : (int16_t)(100*velVar),
-        sqrtvarP : (int16_t)(100*posVar),
-        sqrtvarH : (int16_t)(100*hgtVar),
-        sqrtvarMX : (int16_t)(100*magVar.x),
-        sqrtvarMY : (int16_t)(100*magVar.y),
-        sqrtvarMZ : (int16_t)(100*magVar.z),
-        sqrtvarVT : (int16_t)(100*tasVar),
-        offsetNorth : (int8_t)(offset.x),
-        offsetEast : (int8_t)(offset.y)
-    };
-    WriteBlock(&pkt4, sizeof(pkt4));
+    // Write fourth EKF packet
+    if (ShouldLog(LOG_EKF4_MSG)) {
+        float velVar = ekf.velVar;
+        float posVar = ekf.posVar;
+        float hgtVar = ekf.hgtVar;
+        const Vector3f &magVar = ekf.magVar;
+        float tasVar = ekf.tasVar;
+        const Vector2f &offset = ekf.offset;
+        struct log_EKF4 pkt4 = {
+            LOG_PACKET_HEADER_INIT(LOG_EKF4_MSG),
+            time_ms : hal.scheduler->millis(),
+            sqrtvarV : (int16_t)(100*velVar),
+            sqrtvarP : (int16_t)(100*posVar),
+            sqrtvarH : (int16_t)(100*hgtVar),
+            sqrtvarMX : (int16_t)(100*magVar.x),
+            sqrtvarMY : (int16_t)(100*magVar.y),
+            sqrtvarMZ : (int16_t)(100*magVar.z),
+            sqrtvarVT : (int16_t)(100*tasVar),
+            offsetNorth : (int8_t)(offset.x),
+            offsetEast : (int8_t)(offset.y)
+        };
+        WritePacket(&pkt4, sizeof(pkt4));
+    }
 }
 #endif
 
 // Write a command processing packet
 void DataFlash_Class::Log_Write_MavCmd(uint16_t cmd_total, const mavlink_mission_item_t& mav_cmd)
 {
+    if (!ShouldLog(LOG_CMD_MSG)) {
+        return;
+    }
     struct log_Cmd pkt = {
         LOG_PACKET_HEADER_INIT(LOG_CMD_MSG),
         time_ms         : hal.scheduler->millis(),
@@ -985,6 +1798,9 @@ void DataFlash_Class::Log_Write_MavCmd(uint16_t cmd_total, const mavlink_mission
 
 void DataFlash_Class::Log_Write_Radio(const mavlink_radio_t &packet) 
 {
+    if (!ShouldLog(LOG_RADIO_MSG)) {
+        return;
+    }
     struct log_Radio pkt = {
         LOG_PACKET_HEADER_INIT(LOG_RADIO_MSG),
         time_ms      : hal.scheduler->millis(),
@@ -999,3 +1815,102 @@ void DataFlash_Class::Log_Write_Radio(const mavlink_radio_t &packet)
     WriteBlock(&pkt, sizeof(pkt)); 
 }
 
+#if AP_SCHEDULER_TASK_STATS
+// Write execution time statistics for each scheduler task that has run
+void DataFlash_Class::Log_Write_Scheduler(const AP_Scheduler &scheduler)
+{
+    if (!ShouldLog(LOG_SCHED_MSG)) {
+        return;
+    }
+    uint32_t now = hal.scheduler->millis();
+    for (uint8_t i=0; i<scheduler.num_tasks(); i++) {
+        AP_Scheduler::task_stats stats;
+        if (!scheduler.get_task_stats(i, stats) || stats.count == 0) {
+            continue;
+        }
+        struct log_Scheduler pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_SCHED_MSG),
+            time_ms       : now,
+            task          : i,
+            count         : stats.count,
+            total_time_us : stats.total_time_us,
+            max_time_us   : stats.max_time_us,
+            slips         : stats.slips,
+            overruns      : stats.overruns,
+            hist          : {}
+        };
+        for (uint8_t b=0; b<AP_SCHEDULER_HIST_BUCKETS && b<sizeof(pkt.hist)/sizeof(pkt.hist[0]); b++) {
+            pkt.hist[b] = stats.histogram[b];
+        }
+        WriteBlock(&pkt, sizeof(pkt));
+    }
+}
+#endif
+
+// Write wakeup latency statistics for each HAL thread that measures them
+void DataFlash_Class::Log_Write_Thread_Latency(void)
+{
+    if (!ShouldLog(LOG_THREAD_LATENCY_MSG)) {
+        return;
+    }
+    uint32_t now = hal.scheduler->millis();
+    AP_HAL::Scheduler::thread_latency lat;
+    for (uint8_t i=0; hal.scheduler->get_thread_latency(i, lat); i++) {
+        struct log_Thread_Latency pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_THREAD_LATENCY_MSG),
+            time_ms  : now,
+            thread   : i,
+            count    : lat.count,
+            min_usec : lat.min_usec,
+            avg_usec : lat.avg_usec,
+            max_usec : lat.max_usec,
+            p99_usec : lat.p99_usec,
+            overruns : lat.overruns
+        };
+        WriteBlock(&pkt, sizeof(pkt));
+    }
+}
+
+#if HAL_OS_POSIX_IO
+// Write write buffer statistics, and the drop count for each message
+// type that has had messages dropped
+void DataFlash_Class::Log_Write_DataFlash_Stats(void)
+{
+    if (!ShouldLog(LOG_DF_STATS_MSG)) {
+        return;
+    }
+    struct write_stats stats;
+    if (!get_write_stats(stats)) {
+        return;
+    }
+    uint32_t now = hal.scheduler->millis();
+    struct log_DataFlash_Stats pkt = {
+        LOG_PACKET_HEADER_INIT(LOG_DF_STATS_MSG),
+        time_ms       : now,
+        dropped_msgs  : stats.dropped_msgs,
+        dropped_bytes : stats.dropped_bytes,
+        bytes_written : stats.bytes_written,
+        buf_size      : stats.buf_size,
+        buf_min_free  : stats.buf_min_free,
+        fsyncs        : stats.fsyncs
+    };
+    WriteBlock(&pkt, sizeof(pkt));
+
+    if (stats.dropped_msgs == 0 || !ShouldLog(LOG_DF_DROPS_MSG)) {
+        return;
+    }
+    for (uint16_t i=0; i<256; i++) {
+        uint16_t dropped = get_dropped_msgs(i);
+        if (dropped == 0) {
+            continue;
+        }
+        struct log_DataFlash_Drops drops = {
+            LOG_PACKET_HEADER_INIT(LOG_DF_DROPS_MSG),
+            time_ms      : now,
+            msg_type     : (uint8_t)i,
+            dropped_msgs : dropped
+        };
+        WriteBlock(&drops, sizeof(drops));
+    }
+}
+#endif
@@ -0,0 +1,320 @@
+/// -*- tab-width: 4; Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+/*
+  benchmark of the compact log encoding
+
+  Writes simulated IMU, GPS, AHR2 and EKF messages with and without
+  the compact encoding, checks that every message decodes back to the
+  original, and reports the bytes saved and the CPU cost per message
+ */
+
+// Libraries
+#include <AP_HAL.h>
+#include <AP_HAL_AVR.h>
+#include <AP_HAL_AVR_SITL.h>
+#include <AP_HAL_Empty.h>
+#include <AP_HAL_PX4.h>
+#include <AP_HAL_Linux.h>
+
+#include <AP_Common.h>
+#include <AP_Param.h>
+#include <AP_Progmem.h>
+#include <AP_Math.h>
+#include <AP_Compass.h>
+#include <Filter.h>
+#include <AP_Declination.h>
+#include <AP_Airspeed.h>
+#include <AP_Baro.h>
+#include <AP_AHRS.h>
+#include <AP_Buffer.h>
+#include <AP_ADC.h>
+#include <AP_ADC_AnalogSource.h>
+#include <AP_InertialSensor.h>
+#include <AP_GPS.h>
+#include <DataFlash.h>
+#include <GCS_MAVLink.h>
+#include <AP_Mission.h>
+#include <AP_Notify.h>
+#include <AP_Vehicle.h>
+
+const AP_HAL::HAL& hal = AP_HAL_BOARD_DRIVER;
+
+/*
+  a backend that counts what is written and keeps the last message,
+  so the benchmark measures the encoding and not the storage
+ */
+class DataFlash_Counter : public DataFlash_Empty
+{
+public:
+    void WriteBlock(const void *pBuffer, uint16_t size) {
+        bytes += size;
+        if (size <= sizeof(last)) {
+            memcpy(last, pBuffer, size);
+            last_len = size;
+        }
+    }
+    uint32_t bytes;
+    uint8_t last[4+DATAFLASH_COMPACT_MAX_LEN];
+    uint8_t last_len;
+};
+
+static DataFlash_Counter DataFlash;
+
+static const struct LogStructure log_structure[] PROGMEM = {
+    LOG_COMMON_STRUCTURES
+};
+
+// message types to test, and a typical logging rate for each in Hz
+static const struct {
+    uint8_t type;
+    uint8_t rate;
+} tests[] = {
+    { LOG_IMU_MSG,  50 },
+    { LOG_GPS_MSG,  5 },
+    { LOG_AHR2_MSG, 10 },
+    { LOG_EKF1_MSG, 10 },
+    { LOG_EKF2_MSG, 10 },
+    { LOG_EKF3_MSG, 10 },
+    { LOG_EKF4_MSG, 10 },
+};
+
+#define NUM_MESSAGES 500
+
+static uint32_t seed = 1;
+
+// uniform noise in -scale to scale
+static float noise(float scale)
+{
+    seed = seed * 1103515245UL + 12345UL;
+    return scale * (((seed >> 16) & 0x7FFF) / 16384.0f - 1.0f);
+}
+
+/*
+  fill in message n of a type, following a slow circle with some
+  sensor noise
+ */
+static void make_message(uint8_t type, uint16_t n, uint16_t rate, uint8_t *msg)
+{
+    uint32_t time_ms = 1000UL + (1000UL * n) / rate;
+    float t = time_ms * 0.001f;
+    float yaw = fmodf(t * 0.2f, 2*PI);
+    switch (type) {
+    case LOG_IMU_MSG: {
+        struct log_IMU pkt;
+        pkt.timestamp = time_ms;
+        pkt.gyro_x = noise(0.01f);
+        pkt.gyro_y = noise(0.01f);
+        pkt.gyro_z = 0.2f + noise(0.01f);
+        pkt.accel_x = noise(0.3f);
+        pkt.accel_y = 2.0f + noise(0.3f);
+        pkt.accel_z = -9.81f + noise(0.3f);
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    case LOG_GPS_MSG: {
+        struct log_GPS pkt;
+        pkt.status = 3;
+        pkt.gps_week_ms = 300000000UL + time_ms;
+        pkt.gps_week = 1800;
+        pkt.num_sats = 10;
+        pkt.hdop = 140;
+        pkt.latitude = -353632620L + (int32_t)(4500 * sinf(yaw));
+        pkt.longitude = 1491652370L + (int32_t)(5500 * cosf(yaw));
+        pkt.rel_altitude = 1000 + (int32_t)noise(20);
+        pkt.altitude = 58400 + (int32_t)noise(20);
+        pkt.ground_speed = 1000 + (int32_t)noise(10);
+        pkt.ground_course = (int32_t)ToDeg(yaw) * 100;
+        pkt.vel_z = noise(0.1f);
+        pkt.apm_time = time_ms;
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    case LOG_AHR2_MSG: {
+        struct log_AHRS pkt;
+        pkt.time_ms = time_ms;
+        pkt.roll = 1150 + (int16_t)noise(5);
+        pkt.pitch = (int16_t)noise(5);
+        pkt.yaw = (uint16_t)(ToDeg(yaw) * 100);
+        pkt.alt = 594.0f + noise(0.1f);
+        pkt.lat = -353632620L + (int32_t)(4500 * sinf(yaw));
+        pkt.lng = 1491652370L + (int32_t)(5500 * cosf(yaw));
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    case LOG_EKF1_MSG: {
+        struct log_EKF1 pkt;
+        pkt.time_ms = time_ms;
+        pkt.roll = 1150 + (int16_t)noise(5);
+        pkt.pitch = (int16_t)noise(5);
+        pkt.yaw = (uint16_t)(ToDeg(yaw) * 100);
+        pkt.velN = -10 * sinf(yaw);
+        pkt.velE = 10 * cosf(yaw);
+        pkt.velD = noise(0.1f);
+        pkt.posN = 50 * cosf(yaw);
+        pkt.posE = 50 * sinf(yaw);
+        pkt.posD = -10 + noise(0.1f);
+        pkt.gyrX = (int16_t)noise(3);
+        pkt.gyrY = (int16_t)noise(3);
+        pkt.gyrZ = (int16_t)noise(3);
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    case LOG_EKF2_MSG: {
+        struct log_EKF2 pkt;
+        pkt.time_ms = time_ms;
+        pkt.accX = (int8_t)noise(3);
+        pkt.accY = (int8_t)noise(3);
+        pkt.accZ = (int8_t)noise(3);
+        pkt.windN = 300 + (int16_t)noise(2);
+        pkt.windE = -200 + (int16_t)noise(2);
+        pkt.magN = 221;
+        pkt.magE = 52;
+        pkt.magD = -531;
+        pkt.magX = (int16_t)noise(2);
+        pkt.magY = (int16_t)noise(2);
+        pkt.magZ = (int16_t)noise(2);
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    case LOG_EKF3_MSG: {
+        struct log_EKF3 pkt;
+        pkt.time_ms = time_ms;
+        pkt.innovVN = (int16_t)noise(20);
+        pkt.innovVE = (int16_t)noise(20);
+        pkt.innovVD = (int16_t)noise(20);
+        pkt.innovPN = (int16_t)noise(30);
+        pkt.innovPE = (int16_t)noise(30);
+        pkt.innovPD = (int16_t)noise(30);
+        pkt.innovMX = (int16_t)noise(5);
+        pkt.innovMY = (int16_t)noise(5);
+        pkt.innovMZ = (int16_t)noise(5);
+        pkt.innovVT = 0;
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    case LOG_EKF4_MSG: {
+        struct log_EKF4 pkt;
+        pkt.time_ms = time_ms;
+        pkt.sqrtvarV = 12 + (int16_t)noise(2);
+        pkt.sqrtvarP = 8 + (int16_t)noise(2);
+        pkt.sqrtvarH = 20 + (int16_t)noise(2);
+        pkt.sqrtvarMX = 3;
+        pkt.sqrtvarMY = 3;
+        pkt.sqrtvarMZ = 4;
+        pkt.sqrtvarVT = 0;
+        pkt.offsetNorth = 0;
+        pkt.offsetEast = 0;
+        memcpy(msg, &pkt, sizeof(pkt));
+        break;
+    }
+    }
+    msg[0] = HEAD_BYTE1;
+    msg[1] = HEAD_BYTE2;
+    msg[2] = type;
+}
+
+static uint8_t message_length(uint8_t type)
+{
+    for (uint8_t i=0; i<sizeof(log_structure)/sizeof(log_structure[0]); i++) {
+        if (pgm_read_byte(&log_structure[i].msg_type) == type) {
+            return pgm_read_byte(&log_structure[i].msg_len);
+        }
+    }
+    return 0;
+}
+
+/*
+  write NUM_MESSAGES messages of a type, returning the bytes written
+  and the time taken. With check set every message written is decoded
+  as a log reader would and compared with the original
+ */
+static uint32_t run(uint8_t type, uint8_t rate, bool check, uint32_t &usec, uint16_t &errors)
+{
+    uint8_t len = message_length(type);
+    uint8_t msg[DATAFLASH_COMPACT_MAX_LEN];
+    uint8_t ref[DATAFLASH_COMPACT_MAX_LEN];
+    char encoding[16];
+    char format[17];
+    for (uint8_t i=0; i<sizeof(log_structure)/sizeof(log_structure[0]); i++) {
+        if (pgm_read_byte(&log_structure[i].msg_type) == type) {
+            strncpy_P(format, log_structure[i].format, 16);
+            format[16] = 0;
+        }
+    }
+    DataFlash_Class::compact_encoding(format, len, encoding);
+
+    DataFlash.bytes = 0;
+    usec = 0;
+    seed = 1;
+    for (uint16_t n=0; n<NUM_MESSAGES; n++) {
+        make_message(type, n, rate, msg);
+        uint32_t start = hal.scheduler->micros();
+        DataFlash.WritePacket(msg, len);
+        usec += hal.scheduler->micros() - start;
+        if (!check) {
+            continue;
+        }
+        const uint8_t *last = DataFlash.last;
+        if (last[2] == LOG_COMPACT_MSG) {
+            int16_t used = DataFlash_Class::compact_decode(encoding, len, &last[4],
+                                                           DataFlash.last_len-4, ref);
+            if (used != DataFlash.last_len-4) {
+                errors++;
+            }
+        } else {
+            memcpy(ref, last, len);
+        }
+        if (memcmp(ref, msg, len) != 0) {
+            errors++;
+        }
+    }
+    return DataFlash.bytes;
+}
+
+void setup()
+{
+    DataFlash.Init(log_structure, sizeof(log_structure)/sizeof(log_structure[0]));
+
+    hal.console->println("DataFlash compact encoding benchmark");
+}
+
+void loop()
+{
+    hal.console->printf("%u messages of each type, full message every %u\n",
+                        (unsigned)NUM_MESSAGES, (unsigned)DATAFLASH_COMPACT_KEYFRAME);
+    hal.console->println("Type  Len Compact  Saved  Rate  Saved/s  Full us  Compact us  Errors");
+
+    uint32_t total_saved = 0;
+    for (uint8_t i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+        uint8_t type = tests[i].type;
+        uint32_t full_usec, compact_usec;
+        uint16_t errors = 0;
+
+        DataFlash.ClearCompact();
+        uint32_t full = run(type, tests[i].rate, false, full_usec, errors);
+
+        DataFlash.ClearCompact();
+        if (!DataFlash.SetCompact(type)) {
+            hal.console->printf("%4u  can't be compacted\n", (unsigned)type);
+            continue;
+        }
+        uint32_t compact = run(type, tests[i].rate, true, compact_usec, errors);
+
+        uint32_t saved_per_sec = ((full - compact) * tests[i].rate) / NUM_MESSAGES;
+        total_saved += saved_per_sec;
+        hal.console->printf("%4u %4u %7.1f %5.1f%% %5u %8lu %8.2f %11.2f %7u\n",
+                            (unsigned)type,
+                            (unsigned)message_length(type),
+                            compact / (float)NUM_MESSAGES,
+                            100.0f * (full - compact) / full,
+                            (unsigned)tests[i].rate,
+                            (unsigned long)saved_per_sec,
+                            full_usec / (float)NUM_MESSAGES,
+                            compact_usec / (float)NUM_MESSAGES,
+                            (unsigned)errors);
+    }
+    hal.console->printf("Total saved %lu bytes/s at the rates above\n", (unsigned long)total_saved);
+    hal.console->println("Test will repeat in 20 seconds");
+    hal.scheduler->delay(20000);
+}
+
+AP_HAL_MAIN();
@@ -21,6 +21,7 @@
 #include <AP_Airspeed.h>
 #include <AP_Baro.h>
 #include <AP_AHRS.h>
+#include <AP_Buffer.h>
 #include <AP_ADC.h>
 #include <AP_ADC_AnalogSource.h>
 #include <AP_InertialSensor.h>
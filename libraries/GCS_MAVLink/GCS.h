@@ -12,8 +12,30 @@
 #include <GCS_MAVLink.h>
 #include <DataFlash.h>
 #include <AP_Mission.h>
+#include <AP_Scheduler.h>
 #include <stdint.h>
 
+/*
+  log download tuning. Boards with RAM to spare read the log in large
+  blocks and pace the download from the link feedback rather than a
+  fixed number of packets per call. The prefetch size is limited by
+  the int16_t return of DataFlash_Class::get_log_data()
+ */
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+#define GCS_LOG_PREFETCH_SIZE 16384
+#elif HAL_CPU_CLASS >= HAL_CPU_CLASS_75
+#define GCS_LOG_PREFETCH_SIZE 4096
+#else
+#define GCS_LOG_PREFETCH_SIZE 0
+#endif
+
+#if GCS_LOG_PREFETCH_SIZE
+// re-requested ranges that can be queued while a download is running
+#define GCS_LOG_MAX_RANGES    4
+// time budget for sending log data in each call
+#define GCS_LOG_SEND_TIME_US  2000
+#endif
+
 //  GCS Message ID's
 /// NOTE: to ensure we never block on sending MAVLink messages
 /// please keep each MSG_ to a single MAVLink message. If need be
@@ -46,6 +68,8 @@ enum ap_message {
     MSG_HWSTATUS,
     MSG_WIND,
     MSG_RANGEFINDER,
+    MSG_SCHED_STATS,
+    MSG_DATAFLASH_STATS,
     MSG_RETRY_DEFERRED // this must be last
 };
 
@@ -186,6 +210,12 @@ public:
     void send_meminfo(void);
     void send_power_status(void);
     void send_ahrs2(AP_AHRS &ahrs);
+#if AP_SCHEDULER_TASK_STATS
+    void send_scheduler_stats(const AP_Scheduler &scheduler);
+#endif
+#if HAL_OS_POSIX_IO
+    void send_dataflash_stats(const DataFlash_Class &dataflash);
+#endif
 
 private:
     void        handleMessage(mavlink_message_t * msg);
@@ -280,6 +310,34 @@ private:
     // start page of log data
     uint16_t _log_data_page;
 
+#if GCS_LOG_PREFETCH_SIZE
+    // block of log data read ahead of the packets being sent
+    uint8_t *_log_prefetch;
+    uint32_t _log_prefetch_ofs;
+    uint16_t _log_prefetch_len;
+
+    // ranges the GCS asked for again while we were sending another,
+    // sent before returning to the interrupted range
+    struct {
+        uint32_t ofs;
+        uint32_t count;
+    } _log_ranges[GCS_LOG_MAX_RANGES];
+    uint8_t _log_num_ranges;
+
+    // download throughput
+    uint32_t _log_send_start_ms;
+    uint32_t _log_bytes_sent;
+
+    // last txbuf reported by a radio on this link
+    uint8_t  _radio_txbuf;
+    uint32_t _radio_status_ms;
+#endif
+
+#if AP_SCHEDULER_TASK_STATS
+    // next scheduler task to report statistics for
+    uint8_t _sched_stats_task;
+#endif
+
     // deferred message handling
     enum ap_message deferred_messages[MSG_RETRY_DEFERRED];
     uint8_t next_deferred_message;
@@ -297,6 +355,8 @@ private:
     void handle_log_send(DataFlash_Class &dataflash);
     void handle_log_send_listing(DataFlash_Class &dataflash);
     bool handle_log_send_data(DataFlash_Class &dataflash);
+    int16_t handle_log_read(DataFlash_Class &dataflash, uint16_t len, uint8_t *data);
+    void handle_log_send_done(void);
 
     void handle_mission_request_list(AP_Mission &mission, mavlink_message_t *msg);
     void handle_mission_request(AP_Mission &mission, mavlink_message_t *msg);
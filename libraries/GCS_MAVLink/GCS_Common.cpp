@@ -27,6 +27,12 @@ uint32_t GCS_MAVLINK::last_radio_status_remrssi_ms;
 GCS_MAVLINK::GCS_MAVLINK() :
     waypoint_receive_timeout(1000)
 {
+#if GCS_LOG_PREFETCH_SIZE
+    _log_prefetch = NULL;
+    _log_prefetch_len = 0;
+    _log_num_ranges = 0;
+    _radio_status_ms = 0;
+#endif
     AP_Param::setup_object_defaults(this, var_info);
 }
 
@@ -181,6 +187,60 @@ void GCS_MAVLINK::send_ahrs2(AP_AHRS &ahrs)
 #endif
 }
 
+#if AP_SCHEDULER_TASK_STATS
+/*
+  report execution statistics for one scheduler task per call, working
+  through the task table in turn. This uses DEBUG_VECT with the name
+  set to SCHD followed by the task number, time_usec holding the total
+  time the task has run for, and x, y and z holding the number of
+  runs, the longest run in microseconds and the number of slips
+ */
+void GCS_MAVLINK::send_scheduler_stats(const AP_Scheduler &scheduler)
+{
+    AP_Scheduler::task_stats stats;
+    for (uint8_t i=0; i<scheduler.num_tasks(); i++) {
+        uint8_t task = _sched_stats_task++;
+        if (_sched_stats_task >= scheduler.num_tasks()) {
+            _sched_stats_task = 0;
+        }
+        if (!scheduler.get_task_stats(task, stats) || stats.count == 0) {
+            continue;
+        }
+        char name[10];
+        hal.util->snprintf(name, sizeof(name), "SCHD%u", (unsigned)task);
+        mavlink_msg_debug_vect_send(chan,
+                                    name,
+                                    stats.total_time_us,
+                                    stats.count,
+                                    stats.max_time_us,
+                                    stats.slips);
+        return;
+    }
+}
+#endif
+
+#if HAL_OS_POSIX_IO
+/*
+  report log write buffer statistics. This uses DEBUG_VECT with the
+  name set to DFSTAT, time_usec holding the number of bytes written,
+  and x, y and z holding the number of messages dropped, the number of
+  bytes dropped and the lowest free space seen in the write buffer
+ */
+void GCS_MAVLINK::send_dataflash_stats(const DataFlash_Class &dataflash)
+{
+    DataFlash_Class::write_stats stats;
+    if (!dataflash.get_write_stats(stats)) {
+        return;
+    }
+    mavlink_msg_debug_vect_send(chan,
+                                "DFSTAT",
+                                stats.bytes_written,
+                                stats.dropped_msgs,
+                                stats.dropped_bytes,
+                                stats.buf_min_free);
+}
+#endif
+
 /*
   handle a MISSION_REQUEST_LIST mavlink packet
  */
@@ -650,6 +710,12 @@ void GCS_MAVLINK::handle_radio_status(mavlink_message_t *msg, DataFlash_Class &d
         stream_slowdown--;
     }
 
+#if GCS_LOG_PREFETCH_SIZE
+    // also used to pace log downloads
+    _radio_txbuf = packet.txbuf;
+    _radio_status_ms = hal.scheduler->millis();
+#endif
+
     //log rssi, noise, etc if logging Performance monitoring data
     if (log_radio) {
         dataflash.Log_Write_Radio(packet);
@@ -42,6 +42,9 @@ void GCS_MAVLINK::handle_log_message(mavlink_message_t *msg, DataFlash_Class &da
         break;
     case MAVLINK_MSG_ID_LOG_REQUEST_END:
         _log_sending = false;
+#if GCS_LOG_PREFETCH_SIZE
+        _log_num_ranges = 0;
+#endif
         break;
     }
         
@@ -67,14 +70,17 @@ void GCS_MAVLINK::handle_log_request_list(mavlink_message_t *msg, DataFlash_Clas
     } else {
         uint16_t last_log_num = dataflash.find_last_log();
 
-        _log_next_list_entry = packet.start;
         _log_last_list_entry = packet.end;
-
         if (_log_last_list_entry > last_log_num) {
             _log_last_list_entry = last_log_num;
         }
-        if (_log_next_list_entry < last_log_num + 1 - _log_num_logs) {
-            _log_next_list_entry = last_log_num + 1 - _log_num_logs;
+
+        // log numbers may have gaps, so start at the first log at or
+        // after the requested start
+        _log_next_list_entry = dataflash.find_next_log(packet.start > 0 ? packet.start - 1 : 0);
+        if (_log_next_list_entry == 0 || _log_next_list_entry > _log_last_list_entry) {
+            _log_next_list_entry = 0;
+            _log_last_list_entry = 0;
         }
     }
 
@@ -97,9 +103,7 @@ void GCS_MAVLINK::handle_log_request_data(mavlink_message_t *msg, DataFlash_Clas
     if (!_log_sending || _log_num_data != packet.id) {
         _log_sending = false;
 
-        uint16_t num_logs = dataflash.get_num_logs();
-        uint16_t last_log_num = dataflash.find_last_log();
-        if (packet.id > last_log_num || packet.id < last_log_num + 1 - num_logs) {
+        if (packet.id == 0 || dataflash.find_next_log(packet.id - 1) != packet.id) {
             return;
         }
 
@@ -110,7 +114,25 @@ void GCS_MAVLINK::handle_log_request_data(mavlink_message_t *msg, DataFlash_Clas
 
         uint16_t end;
         dataflash.get_log_boundaries(packet.id, _log_data_page, end);
+
+#if GCS_LOG_PREFETCH_SIZE
+        _log_prefetch_len = 0;
+        _log_num_ranges = 0;
+        _log_send_start_ms = hal.scheduler->millis();
+        _log_bytes_sent = 0;
+#endif
     }
+#if GCS_LOG_PREFETCH_SIZE
+    else if (_log_data_remaining != 0 &&
+             _log_num_ranges < GCS_LOG_MAX_RANGES) {
+        // the GCS is re-requesting a range it lost while we are
+        // still sending. Send that first, then come back to the rest
+        // of the current range
+        _log_ranges[_log_num_ranges].ofs = _log_data_offset;
+        _log_ranges[_log_num_ranges].count = _log_data_remaining;
+        _log_num_ranges++;
+    }
+#endif
 
     _log_data_offset = packet.ofs;
     if (_log_data_offset >= _log_data_size) {
@@ -137,6 +159,33 @@ void GCS_MAVLINK::handle_log_send(DataFlash_Class &dataflash)
     if (!_log_sending) {
         return;
     }
+#if GCS_LOG_PREFETCH_SIZE
+    /*
+      send while the link has room, within a time budget. A radio
+      reporting that its buffer is filling up limits us to one packet
+      per call, or none when it is nearly full
+     */
+    if (hal.scheduler->millis() - _radio_status_ms < 5000) {
+        if (_radio_txbuf < 20) {
+            return;
+        }
+        if (_radio_txbuf < 50) {
+            handle_log_send_data(dataflash);
+            return;
+        }
+    }
+    uint32_t start_us = hal.scheduler->micros();
+    while (_log_sending &&
+           hal.scheduler->micros() - start_us < GCS_LOG_SEND_TIME_US) {
+        // leave room for one packet of other traffic
+        if (comm_get_txspace(chan) < 2*(MAVLINK_NUM_NON_PAYLOAD_BYTES+MAVLINK_MSG_ID_LOG_DATA_LEN)) {
+            break;
+        }
+        if (!handle_log_send_data(dataflash)) {
+            break;
+        }
+    }
+#else
     uint8_t num_sends = 1;
     if (chan == MAVLINK_COMM_0 && hal.gpio->usb_connected()) {
         // when on USB we can send a lot more data
@@ -155,6 +204,7 @@ void GCS_MAVLINK::handle_log_send(DataFlash_Class &dataflash)
             if (!handle_log_send_data(dataflash)) break;
         }
     }
+#endif
 }
 
 /**
@@ -183,7 +233,10 @@ void GCS_MAVLINK::handle_log_send_listing(DataFlash_Class &dataflash)
     if (_log_next_list_entry == _log_last_list_entry) {
         _log_listing = false;
     } else {
-        _log_next_list_entry++;
+        _log_next_list_entry = dataflash.find_next_log(_log_next_list_entry);
+        if (_log_next_list_entry == 0 || _log_next_list_entry > _log_last_list_entry) {
+            _log_listing = false;
+        }
     }
 }
 
@@ -209,7 +262,7 @@ bool GCS_MAVLINK::handle_log_send_data(DataFlash_Class &dataflash)
     if (len > 90) {
         len = 90;
     }
-    ret = dataflash.get_log_data(_log_num_data, _log_data_page, _log_data_offset, len, packet.data);
+    ret = handle_log_read(dataflash, len, packet.data);
     if (ret < 0) {
         // report as EOF on error
         ret = 0;
@@ -226,8 +279,84 @@ bool GCS_MAVLINK::handle_log_send_data(DataFlash_Class &dataflash)
 
     _log_data_offset += len;
     _log_data_remaining -= len;
+#if GCS_LOG_PREFETCH_SIZE
+    _log_bytes_sent += ret;
+#endif
     if (ret < 90 || _log_data_remaining == 0) {
-        _log_sending = false;
+        handle_log_send_done();
     }
     return true;
 }
+
+/**
+   read len bytes of log data at the current offset. Where we have the
+   memory the log is read in large blocks, as a backend read costs
+   much the same for one packet as for a few kilobytes
+ */
+int16_t GCS_MAVLINK::handle_log_read(DataFlash_Class &dataflash, uint16_t len, uint8_t *data)
+{
+#if GCS_LOG_PREFETCH_SIZE
+    if (_log_prefetch == NULL) {
+        _log_prefetch = (uint8_t *)malloc(GCS_LOG_PREFETCH_SIZE);
+    }
+    if (_log_prefetch != NULL) {
+        uint32_t ofs = _log_data_offset;
+        if (ofs < _log_prefetch_ofs ||
+            ofs + len > _log_prefetch_ofs + _log_prefetch_len) {
+            int16_t ret = dataflash.get_log_data(_log_num_data, _log_data_page, ofs,
+                                                 GCS_LOG_PREFETCH_SIZE, _log_prefetch);
+            if (ret < 0) {
+                _log_prefetch_len = 0;
+                return ret;
+            }
+            _log_prefetch_ofs = ofs;
+            _log_prefetch_len = ret;
+        }
+        // a short block means we have reached the end of the log
+        uint32_t avail = (_log_prefetch_ofs + _log_prefetch_len) - ofs;
+        if (len > avail) {
+            len = avail;
+        }
+        memcpy(data, &_log_prefetch[ofs - _log_prefetch_ofs], len);
+        return len;
+    }
+#endif
+    return dataflash.get_log_data(_log_num_data, _log_data_page, _log_data_offset, len, data);
+}
+
+/**
+   the current range has been sent. Move on to any queued re-request,
+   otherwise finish the download and report the throughput achieved
+ */
+void GCS_MAVLINK::handle_log_send_done(void)
+{
+#if GCS_LOG_PREFETCH_SIZE
+    if (_log_num_ranges > 0) {
+        _log_num_ranges--;
+        _log_data_offset = _log_ranges[_log_num_ranges].ofs;
+        _log_data_remaining = _log_ranges[_log_num_ranges].count;
+        return;
+    }
+    _log_sending = false;
+
+    uint32_t dt_ms = hal.scheduler->millis() - _log_send_start_ms;
+    if (dt_ms == 0) {
+        dt_ms = 1;
+    }
+    char msg[50];
+    hal.util->snprintf(msg, sizeof(msg), "Log %u: %lu bytes %lu.%lus %lukB/s",
+                       (unsigned)_log_num_data,
+                       (unsigned long)_log_bytes_sent,
+                       (unsigned long)(dt_ms / 1000),
+                       (unsigned long)((dt_ms % 1000) / 100),
+                       (unsigned long)(_log_bytes_sent / dt_ms));
+    send_text(SEVERITY_LOW, msg);
+
+    // release the prefetch block until the next download
+    free(_log_prefetch);
+    _log_prefetch = NULL;
+    _log_prefetch_len = 0;
+#else
+    _log_sending = false;
+#endif
+}
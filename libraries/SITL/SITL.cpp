@@ -97,6 +97,10 @@ void SITL::Log_Write_SIMSTATE(DataFlash_Class &DataFlash)
 	double p, q, r;
 	float yaw;
 
+    if (!DataFlash.ShouldLog(LOG_SIMSTATE_MSG)) {
+        return;
+    }
+
 	// we want the gyro values to be directly comparable to the
 	// raw_imu message, which is in body frame
 	convert_body_frame(state.rollDeg, state.pitchDeg,